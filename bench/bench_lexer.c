@@ -0,0 +1,124 @@
+// measures lexer throughput in bytes/sec
+// usage: bench-lexer [-j threads] [file]   (without a file a synthetic source is generated)
+
+// clock_gettime, the lexer may run on several threads
+#define _POSIX_C_SOURCE 199309L
+
+#include "../src/lexer.h"
+#include "../src/os.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_ITERATIONS 3
+#define BENCH_SYNTHETIC_SIZE MEGABYTES(16)
+
+static char* generate_source(size_t size)
+{
+    const char *function =
+        "/* generated function\n"
+        " * with a multi-line comment */\n"
+        "double function_name(double alpha, double beta, char *text) {\n"
+        "    double result = alpha * 2.5 + beta;\n"
+        "    char *copy = \"some string literal\";\n"
+        "    // single line comment\n"
+        "    while (result > 0.0 && beta >= 1.0 || !(result == beta)) {\n"
+        "        if (result != 2.0) { result = result / 2.0; } else { result = result - 1.0; }\n"
+        "        beta = beta - 0.5; copy = text;\n"
+        "    }\n"
+        "    return result + alpha * (beta - 12345.0);\n"
+        "}\n\n";
+    size_t function_length = strlen(function);
+
+    char *source = malloc(size + 1);
+    if (!source)
+    {
+        printf("error: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t length = 0;
+    while (length + function_length <= size)
+    {
+        memcpy(source + length, function, function_length);
+        length += function_length;
+    }
+    source[length] = '\0';
+    return source;
+}
+
+static double get_seconds()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    i32 thread_count = 0;
+    if (argc > 2 && strcmp(argv[1], "-j") == 0)
+    {
+        thread_count = atoi(argv[2]);
+        argc -= 2;
+        argv += 2;
+    }
+    lexer_set_thread_count(thread_count);
+
+    char *source = argc > 1 ? os_read_file_as_string(argv[1]) : generate_source(BENCH_SYNTHETIC_SIZE);
+    if (!source)
+    {
+        return 1;
+    }
+    size_t length = strlen(source);
+
+    double best_seconds = 0;
+    i64 token_count = 0;
+    for (i32 iteration = 0; iteration < BENCH_ITERATIONS; iteration++)
+    {
+        double start = get_seconds();
+        lexer_init(source);
+        double seconds = get_seconds() - start;
+        if (iteration == 0 || seconds < best_seconds)
+        {
+            best_seconds = seconds;
+        }
+    }
+
+    // the whole file is lexed by lexer_init, count the tokens afterwards
+    for (;;)
+    {
+        Token token = lexer_peek_token(0);
+        if (token.type == '\0' ||
+            token.type == TOKEN_UNCLOSED_COMMENT ||
+            token.type == TOKEN_UNCLOSED_STRING)
+        {
+            break;
+        }
+        lexer_eat_token();
+        token_count++;
+    }
+
+    printf("lexed %zu bytes, %lld tokens in %.3f s: %.1f MB/s\n",
+           length, (long long)token_count, best_seconds, length / best_seconds / MEGABYTES(1));
+
+    // insert one character in the middle of the source and relex
+    size_t edit_offset = length / 2;
+    char *edited = malloc(length + 2);
+    if (!edited)
+    {
+        printf("error: out of memory\n");
+        return 1;
+    }
+    memcpy(edited, source, edit_offset);
+    edited[edit_offset] = ' ';
+    memcpy(edited + edit_offset + 1, source + edit_offset, length - edit_offset + 1);
+
+    double start = get_seconds();
+    lexer_relex(edited, edit_offset, 0, 1);
+    double relex_seconds = get_seconds() - start;
+    printf("relexed a 1 byte edit in %.1f us\n", relex_seconds * 1e6);
+    return 0;
+}
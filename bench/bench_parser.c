@@ -0,0 +1,246 @@
+// measures parser time on single expressions of growing operand counts, on a file
+// of many functions with growing thread counts, on the signatures of that file, on
+// an incremental parse of it after an edit, and on statements and parentheses nested
+// deeper and deeper, which are typechecked too
+// usage: bench-parser   (the time per operand should stay flat as the expressions grow,
+//                        the file should parse faster with every thread up to the core count,
+//                        the signatures should take about as long as lexing the file,
+//                        the incremental parse should take a fraction of the full one,
+//                        the time per nesting level should stay flat as the nesting grows,
+//                        for the parse and the check)
+
+// clock_gettime
+#define _POSIX_C_SOURCE 199309L
+
+#include "../src/lexer.h"
+#include "../src/parser.h"
+#include "../src/typer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// a long chain of '+' with unary operators, parenthesis and every precedence level in between
+#define BENCH_TERM "a * b + -a / (b - 1) % a + (b <= a && !b || a) + "
+#define BENCH_TERM_OPERANDS 10
+
+static char* generate_expression_source(i64 operand_count)
+{
+    const char *begin = "int function_name(int a, int b) {\n    return ";
+    const char *end = "a;\n}\n";
+    size_t term_length = strlen(BENCH_TERM);
+    i64 term_count = operand_count / BENCH_TERM_OPERANDS;
+
+    size_t size = strlen(begin) + term_count * term_length + strlen(end);
+    char *source = malloc(size + 1);
+    if (!source)
+    {
+        printf("error: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    char *at = source;
+    at += sprintf(at, "%s", begin);
+    for (i64 i = 0; i < term_count; i++)
+    {
+        memcpy(at, BENCH_TERM, term_length);
+        at += term_length;
+    }
+    sprintf(at, "%s", end);
+    return source;
+}
+
+#define BENCH_FUNCTION_COUNT 50000
+
+static char* generate_functions_source(i32 function_count)
+{
+    const char *function =
+        "int f%d(int a, double b) {\n"
+        "    int x = a * 2 + 7;\n"
+        "    double y = b / 2.5;\n"
+        "    while (y > 0.0) { x = x - 1; y = y - 1.0; }\n"
+        "    if (x > a && !(y < 1.0)) { x = x * (a - 1); } else { x = f%d(x, y); }\n"
+        "    return x;\n"
+        "}\n";
+
+    size_t size = (size_t)function_count * (strlen(function) + 20);
+    char *source = malloc(size + 1);
+    if (!source)
+    {
+        printf("error: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    char *at = source;
+    for (i32 i = 0; i < function_count; i++)
+    {
+        at += sprintf(at, function, i, i);
+    }
+    return source;
+}
+
+// if (a) { ... } nested depth times, or -( ... ) nested depth times around a return value
+static char* generate_nested_source(i64 depth, b32 parentheses)
+{
+    const char *begin = "int function_name(int a) {\n";
+    const char *open = parentheses ? "-(" : "if (a) { ";
+    const char *inner = parentheses ? "a" : "a = a + 1; ";
+    const char *close = parentheses ? ")" : "} ";
+    const char *end = parentheses ? ";\n}\n" : "\n    return a;\n}\n";
+
+    size_t size = strlen(begin) + strlen("    return ") +
+                  depth * (strlen(open) + strlen(close)) + strlen(inner) + strlen(end);
+    char *source = malloc(size + 1);
+    if (!source)
+    {
+        printf("error: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    char *at = source;
+    at += sprintf(at, "%s", begin);
+    at += sprintf(at, "%s", parentheses ? "    return " : "    ");
+    for (i64 i = 0; i < depth; i++)
+    {
+        at += sprintf(at, "%s", open);
+    }
+    at += sprintf(at, "%s", inner);
+    for (i64 i = 0; i < depth; i++)
+    {
+        at += sprintf(at, "%s", close);
+    }
+    sprintf(at, "%s", end);
+    return source;
+}
+
+static double get_seconds()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+int main()
+{
+    i64 operand_counts[] = {10000, 100000, 1000000};
+
+    for (size_t i = 0; i < sizeof(operand_counts) / sizeof(operand_counts[0]); i++)
+    {
+        char *source = generate_expression_source(operand_counts[i]);
+
+        Ast ast;
+        double start = get_seconds();
+        b32 parsed = parse_source(source, &ast);
+        double seconds = get_seconds() - start;
+        if (!parsed)
+        {
+            return 1;
+        }
+
+        printf("parsed %lld operands in %.3f ms: %.1f ns/operand\n",
+               (long long)operand_counts[i], seconds * 1e3, seconds * 1e9 / operand_counts[i]);
+        ast_free(&ast);
+    }
+
+    // lexing is part of parse_source, it stays on one thread to show the parser's scaling
+    lexer_set_thread_count(1);
+    char *source = generate_functions_source(BENCH_FUNCTION_COUNT);
+    i32 thread_counts[] = {1, 2, 4, 8};
+    for (size_t i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); i++)
+    {
+        parse_set_thread_count(thread_counts[i]);
+
+        Ast ast;
+        double start = get_seconds();
+        b32 parsed = parse_source(source, &ast);
+        double seconds = get_seconds() - start;
+        if (!parsed)
+        {
+            return 1;
+        }
+
+        printf("parsed %d functions on %d threads in %.3f ms\n",
+               BENCH_FUNCTION_COUNT, thread_counts[i], seconds * 1e3);
+        ast_free(&ast);
+    }
+
+    double start = get_seconds();
+    lexer_init(source);
+    double lex_seconds = get_seconds() - start;
+    printf("lexed %d functions in %.3f ms\n", BENCH_FUNCTION_COUNT, lex_seconds * 1e3);
+
+    parse_set_lazy_bodies(true);
+    Ast ast;
+    start = get_seconds();
+    b32 parsed = parse_source(source, &ast);
+    double seconds = get_seconds() - start;
+    if (!parsed)
+    {
+        return 1;
+    }
+    printf("parsed the signatures of %d functions in %.3f ms\n", BENCH_FUNCTION_COUNT, seconds * 1e3);
+    ast_free(&ast);
+
+    // change one literal in the middle function and parse the file again
+    parse_set_lazy_bodies(false);
+    parse_set_thread_count(1);
+    if (!parse_source(source, &ast))
+    {
+        return 1;
+    }
+    size_t length = strlen(source);
+    char *edited = malloc(length + 1);
+    if (!edited)
+    {
+        printf("error: out of memory\n");
+        return 1;
+    }
+    memcpy(edited, source, length + 1);
+    char *literal = strstr(edited + length / 2, "+ 7;");
+    literal[2] = '8';
+
+    start = get_seconds();
+    parsed = parse_source_incremental(edited, &ast);
+    seconds = get_seconds() - start;
+    if (!parsed)
+    {
+        return 1;
+    }
+    printf("parsed %d functions again after a 1 byte edit in %.3f ms\n", BENCH_FUNCTION_COUNT, seconds * 1e3);
+    ast_free(&ast);
+
+    i64 depths[] = {1000, 10000, 100000, 1000000};
+    for (i32 parentheses = 0; parentheses <= 1; parentheses++)
+    {
+        for (size_t i = 0; i < sizeof(depths) / sizeof(depths[0]); i++)
+        {
+            char *nested = generate_nested_source(depths[i], parentheses);
+
+            start = get_seconds();
+            parsed = parse_source(nested, &ast);
+            seconds = get_seconds() - start;
+            if (!parsed)
+            {
+                return 1;
+            }
+
+            printf("parsed %lld nested %s in %.3f ms: %.1f ns/level\n", (long long)depths[i],
+                   parentheses ? "parentheses" : "statements", seconds * 1e3, seconds * 1e9 / depths[i]);
+
+            start = get_seconds();
+            b32 checked = check_ast(&ast);
+            seconds = get_seconds() - start;
+            if (!checked)
+            {
+                return 1;
+            }
+
+            printf("checked %lld nested %s in %.3f ms: %.1f ns/level\n", (long long)depths[i],
+                   parentheses ? "parentheses" : "statements", seconds * 1e3, seconds * 1e9 / depths[i]);
+            ast_free(&ast);
+            free(nested);
+        }
+    }
+    return 0;
+}
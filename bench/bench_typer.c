@@ -0,0 +1,127 @@
+// measures typer time on a file of many functions with growing thread counts, every
+// 64th function is many times longer than the others, and on a check of the file
+// again after an edit
+// usage: bench-typer   (the file should check faster with every thread up to the core count,
+//                       the check after the edit should take a fraction of the full one)
+
+// clock_gettime
+#define _POSIX_C_SOURCE 199309L
+
+#include "../src/lexer.h"
+#include "../src/parser.h"
+#include "../src/typer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_FUNCTION_COUNT 50000
+#define BENCH_LONG_FUNCTION_LOOPS 64
+
+static char* generate_functions_source(i32 function_count)
+{
+    const char *begin =
+        "int f%d(int a, double b) {\n"
+        "    int x = a * 2 + 7;\n"
+        "    double y = b / 2.5;\n";
+    const char *loop =
+        "    while (y > 0.0) { x = x - 1; y = y - 1.0; }\n";
+    const char *end =
+        "    if (y > b && !(y < 1.0)) { x = x * (a - 1); } else { x = f%d(x, y); }\n"
+        "    return x;\n"
+        "}\n";
+
+    i32 loop_count = function_count + function_count / 64 * BENCH_LONG_FUNCTION_LOOPS;
+    size_t size = (size_t)function_count * (strlen(begin) + strlen(end) + 20) + (size_t)loop_count * strlen(loop);
+    char *source = malloc(size + 1);
+    if (!source)
+    {
+        printf("error: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    char *at = source;
+    for (i32 i = 0; i < function_count; i++)
+    {
+        at += sprintf(at, begin, i);
+        i32 loops = i % 64 == 0 ? BENCH_LONG_FUNCTION_LOOPS + 1 : 1;
+        for (i32 j = 0; j < loops; j++)
+        {
+            at += sprintf(at, "%s", loop);
+        }
+        at += sprintf(at, end, i);
+    }
+    return source;
+}
+
+static double get_seconds()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+int main()
+{
+    char *source = generate_functions_source(BENCH_FUNCTION_COUNT);
+
+    // a new ast for each thread count, the typer keeps its results for the same one
+    i32 thread_counts[] = {1, 2, 4, 8};
+    for (size_t i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); i++)
+    {
+        typer_set_thread_count(thread_counts[i]);
+
+        Ast ast;
+        if (!parse_source(source, &ast))
+        {
+            return 1;
+        }
+
+        double start = get_seconds();
+        b32 checked = check_ast(&ast);
+        double seconds = get_seconds() - start;
+        if (!checked)
+        {
+            return 1;
+        }
+
+        printf("checked %d functions on %d threads in %.3f ms\n",
+               BENCH_FUNCTION_COUNT, thread_counts[i], seconds * 1e3);
+        ast_free(&ast);
+    }
+
+    // change one literal in the middle function and check the file again
+    typer_set_thread_count(1);
+    Ast ast;
+    if (!parse_source(source, &ast) || !check_ast(&ast))
+    {
+        return 1;
+    }
+    size_t length = strlen(source);
+    char *edited = malloc(length + 1);
+    if (!edited)
+    {
+        printf("error: out of memory\n");
+        return 1;
+    }
+    memcpy(edited, source, length + 1);
+    char *literal = strstr(edited + length / 2, "+ 7;");
+    literal[2] = '8';
+    if (!parse_source_incremental(edited, &ast))
+    {
+        return 1;
+    }
+
+    double start = get_seconds();
+    b32 checked = check_ast(&ast);
+    double seconds = get_seconds() - start;
+    if (!checked)
+    {
+        return 1;
+    }
+    printf("checked %d functions again after a 1 byte edit in %.3f ms\n", BENCH_FUNCTION_COUNT, seconds * 1e3);
+
+    ast_free(&ast);
+    return 0;
+}
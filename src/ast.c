@@ -1,106 +1,237 @@
 #include "ast.h"
+#include "lexer.h"
 #include "os.h"
 
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 
-static void print_ast_expression(Ast_Expression *expr, i32 indentation);
-static void print_ast_statement(Ast_Statement *statement, i32 indentation);
 
-static char *str_ref_to_horrific_string(StringRef str_ref)
+void ast_pool_reserve(void **nodes, u32 *capacity, u32 new_capacity, size_t node_size)
 {
-    char *string = (char*)os_allocate_memory(str_ref.length + 1);
-    if (!string)
+    if (new_capacity <= *capacity)
+    {
+        return;
+    }
+
+    void *new_nodes = os_reallocate_memory(*nodes, (size_t)new_capacity * node_size);
+    if (!new_nodes)
     {
         printf("error: out of memory\n");
         exit(EXIT_FAILURE);
     }
+    *nodes = new_nodes;
+    *capacity = new_capacity;
+}
 
-    memcpy(string, str_ref.location, str_ref.length);
-    string[str_ref.length] = '\0';
-    return string;
+u32 ast_pool_push(void **nodes, u32 *count, u32 *capacity, size_t node_size)
+{
+    if (*count == *capacity)
+    {
+        ast_pool_reserve(nodes, capacity, *capacity ? *capacity * 2 : 64, node_size);
+    }
+
+    u32 index = (*count)++;
+    memset((char*)*nodes + (size_t)index * node_size, 0, node_size);
+    return index;
 }
 
-static void print_indentation(i32 indentation)
+static u32 hash_type(i32 base, u32 pointer_count)
 {
-    for (i32 i=0; i<indentation; i++)
-        putchar(' ');
+    u32 hash = ((u32)base * 0x9e3779b9u) ^ (pointer_count * 0x85ebca6bu);
+    hash ^= hash >> 16;
+    return hash;
 }
 
-static void print_type(Ast_Type *type)
+static void grow_type_slots(Ast *ast)
 {
-    if (!type)
+    os_free_memory(ast->type_slots);
+    ast->type_slot_count = ast->type_slot_count ? ast->type_slot_count * 2 : 16;
+    ast->type_slots = os_reallocate_memory(0, ast->type_slot_count * sizeof(Ast_Index));
+    if (!ast->type_slots)
     {
-        printf("type = void\n");
-        return;
+        printf("error: out of memory\n");
+        exit(EXIT_FAILURE);
     }
+    memset(ast->type_slots, 0, ast->type_slot_count * sizeof(Ast_Index));
 
-    printf("type = ");
-    while (type)
+    u32 mask = ast->type_slot_count - 1;
+    for (u32 i = 1; i < ast->types.count; i++)
     {
-        switch (type->token->type)
+        Ast_Type *type = &ast->types.nodes[i];
+        u32 slot = hash_type(type->base, type->pointer_count) & mask;
+        while (ast->type_slots[slot])
         {
-            case TOKEN_KEYWORD_VOID:   printf("void");   break;
-            case TOKEN_KEYWORD_CHAR:   printf("char");   break;
-            case TOKEN_KEYWORD_INT:    printf("int");    break;
-            case TOKEN_KEYWORD_DOUBLE: printf("double"); break;
-            case '*':                  printf("*");      break;
-            default: printf("type = %d (error)\n", type->token->type);
+            slot = (slot + 1) & mask;
         }
-        type = type->next;
+        ast->type_slots[slot] = i;
+    }
+}
+
+Ast_Index ast_intern_type(Ast *ast, i32 base, u32 pointer_count)
+{
+    // at most half full
+    if (ast->types.count * 2 >= ast->type_slot_count)
+    {
+        grow_type_slots(ast);
+    }
+
+    u32 mask = ast->type_slot_count - 1;
+    u32 slot = hash_type(base, pointer_count) & mask;
+    while (ast->type_slots[slot])
+    {
+        Ast_Index index = ast->type_slots[slot];
+        Ast_Type *type = &ast->types.nodes[index];
+        if (type->base == base && type->pointer_count == pointer_count)
+        {
+            return index;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    Ast_Index index = AST_POOL_PUSH(ast->types);
+    Ast_Type *type = &ast->types.nodes[index];
+    type->base = base;
+    type->pointer_count = pointer_count;
+    type->is_void = base == TOKEN_KEYWORD_VOID && pointer_count == 0;
+    if (pointer_count == 0 && base == TOKEN_KEYWORD_INT)
+    {
+        type->types = AST_TYPE_INT;
+    }
+    else if (pointer_count == 0 && base == TOKEN_KEYWORD_DOUBLE)
+    {
+        type->types = AST_TYPE_DOUBLE;
+    }
+    else if (pointer_count == 1 && base == TOKEN_KEYWORD_CHAR)
+    {
+        type->types = AST_TYPE_STRING;
+    }
+    ast->type_slots[slot] = index;
+    return index;
+}
+
+void ast_init(Ast *ast)
+{
+    memset(ast, 0, sizeof(Ast));
+
+    // index 0 is no node
+    AST_POOL_PUSH(ast->functions);
+    AST_POOL_PUSH(ast->parameters);
+    AST_POOL_PUSH(ast->declarations);
+    AST_POOL_PUSH(ast->statements);
+    AST_POOL_PUSH(ast->expressions);
+    AST_POOL_PUSH(ast->arguments);
+    AST_POOL_PUSH(ast->types);
+}
+
+void ast_free(Ast *ast)
+{
+    os_free_memory(ast->functions.nodes);
+    os_free_memory(ast->parameters.nodes);
+    os_free_memory(ast->declarations.nodes);
+    os_free_memory(ast->statements.nodes);
+    os_free_memory(ast->expressions.nodes);
+    os_free_memory(ast->arguments.nodes);
+    os_free_memory(ast->types.nodes);
+    os_free_memory(ast->type_slots);
+    memset(ast, 0, sizeof(Ast));
+}
+
+// The printer keeps what it still has to print on a stack instead of recursing, so
+// deeply nested statements and expressions can't overflow the call stack. Children
+// are pushed in reverse, so they come off in order.
+typedef enum {
+    PRINT_STATEMENT,
+    PRINT_EXPRESSION,
+    PRINT_ARGUMENT, // "arg" and the expression below it
+} Print_Item_Type;
+
+typedef struct {
+    Print_Item_Type type;
+    Ast_Index index;
+    i32 indentation;
+} Print_Item;
+
+typedef AST_POOL(Print_Item) Print_Stack;
+
+static void push_print_item(Print_Stack *stack, Print_Item_Type type, Ast_Index index, i32 indentation)
+{
+    if (!index)
+    {
+        return;
+    }
+    u32 item = AST_POOL_PUSH(*stack);
+    stack->nodes[item].type = type;
+    stack->nodes[item].index = index;
+    stack->nodes[item].indentation = indentation;
+}
+
+static void print_indentation(i32 indentation)
+{
+    for (i32 i=0; i<indentation; i++)
+        putchar(' ');
+}
+
+static void print_type(Ast *ast, Ast_Index index)
+{
+    Ast_Type type = ast->types.nodes[index];
+    printf("type = ");
+    switch (type.base)
+    {
+        case TOKEN_KEYWORD_VOID:   printf("void");   break;
+        case TOKEN_KEYWORD_CHAR:   printf("char");   break;
+        case TOKEN_KEYWORD_INT:    printf("int");    break;
+        case TOKEN_KEYWORD_DOUBLE: printf("double"); break;
+        default: printf("type = %d (error)\n", type.base);
+    }
+    for (u32 i = 0; i < type.pointer_count; i++)
+    {
+        printf("*");
     }
     printf("\n");
 }
 
-void print_ast_expression(Ast_Expression *expr, i32 indentation)
+void print_ast_expression(Print_Stack *stack, Ast *ast, Ast_Index expr_index, i32 indentation)
 {
-    if (!expr) return;
+    Ast_Expression *expr = &ast->expressions.nodes[expr_index];
 
     print_indentation(indentation);
     printf("expr\n");
     print_indentation(indentation);
-    if (expr->token->type == '+')       printf("+\n");
-    else if (expr->token->type == '-')  printf("-\n");
-    else if (expr->token->type == '*')  printf("*\n");
-    else if (expr->token->type == '/')  printf("/\n");
-    else if (expr->token->type == '%')  printf("%%\n");
-    else if (expr->token->type == '!')  printf("!\n");
-    else if (expr->token->type == TOKEN_ANDAND) printf("&&\n");
-    else if (expr->token->type == TOKEN_OROR)   printf("||\n");
-    else if (expr->token->type == TOKEN_EQEQ) printf("==\n");
-    else if (expr->token->type == TOKEN_GE) printf(">=\n");
-    else if (expr->token->type == TOKEN_LE) printf("<=\n");
-    else if (expr->token->type == TOKEN_NE) printf("!=\n");
-    else if (expr->token->type == '>') printf(">\n");
-    else if (expr->token->type == '<') printf("<\n");
-    else if (expr->token->type == TOKEN_LITERAL_INT || expr->token->type == TOKEN_LITERAL_DOUBLE)
+    if (expr->token.type == '+')       printf("+\n");
+    else if (expr->token.type == '-')  printf("-\n");
+    else if (expr->token.type == '*')  printf("*\n");
+    else if (expr->token.type == '/')  printf("/\n");
+    else if (expr->token.type == '%')  printf("%%\n");
+    else if (expr->token.type == '!')  printf("!\n");
+    else if (expr->token.type == TOKEN_ANDAND) printf("&&\n");
+    else if (expr->token.type == TOKEN_OROR)   printf("||\n");
+    else if (expr->token.type == TOKEN_EQEQ) printf("==\n");
+    else if (expr->token.type == TOKEN_GE) printf(">=\n");
+    else if (expr->token.type == TOKEN_LE) printf("<=\n");
+    else if (expr->token.type == TOKEN_NE) printf("!=\n");
+    else if (expr->token.type == '>') printf(">\n");
+    else if (expr->token.type == '<') printf("<\n");
+    else if (expr->token.type == TOKEN_LITERAL_INT)
     {
-        const char *lit = str_ref_to_horrific_string(expr->token->str_ref);
-        printf("%s\n", lit);
+        printf("%llu\n", (unsigned long long)expr->token.value.int_value);
     }
-    else if (expr->token->type == TOKEN_LITERAL_STRING)
+    else if (expr->token.type == TOKEN_LITERAL_DOUBLE)
     {
-        const char *lit = str_ref_to_horrific_string(expr->token->str_ref);
-        printf("%s\n", lit);
+        StringRef lit = lexer_token_string(&expr->token);
+        printf("%.*s\n", (int)lit.length, lit.location);
     }
-    else if (expr->token->type == TOKEN_IDENTIFIER)
+    else if (expr->token.type == TOKEN_LITERAL_STRING)
     {
-        const char *ident = str_ref_to_horrific_string(expr->token->str_ref);
-        printf("%s\n", ident);
-        if (expr->function_invocation)
-        {
-            Ast_Argument *arg = expr->function_invocation->args_root;
-            while (arg)
-            {
-                print_indentation(indentation + 2);
-                printf("arg\n");
-                print_ast_expression(arg->expr, indentation + 4);
-                arg = arg->next;
-            }
-        }
+        StringRef lit = lexer_token_string(&expr->token);
+        printf("%.*s\n", (int)lit.length, lit.location);
+    }
+    else if (expr->token.type == TOKEN_IDENTIFIER)
+    {
+        StringRef ident = lexer_token_string(&expr->token);
+        printf("%.*s\n", (int)ident.length, ident.location);
     }
-    else if (expr->token->type == '(')
+    else if (expr->token.type == '(')
     {
         printf("(\n");
     }
@@ -110,105 +241,108 @@ void print_ast_expression(Ast_Expression *expr, i32 indentation)
     }
 
     indentation += 2;
-    print_ast_expression(expr->left, indentation);
-    print_ast_expression(expr->right, indentation);
+    if (expr->is_call)
+    {
+        for (u32 i = expr->arguments.count; i-- > 0;)
+        {
+            push_print_item(stack, PRINT_ARGUMENT, ast->arguments.nodes[expr->arguments.start + i], indentation);
+        }
+        return;
+    }
+
+    push_print_item(stack, PRINT_EXPRESSION, expr->right, indentation);
+    push_print_item(stack, PRINT_EXPRESSION, expr->left, indentation);
 }
 
-void print_ast_function_invocation(Ast_Function_Invocation *function_invocation, i32 indentation)
+void print_ast_function_invocation(Print_Stack *stack, Ast *ast, Ast_Expression *call, i32 indentation)
 {
     print_indentation(indentation);
     printf("function_invocation\n");
     indentation += 2;
 
-    const char *ident = str_ref_to_horrific_string(function_invocation->ident->str_ref);
+    StringRef ident = lexer_token_string(&call->token);
     print_indentation(indentation);
-    printf("ident = %s\n", ident);
+    printf("ident = %.*s\n", (int)ident.length, ident.location);
 
-    Ast_Argument *arg = function_invocation->args_root;
-    while (arg)
+    for (u32 i = call->arguments.count; i-- > 0;)
     {
-        print_indentation(indentation);
-        printf("arg\n");
-        print_ast_expression(arg->expr, indentation + 2);
-        arg = arg->next;
+        push_print_item(stack, PRINT_ARGUMENT, ast->arguments.nodes[call->arguments.start + i], indentation);
     }
 }
 
-void print_ast_return(Ast_Return *ast_return, i32 indentation)
+void print_ast_return(Print_Stack *stack, Ast_Return *ast_return, i32 indentation)
 {
     print_indentation(indentation);
     printf("return\n");
     indentation += 2;
 
     // return expr
-    print_ast_expression(ast_return->expr, indentation);
+    push_print_item(stack, PRINT_EXPRESSION, ast_return->expr, indentation);
 }
 
-void print_ast_block(Ast_Block *ast_block, i32 indentation)
+void print_ast_block(Print_Stack *stack, Ast_Block *ast_block, i32 indentation)
 {
     print_indentation(indentation);
     printf("block\n");
     indentation += 2;
 
-    Ast_Statement *statement = ast_block->statements_root;
-    while (statement)
+    for (u32 i = ast_block->statements.count; i-- > 0;)
     {
-        print_ast_statement(statement, indentation);
-        statement = statement->next;
+        push_print_item(stack, PRINT_STATEMENT, ast_block->statements.start + i, indentation);
     }
 }
 
-void print_ast_while(Ast_While *ast_while, i32 indentation)
+void print_ast_while(Print_Stack *stack, Ast_While *ast_while, i32 indentation)
 {
     print_indentation(indentation);
     printf("while\n");
     indentation += 2;
 
-    print_ast_expression(ast_while->expr, indentation);
-    print_ast_statement(ast_while->statement, indentation);
+    push_print_item(stack, PRINT_STATEMENT, ast_while->statement, indentation);
+    push_print_item(stack, PRINT_EXPRESSION, ast_while->expr, indentation);
 }
 
-void print_ast_if(Ast_If *ast_if, i32 indentation)
+void print_ast_if(Print_Stack *stack, Ast_If *ast_if, i32 indentation)
 {
     print_indentation(indentation);
     printf("if\n");
     indentation += 2;
-    
-    print_ast_expression(ast_if->expr, indentation);
-    print_ast_statement(ast_if->statement_if, indentation);
-    print_ast_statement(ast_if->statement_else, indentation);
+
+    push_print_item(stack, PRINT_STATEMENT, ast_if->statement_else, indentation);
+    push_print_item(stack, PRINT_STATEMENT, ast_if->statement_if, indentation);
+    push_print_item(stack, PRINT_EXPRESSION, ast_if->expr, indentation);
 }
 
-void print_ast_assignment(Ast_Assignment *assign, i32 indentation)
+void print_ast_assignment(Print_Stack *stack, Ast_Assignment *assign, i32 indentation)
 {
     print_indentation(indentation);
     printf("assignment\n");
     indentation += 2;
 
-    const char *ident = str_ref_to_horrific_string(assign->ident->str_ref);
+    StringRef ident = lexer_token_string(&assign->ident);
     print_indentation(indentation);
-    printf("ident = %s\n", ident);
+    printf("ident = %.*s\n", (int)ident.length, ident.location);
 
-    print_ast_expression(assign->expr, indentation);
+    push_print_item(stack, PRINT_EXPRESSION, assign->expr, indentation);
 }
 
-void print_ast_statement(Ast_Statement *statement, i32 indentation)
+void print_ast_statement(Print_Stack *stack, Ast *ast, Ast_Index statement_index, i32 indentation)
 {
-    if (!statement) return;
+    Ast_Statement *statement = &ast->statements.nodes[statement_index];
 
     Ast_Node_Type type = statement->type;
     if (type == AST_ASSIGNMENT)   
-        print_ast_assignment(&statement->stmt_assignment, indentation);
+        print_ast_assignment(stack, &statement->stmt_assignment, indentation);
     else if (type == AST_IF)     
-        print_ast_if(&statement->stmt_if, indentation);
+        print_ast_if(stack, &statement->stmt_if, indentation);
     else if (type == AST_WHILE)     
-        print_ast_while(&statement->stmt_while, indentation);
+        print_ast_while(stack, &statement->stmt_while, indentation);
     else if (type == AST_BLOCK) 
-        print_ast_block(&statement->stmt_block, indentation);
-    else if (type == AST_EXPRESSION && statement->stmt_expr.function_invocation)
-        print_ast_function_invocation(statement->stmt_expr.function_invocation, indentation);
+        print_ast_block(stack, &statement->stmt_block, indentation);
+    else if (type == AST_EXPRESSION)
+        print_ast_function_invocation(stack, ast, &ast->expressions.nodes[statement->stmt_expr], indentation);
     else if (type == AST_RETURN)           
-        print_ast_return(&statement->stmt_return, indentation);
+        print_ast_return(stack, &statement->stmt_return, indentation);
     else
     {
         print_indentation(indentation);
@@ -216,7 +350,31 @@ void print_ast_statement(Ast_Statement *statement, i32 indentation)
     }
 }
 
-void print_ast_declaration(Ast_Declaration *decl, i32 indentation)
+// prints the item and everything below it
+static void print_tree(Print_Stack *stack, Ast *ast, Print_Item_Type type, Ast_Index index, i32 indentation)
+{
+    push_print_item(stack, type, index, indentation);
+    while (stack->count)
+    {
+        Print_Item item = stack->nodes[--stack->count];
+        if (item.type == PRINT_STATEMENT)
+        {
+            print_ast_statement(stack, ast, item.index, item.indentation);
+        }
+        else if (item.type == PRINT_EXPRESSION)
+        {
+            print_ast_expression(stack, ast, item.index, item.indentation);
+        }
+        else
+        {
+            print_indentation(item.indentation);
+            printf("arg\n");
+            push_print_item(stack, PRINT_EXPRESSION, item.index, item.indentation + 2);
+        }
+    }
+}
+
+void print_ast_declaration(Print_Stack *stack, Ast *ast, Ast_Declaration *decl, i32 indentation)
 {
     print_indentation(indentation);
     printf("decl\n");
@@ -224,18 +382,18 @@ void print_ast_declaration(Ast_Declaration *decl, i32 indentation)
 
     // type
     print_indentation(indentation);
-    print_type(decl->type);
+    print_type(ast, decl->type);
 
     // ident
-    const char *ident = str_ref_to_horrific_string(decl->ident->str_ref);
+    StringRef ident = lexer_token_string(&decl->ident);
     print_indentation(indentation);
-    printf("ident = %s\n", ident);
+    printf("ident = %.*s\n", (int)ident.length, ident.location);
 
     // expr
-    print_ast_expression(decl->expr,indentation);
+    print_tree(stack, ast, PRINT_EXPRESSION, decl->expr, indentation);
 }
 
-void print_ast_parameter(Ast_Parameter *param, i32 indentation)
+void print_ast_parameter(Ast *ast, Ast_Parameter *param, i32 indentation)
 {
     print_indentation(indentation);
     printf("param\n");
@@ -243,62 +401,81 @@ void print_ast_parameter(Ast_Parameter *param, i32 indentation)
     print_indentation(indentation);
 
     // type
-    Ast_Type *type = param->type;
-    print_type(type);
+    print_type(ast, param->type);
 
     // ident
-    if (param->ident)
+    if (param->ident.type == TOKEN_IDENTIFIER)
     {
-        const char *ident = str_ref_to_horrific_string(param->ident->str_ref);
+        StringRef ident = lexer_token_string(&param->ident);
         print_indentation(indentation);
-        printf("ident = %s\n", ident);
+        printf("ident = %.*s\n", (int)ident.length, ident.location);
     }
 }
 
-void print_function(Ast_Function *function, i32 indentation)
+static void print_signature(Ast *ast, Ast_Function *function, i32 indentation)
 {
     print_indentation(indentation);
     printf("function\n");
     indentation += 2;
 
     // type
-    Ast_Type *type = function->type;
     print_indentation(indentation);
-    print_type(type);
+    print_type(ast, function->type);
 
     // ident
-    const char *ident = str_ref_to_horrific_string(function->ident->str_ref);
+    StringRef ident = lexer_token_string(&function->ident);
     print_indentation(indentation);
-    printf("ident = %s\n", ident);
+    printf("ident = %.*s\n", (int)ident.length, ident.location);
 
-    // params
-    Ast_Parameter *param = function->params_root;
-    while (param)
+    // params, f() and f(void) print as one void parameter
+    if (function->params.count == 0)
+    {
+        print_indentation(indentation);
+        printf("param\n");
+        print_indentation(indentation + 2);
+        printf("type = void\n");
+    }
+    for (u32 i = 0; i < function->params.count; i++)
     {
-        print_ast_parameter(param, indentation);
-        param = param->next;
+        print_ast_parameter(ast, &ast->parameters.nodes[function->params.start + i], indentation);
     }
+}
+
+void print_function(Ast *ast, Ast_Function *function, i32 indentation)
+{
+    print_signature(ast, function, indentation);
+    indentation += 2;
 
-    Ast_Statement *statement = function->statements_root;
-    while (statement && statement->type == AST_DECLARATION)
+    Print_Stack stack = {0};
+    for (u32 i = 0; i < function->declarations.count; i++)
     {
-        print_ast_declaration(&statement->stmt_decl, indentation);
-        statement = statement->next;
+        print_ast_declaration(&stack, ast, &ast->declarations.nodes[function->declarations.start + i], indentation);
     }
-    while (statement)
+    for (u32 i = 0; i < function->statements.count; i++)
     {
-        print_ast_statement(statement, indentation);
-        statement = statement->next;
+        print_tree(&stack, ast, PRINT_STATEMENT, function->statements.start + i, indentation);
     }
+    os_free_memory(stack.nodes);
+}
+
+void ast_print_function(Ast *ast, Ast_Function *function)
+{
+    print_function(ast, function, 0);
 }
 
 void ast_print(Ast *ast)
 {
-    Ast_Function *function = ast->functions_root;
-    while (function)
+    for (u32 i = 1; i < ast->functions.count; i++)
+    {
+        print_function(ast, &ast->functions.nodes[i], 0);
+    }
+}
+
+void ast_print_signatures(Ast *ast)
+{
+    for (u32 i = 1; i < ast->functions.count; i++)
     {
-        print_function(function, 0);
-        function = function->next;
+        print_signature(ast, &ast->functions.nodes[i], 0);
     }
 }
 
@@ -3,20 +3,27 @@
 
 #include "token.h"
 
+// The ast is stored in one pool per node type. Nodes refer to each other by
+// their index in the pool, 0 is no node. Lists are spans of consecutive nodes,
+// so the ast has no pointers and can be moved around as a whole.
+typedef u32 Ast_Index;
+
+typedef struct {
+    u32 start;
+    u32 count;
+} Ast_Span;
+
 typedef struct Ast_Expression Ast_Expression;
 typedef struct Ast_Statement Ast_Statement;
-typedef struct Ast_Argument Ast_Argument;
-typedef struct Ast_Statement Ast_Statement;
 typedef struct Ast_Parameter Ast_Parameter;
 typedef struct Ast_Declaration Ast_Declaration;
 typedef struct Ast_Function Ast_Function;
-typedef struct Ast_Function_Invocation Ast_Function_Invocation;
 typedef struct Ast_Assignment Ast_Assignment;
 typedef struct Ast_If Ast_If;
 typedef struct Ast_While Ast_While;
 typedef struct Ast_Block Ast_Block;
 typedef struct Ast_Return Ast_Return;
-typedef struct Ast_Type Ast_Type;
+typedef struct Scope Scope;
 
 typedef enum {
     AST_NONE,
@@ -30,93 +37,159 @@ typedef enum {
     AST_FUNCTION,
     AST_FUNCTION_INVOCATION,
     AST_RETURN,
+    AST_ERROR, // a statement with a syntax error, only in asts that failed to parse
 } Ast_Node_Type;
 
-struct Ast_Expression {
-    Token *token;
-    Ast_Expression *left;
-    Ast_Expression *right;
-    Ast_Function_Invocation *function_invocation;
+// what an identifier refers to, type is AST_NONE until it is resolved
+typedef struct {
+    Ast_Node_Type type; // AST_FUNCTION, AST_PARAMETER or AST_DECLARATION
+    Ast_Index index;    // into the pool of that type
+} Ast_Binding;
+
+// the types an expression can be used as, set by the typer. An int literal can be used
+// as a double too. The same bits shifted by AST_TYPES_NEGATED_SHIFT are the types under
+// an odd number of unary '-', 2147483648 is an int only there.
+enum Ast_Types {
+    AST_TYPE_INT    = 1 << 0,
+    AST_TYPE_DOUBLE = 1 << 1,
+    AST_TYPE_BOOL   = 1 << 2,
+    AST_TYPE_STRING = 1 << 3,
 };
+#define AST_TYPES_NEGATED_SHIFT 4
 
-struct Ast_Type {
-    Token *token;
-    Ast_Type *next;
+// A type keyword followed by pointer_count '*'. Every distinct type is in the ast's
+// type pool once, see ast_intern_type, so nodes refer to types by index and two
+// types are the same if their indices are.
+typedef struct {
+    i32 base; // TOKEN_KEYWORD_VOID, _CHAR, _INT or _DOUBLE
+    u32 pointer_count;
+    b32 is_void;
+    u8 types; // the Ast_Types of an expression of this type, 0 if there are none
+} Ast_Type;
+
+// The children of an expression come before it in the pool. Unary operators are
+// chained through left, the last one holds the operand on its right.
+struct Ast_Expression {
+    Token token;
+    union {
+        struct {
+            Ast_Index left; // a '(' node holds the parenthesized expression here
+            Ast_Index right;
+        };
+        Ast_Span arguments; // calls, into the argument pool
+    };
+    Ast_Binding binding; // identifiers
+    b32 is_call;
+    u8 types; // Ast_Types, and the negated ones
 };
 
 struct Ast_Parameter {
-    Ast_Type *type;
-    Token *ident;
-    Ast_Parameter *next;
-};
-
-struct Ast_Argument {
-    Ast_Expression *expr;
-    Ast_Argument *next;
+    Ast_Index type; // into the type pool
+    Token ident;
 };
 
 struct Ast_Declaration {
-    Ast_Type *type;
-    Token *ident;
-    Ast_Expression *expr;
-    Ast_Declaration *next;
+    Ast_Index type;
+    Token ident;
+    Ast_Index expr;
 };
 
+// the parameters are empty for f() and f(void), a body that is not parsed yet is
+// the tokens from body_start up to its closing '}' at body_end
 struct Ast_Function {
-    Ast_Type *type;
-    Token *ident;
-    Ast_Statement *statements_root;
-    Ast_Parameter *params_root;
-    Ast_Function *next;
+    Ast_Index type;
+    Token ident;
+    Ast_Span params;
+    Ast_Span declarations;
+    Ast_Span statements;
+    i32 body_start;
+    i32 body_end;
+    b32 body_pending;
+
+    // for the incremental parse, the function's tokens and a hash of them, and all
+    // statement and expression nodes of the body, nested ones included
+    i32 token_start;
+    i32 token_end; // one past the closing '}'
+    u64 fingerprint;
+    Ast_Span statement_nodes;
+    Ast_Span expression_nodes;
+
+    // the typer's result for the function, kept by the incremental parse with the rest
+    // of it, 0 if the function was not checked since it was parsed, see check_ast
+    u32 check_result;
 };
 
 struct Ast_Assignment {
-    Token *ident;
-    Ast_Expression *expr;
+    Token ident;
+    Ast_Binding binding;
+    Ast_Index expr;
 };
 
 struct Ast_If {
-    Ast_Expression *expr;
-    Ast_Statement  *statement_if;
-    Ast_Statement  *statement_else;
+    Ast_Index expr;
+    Ast_Index statement_if;
+    Ast_Index statement_else;
 };
 
 struct Ast_While {
-    Ast_Expression *expr;
-    Ast_Statement  *statement;
+    Ast_Index expr;
+    Ast_Index statement;
 };
 
 struct Ast_Block {
-    Ast_Statement *statements_root;
+    Ast_Span statements;
 };
 
 struct Ast_Return {
-    Ast_Expression *expr;
-};
-
-struct Ast_Function_Invocation {
-    Token *ident;
-    Ast_Argument *args_root;
+    Ast_Index expr;
 };
 
 struct Ast_Statement {
     Ast_Node_Type type;
+    u32 offset; // of its first token
     union {
-        Ast_Declaration         stmt_decl;
         Ast_Assignment          stmt_assignment;
         Ast_If                  stmt_if;
         Ast_While               stmt_while;
         Ast_Block               stmt_block;
         Ast_Return              stmt_return;
-        Ast_Expression          stmt_expr;
+        Ast_Index               stmt_expr; // a call
     };
-    Ast_Statement *next;
 };
 
+#define AST_POOL(type) struct { type *nodes; u32 count; u32 capacity; }
+
 typedef struct {
-    Ast_Function *functions_root;
+    AST_POOL(Ast_Function)    functions;
+    AST_POOL(Ast_Parameter)   parameters;
+    AST_POOL(Ast_Declaration) declarations;
+    AST_POOL(Ast_Statement)   statements;
+    AST_POOL(Ast_Expression)  expressions;
+    AST_POOL(Ast_Index)       arguments; // the argument expressions of the calls
+    AST_POOL(Ast_Type)        types;
+    Scope *globals; // the functions by name
+
+    // open addressing hash table of the types, for ast_intern_type
+    Ast_Index *type_slots;
+    u32 type_slot_count; // a power of two
 } Ast;
 
+// appends a zeroed node and returns its index, pointers into the pool are invalid afterwards
+#define AST_POOL_PUSH(pool) ast_pool_push((void**)&(pool).nodes, &(pool).count, &(pool).capacity, sizeof(*(pool).nodes))
+u32 ast_pool_push(void **nodes, u32 *count, u32 *capacity, size_t node_size);
+
+// makes room for capacity nodes, the count is not changed
+#define AST_POOL_RESERVE(pool, new_capacity) ast_pool_reserve((void**)&(pool).nodes, &(pool).capacity, (new_capacity), sizeof(*(pool).nodes))
+void ast_pool_reserve(void **nodes, u32 *capacity, u32 new_capacity, size_t node_size);
+
+// the index of the type, which is added if the ast doesn't have it yet
+Ast_Index ast_intern_type(Ast *ast, i32 base, u32 pointer_count);
+
+void ast_init(Ast *ast);
+void ast_free(Ast *ast);
+
 void ast_print(Ast *ast);
+void ast_print_function(Ast *ast, Ast_Function *function);
+void ast_print_signatures(Ast *ast); // only the types, names and parameters
 
 #endif // AST_H
@@ -0,0 +1,551 @@
+#include "ast_file.h"
+#include "lexer.h"
+#include "os.h"
+#include "scope.h"
+
+#include <string.h>
+#include <stdio.h>
+
+u64 ast_file_hash(const char *source, size_t length)
+{
+    u64 hash = 0x9e3779b97f4a7c15ull ^ length;
+    while (length >= 8)
+    {
+        u64 word;
+        memcpy(&word, source, sizeof(word));
+        hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+        hash ^= hash >> 32;
+        source += 8;
+        length -= 8;
+    }
+
+    u64 word = 0;
+    memcpy(&word, source, length);
+    hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+// A reader may have the file mapped, which breaks if it is truncated under it, so the
+// file is written next to it and renamed over it, as in result_cache.c.
+static b32 replace_file(const char *filepath, const void *buffer, size_t size)
+{
+    char temp_filepath[4096];
+    snprintf(temp_filepath, sizeof(temp_filepath), "%s.%lld.tmp", filepath, (long long)os_get_process_id());
+    if (!os_write_buffer_to_file(temp_filepath, buffer, size) ||
+        !os_rename_file(temp_filepath, filepath))
+    {
+        os_delete_file(temp_filepath);
+        return false;
+    }
+    return true;
+}
+
+// places the section at offset and returns where the next one starts
+static u64 place_section(Ast_File_Header *header, i32 section, u64 offset, u32 count, u32 element_size)
+{
+    header->sections[section].offset = offset;
+    header->sections[section].count = count;
+    header->sections[section].element_size = element_size;
+    offset += (u64)count * element_size;
+    return (offset + 7) & ~7ull;
+}
+
+#define PLACE_POOL(section, pool) place_section(&header, section, offset, (pool).count, sizeof(*(pool).nodes))
+#define COPY_POOL(section, pool) memcpy(buffer + header.sections[section].offset, (pool).nodes, (size_t)(pool).count * sizeof(*(pool).nodes))
+
+b32 ast_file_write(const char *filepath, Ast *ast, const char *source)
+{
+    size_t source_length = strlen(source);
+
+    u32 line_count = 1;
+    for (const char *p = source; (p = memchr(p, '\n', source + source_length - p)); p++)
+    {
+        line_count++;
+    }
+
+    u32 symbol_count = lexer_symbol_count();
+    u32 symbol_text_length = 0;
+    for (u32 symbol = 1; symbol <= symbol_count; symbol++)
+    {
+        symbol_text_length += lexer_symbol_string(symbol).length;
+    }
+
+    Ast_File_Header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = AST_FILE_MAGIC;
+    header.version = AST_FILE_VERSION;
+    header.source_hash = ast_file_hash(source, source_length);
+
+    u64 offset = (sizeof(header) + 7) & ~7ull;
+    offset = PLACE_POOL(AST_FILE_FUNCTIONS,    ast->functions);
+    offset = PLACE_POOL(AST_FILE_PARAMETERS,   ast->parameters);
+    offset = PLACE_POOL(AST_FILE_DECLARATIONS, ast->declarations);
+    offset = PLACE_POOL(AST_FILE_STATEMENTS,   ast->statements);
+    offset = PLACE_POOL(AST_FILE_EXPRESSIONS,  ast->expressions);
+    offset = PLACE_POOL(AST_FILE_ARGUMENTS,    ast->arguments);
+    offset = PLACE_POOL(AST_FILE_TYPES,        ast->types);
+    offset = place_section(&header, AST_FILE_SYMBOLS, offset, symbol_count + 1, sizeof(Ast_File_Symbol));
+    offset = place_section(&header, AST_FILE_SYMBOL_TEXT, offset, symbol_text_length, 1);
+    offset = place_section(&header, AST_FILE_LINES, offset, line_count, sizeof(u32));
+    offset = place_section(&header, AST_FILE_SOURCE, offset, source_length + 1, 1);
+    header.sections[AST_FILE_SOURCE].count = source_length;
+    header.file_size = offset;
+
+    char *buffer = os_allocate_memory(header.file_size);
+    if (!buffer)
+    {
+        printf("error: out of memory\n");
+        return false;
+    }
+    memset(buffer, 0, header.file_size);
+    memcpy(buffer, &header, sizeof(header));
+
+    COPY_POOL(AST_FILE_FUNCTIONS,    ast->functions);
+    COPY_POOL(AST_FILE_PARAMETERS,   ast->parameters);
+    COPY_POOL(AST_FILE_DECLARATIONS, ast->declarations);
+    COPY_POOL(AST_FILE_STATEMENTS,   ast->statements);
+    COPY_POOL(AST_FILE_EXPRESSIONS,  ast->expressions);
+    COPY_POOL(AST_FILE_ARGUMENTS,    ast->arguments);
+    COPY_POOL(AST_FILE_TYPES,        ast->types);
+
+    Ast_File_Symbol *symbols = (Ast_File_Symbol*)(buffer + header.sections[AST_FILE_SYMBOLS].offset);
+    char *symbol_text = buffer + header.sections[AST_FILE_SYMBOL_TEXT].offset;
+    u32 symbol_text_used = 0;
+    for (u32 symbol = 1; symbol <= symbol_count; symbol++)
+    {
+        StringRef string = lexer_symbol_string(symbol);
+        symbols[symbol].offset = symbol_text_used;
+        symbols[symbol].length = string.length;
+        memcpy(symbol_text + symbol_text_used, string.location, string.length);
+        symbol_text_used += string.length;
+    }
+
+    u32 *lines = (u32*)(buffer + header.sections[AST_FILE_LINES].offset);
+    u32 line = 0;
+    lines[line++] = 0;
+    for (const char *p = source; (p = memchr(p, '\n', source + source_length - p)); p++)
+    {
+        lines[line++] = p + 1 - source;
+    }
+
+    // the '\0' is already there from the memset
+    memcpy(buffer + header.sections[AST_FILE_SOURCE].offset, source, source_length);
+
+    b32 written = replace_file(filepath, buffer, header.file_size);
+    os_free_memory(buffer);
+    return written;
+}
+
+b32 ast_file_write_copy(const char *filepath, Ast_File *file)
+{
+    return replace_file(filepath, file->header, file->size);
+}
+
+#undef PLACE_POOL
+#undef COPY_POOL
+
+#define GET_POOL(section, pool) \
+    (pool).nodes = ast_file_section(file, section); \
+    (pool).count = file->header->sections[section].count; \
+    (pool).capacity = (pool).count
+
+// an ast without the globals
+static void get_pools(Ast_File *file, Ast *ast)
+{
+    memset(ast, 0, sizeof(Ast));
+    GET_POOL(AST_FILE_FUNCTIONS,    ast->functions);
+    GET_POOL(AST_FILE_PARAMETERS,   ast->parameters);
+    GET_POOL(AST_FILE_DECLARATIONS, ast->declarations);
+    GET_POOL(AST_FILE_STATEMENTS,   ast->statements);
+    GET_POOL(AST_FILE_EXPRESSIONS,  ast->expressions);
+    GET_POOL(AST_FILE_ARGUMENTS,    ast->arguments);
+    GET_POOL(AST_FILE_TYPES,        ast->types);
+}
+
+#undef GET_POOL
+
+static b32 section_is_valid(Ast_File *file, i32 section, u32 element_size, u32 min_count)
+{
+    Ast_File_Section *s = &file->header->sections[section];
+    if (s->element_size != element_size || s->count < min_count || s->offset % 8 != 0)
+    {
+        return false;
+    }
+
+    // the source is followed by its '\0'
+    u64 size = (u64)s->count * element_size;
+    if (section == AST_FILE_SOURCE)
+    {
+        size++;
+    }
+    return s->offset >= sizeof(Ast_File_Header) && s->offset <= file->size && size <= file->size - s->offset;
+}
+
+// empty spans are never read from, so their start doesn't matter
+static b32 span_is_within(Ast_Span span, u32 start, u32 end)
+{
+    return span.count == 0 || (span.start >= start && (u64)span.start + span.count <= end);
+}
+
+// 0 or a node from start up to end
+static b32 index_is_within(Ast_Index index, u32 start, u32 end)
+{
+    return index == 0 || (index >= start && index < end);
+}
+
+static b32 binding_is_valid(Ast_Binding binding, Ast_Function *function, Ast *ast)
+{
+    switch (binding.type)
+    {
+        case AST_NONE:        return binding.index == 0;
+        case AST_FUNCTION:    return binding.index >= 1 && binding.index < ast->functions.count;
+        case AST_PARAMETER:   return binding.index >= function->params.start &&
+                                     binding.index - function->params.start < function->params.count;
+        case AST_DECLARATION: return binding.index >= function->declarations.start &&
+                                     binding.index - function->declarations.start < function->declarations.count;
+        default:              return false;
+    }
+}
+
+// what the tokens of the nodes have to be within
+typedef struct {
+    u32 source_length;
+    u32 symbol_count; // the symbols are 1 up to symbol_count
+} Token_Bounds;
+
+// identifiers and string literals are printed as their symbol
+static b32 token_is_valid(Token *token, Token_Bounds *bounds)
+{
+    if (token->offset >= bounds->source_length)
+    {
+        return false;
+    }
+    if (token->type == TOKEN_IDENTIFIER || token->type == TOKEN_LITERAL_STRING)
+    {
+        return token->value.symbol >= 1 && token->value.symbol <= bounds->symbol_count;
+    }
+    return true;
+}
+
+static b32 ident_is_valid(Token *ident, Token_Bounds *bounds)
+{
+    return ident->type == TOKEN_IDENTIFIER && token_is_valid(ident, bounds);
+}
+
+// the children an expression has to have for the typer and the printer
+static b32 expression_shape_is_valid(Ast_Expression *expr, Token_Bounds *bounds)
+{
+    if (!token_is_valid(&expr->token, bounds))
+    {
+        return false;
+    }
+    if (expr->is_call)
+    {
+        return expr->token.type == TOKEN_IDENTIFIER;
+    }
+
+    switch (expr->token.type)
+    {
+        case TOKEN_IDENTIFIER:
+        case TOKEN_LITERAL_INT:
+        case TOKEN_LITERAL_DOUBLE:
+        case TOKEN_LITERAL_STRING: return true;
+
+        case '(':                  return expr->left != 0;
+
+        // unary chains have operators without a left or right child
+        case '+':
+        case '-':
+        case '!':                  return true;
+
+        default:                   return expr->left && expr->right;
+    }
+}
+
+// A function's statements and expressions refer to nodes of its own spans only, and
+// children come before their parent as the parser pushes them, so walking the ast
+// stays in the pools and ends. The nodes are trusted to be the parser's otherwise.
+static b32 function_is_valid(Ast_Function *function, Ast *ast, Token_Bounds *bounds)
+{
+    if (function->body_pending ||
+        function->type == 0 || function->type >= ast->types.count ||
+        !ident_is_valid(&function->ident, bounds) ||
+        !span_is_within(function->params, 1, ast->parameters.count) ||
+        !span_is_within(function->declarations, 1, ast->declarations.count) ||
+        !span_is_within(function->statement_nodes, 1, ast->statements.count) ||
+        !span_is_within(function->expression_nodes, 1, ast->expressions.count) ||
+        !span_is_within(function->statements, function->statement_nodes.start,
+                        function->statement_nodes.start + function->statement_nodes.count))
+    {
+        return false;
+    }
+
+    for (u32 i = 0; i < function->params.count; i++)
+    {
+        Ast_Parameter *param = &ast->parameters.nodes[function->params.start + i];
+        if (param->type == 0 || param->type >= ast->types.count || !ident_is_valid(&param->ident, bounds))
+        {
+            return false;
+        }
+    }
+
+    u32 expressions_start = function->expression_nodes.start;
+    u32 expressions_end = expressions_start + function->expression_nodes.count;
+    for (u32 i = 0; i < function->declarations.count; i++)
+    {
+        Ast_Declaration *decl = &ast->declarations.nodes[function->declarations.start + i];
+        if (decl->type == 0 || decl->type >= ast->types.count || !ident_is_valid(&decl->ident, bounds) ||
+            !index_is_within(decl->expr, expressions_start, expressions_end))
+        {
+            return false;
+        }
+    }
+
+    for (u32 i = 0; i < function->expression_nodes.count; i++)
+    {
+        u32 index = expressions_start + i;
+        Ast_Expression *expr = &ast->expressions.nodes[index];
+        if (!expression_shape_is_valid(expr, bounds) || !binding_is_valid(expr->binding, function, ast))
+        {
+            return false;
+        }
+
+        if (!expr->is_call)
+        {
+            if (!index_is_within(expr->left, expressions_start, index) ||
+                !index_is_within(expr->right, expressions_start, index))
+            {
+                return false;
+            }
+            continue;
+        }
+        if (!span_is_within(expr->arguments, 1, ast->arguments.count))
+        {
+            return false;
+        }
+        for (u32 j = 0; j < expr->arguments.count; j++)
+        {
+            Ast_Index argument = ast->arguments.nodes[expr->arguments.start + j];
+            if (argument == 0 || !index_is_within(argument, expressions_start, index))
+            {
+                return false;
+            }
+        }
+    }
+
+    u32 statements_start = function->statement_nodes.start;
+    for (u32 i = 0; i < function->statement_nodes.count; i++)
+    {
+        u32 index = statements_start + i;
+        Ast_Statement *statement = &ast->statements.nodes[index];
+        b32 valid = statement->offset < bounds->source_length;
+        switch (statement->type)
+        {
+            case AST_ASSIGNMENT:
+            {
+                Ast_Assignment *assignment = &statement->stmt_assignment;
+                valid = valid && ident_is_valid(&assignment->ident, bounds) &&
+                        binding_is_valid(assignment->binding, function, ast) &&
+                        assignment->expr && index_is_within(assignment->expr, expressions_start, expressions_end);
+            }
+            break;
+
+            case AST_EXPRESSION:
+            {
+                valid = valid && statement->stmt_expr &&
+                        index_is_within(statement->stmt_expr, expressions_start, expressions_end) &&
+                        ast->expressions.nodes[statement->stmt_expr].is_call;
+            }
+            break;
+
+            case AST_RETURN:
+            {
+                valid = valid && index_is_within(statement->stmt_return.expr, expressions_start, expressions_end);
+            }
+            break;
+
+            case AST_BLOCK:
+            {
+                valid = valid && span_is_within(statement->stmt_block.statements, statements_start, index);
+            }
+            break;
+
+            case AST_IF:
+            {
+                Ast_If *stmt_if = &statement->stmt_if;
+                valid = valid && stmt_if->expr && stmt_if->statement_if &&
+                        index_is_within(stmt_if->expr, expressions_start, expressions_end) &&
+                        index_is_within(stmt_if->statement_if, statements_start, index) &&
+                        index_is_within(stmt_if->statement_else, statements_start, index);
+            }
+            break;
+
+            case AST_WHILE:
+            {
+                Ast_While *stmt_while = &statement->stmt_while;
+                valid = valid && stmt_while->expr && stmt_while->statement &&
+                        index_is_within(stmt_while->expr, expressions_start, expressions_end) &&
+                        index_is_within(stmt_while->statement, statements_start, index);
+            }
+            break;
+
+            // files are only written for sources that parsed
+            default: valid = false;
+        }
+        if (!valid)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static b32 nodes_are_valid(Ast_File *file)
+{
+    Ast ast;
+    get_pools(file, &ast);
+    Token_Bounds bounds;
+    bounds.source_length = file->header->sections[AST_FILE_SOURCE].count;
+    bounds.symbol_count = file->header->sections[AST_FILE_SYMBOLS].count - 1;
+
+    // the symbols are loaded into the lexer, see ast_file_get_ast
+    Ast_File_Symbol *symbols = ast_file_section(file, AST_FILE_SYMBOLS);
+    u32 symbol_text_length = file->header->sections[AST_FILE_SYMBOL_TEXT].count;
+    for (u32 i = 1; i <= bounds.symbol_count; i++)
+    {
+        if (symbols[i].offset > symbol_text_length || symbols[i].length > symbol_text_length - symbols[i].offset)
+        {
+            return false;
+        }
+    }
+
+    for (u32 i = 1; i < ast.types.count; i++)
+    {
+        i32 base = ast.types.nodes[i].base;
+        if (base != TOKEN_KEYWORD_VOID && base != TOKEN_KEYWORD_CHAR &&
+            base != TOKEN_KEYWORD_INT && base != TOKEN_KEYWORD_DOUBLE)
+        {
+            return false;
+        }
+    }
+
+    for (u32 i = 1; i < ast.functions.count; i++)
+    {
+        if (!function_is_valid(&ast.functions.nodes[i], &ast, &bounds))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// the file is checked to be complete, of this layout, and to have node indices that
+// stay in the pools, see function_is_valid
+static b32 file_is_valid(Ast_File *file)
+{
+    Ast_File_Header *header = file->header;
+    if (file->size < sizeof(Ast_File_Header) ||
+        header->magic != AST_FILE_MAGIC ||
+        header->version != AST_FILE_VERSION ||
+        header->file_size != file->size)
+    {
+        return false;
+    }
+
+    // every pool has the node 0
+    b32 valid = section_is_valid(file, AST_FILE_FUNCTIONS,    sizeof(Ast_Function),    1) &&
+                section_is_valid(file, AST_FILE_PARAMETERS,   sizeof(Ast_Parameter),   1) &&
+                section_is_valid(file, AST_FILE_DECLARATIONS, sizeof(Ast_Declaration), 1) &&
+                section_is_valid(file, AST_FILE_STATEMENTS,   sizeof(Ast_Statement),   1) &&
+                section_is_valid(file, AST_FILE_EXPRESSIONS,  sizeof(Ast_Expression),  1) &&
+                section_is_valid(file, AST_FILE_ARGUMENTS,    sizeof(Ast_Index),       1) &&
+                section_is_valid(file, AST_FILE_TYPES,        sizeof(Ast_Type),        1) &&
+                section_is_valid(file, AST_FILE_SYMBOLS,      sizeof(Ast_File_Symbol), 1) &&
+                section_is_valid(file, AST_FILE_SYMBOL_TEXT,  1,                       0) &&
+                section_is_valid(file, AST_FILE_LINES,        sizeof(u32),             1) &&
+                section_is_valid(file, AST_FILE_SOURCE,       1,                       0);
+    if (!valid)
+    {
+        return false;
+    }
+
+    const char *source = ast_file_section(file, AST_FILE_SOURCE);
+    if (source[header->sections[AST_FILE_SOURCE].count] != '\0')
+    {
+        return false;
+    }
+    return nodes_are_valid(file);
+}
+
+b32 ast_file_open(Ast_File *file, const char *filepath)
+{
+    memset(file, 0, sizeof(Ast_File));
+    file->header = os_map_file(filepath, &file->size);
+    if (!file->header)
+    {
+        return false;
+    }
+
+    if (!file_is_valid(file))
+    {
+        ast_file_close(file);
+        return false;
+    }
+    return true;
+}
+
+void ast_file_close(Ast_File *file)
+{
+    if (file->header)
+    {
+        os_unmap_file(file->header, file->size);
+    }
+    if (file->memory.slots[0].memory)
+    {
+        memory_manager_free(&file->memory);
+    }
+    memset(file, 0, sizeof(Ast_File));
+}
+
+void *ast_file_section(Ast_File *file, i32 section)
+{
+    void *elements = (char*)file->header + file->header->sections[section].offset;
+    return elements;
+}
+
+void ast_file_get_ast(Ast_File *file, Ast *ast)
+{
+    get_pools(file, ast);
+
+    // the scopes aren't stored, the typer only needs the globals for calls to later functions
+    if (file->memory.slots[0].memory)
+    {
+        memory_manager_reset(&file->memory);
+    }
+    else
+    {
+        memory_manager_init(&file->memory, KILOBYTES(64));
+    }
+    ast->globals = scope_create(&file->memory, 0);
+    for (u32 i = 1; i < ast->functions.count; i++)
+    {
+        Ast_Binding binding = {AST_FUNCTION, i};
+        scope_insert(ast->globals, ast->functions.nodes[i].ident.value.symbol, binding);
+
+        // it was the typer's result in the run that wrote the file
+        ast->functions.nodes[i].check_result = 0;
+    }
+
+    // the tokens' symbols are the ones of the run that wrote the file
+    Ast_File_Symbol *symbols = ast_file_section(file, AST_FILE_SYMBOLS);
+    const char *symbol_text = ast_file_section(file, AST_FILE_SYMBOL_TEXT);
+    lexer_reset_symbols();
+    for (u32 i = 1; i < file->header->sections[AST_FILE_SYMBOLS].count; i++)
+    {
+        lexer_add_symbol(symbol_text + symbols[i].offset, symbols[i].length);
+    }
+}
+
@@ -0,0 +1,80 @@
+#ifndef AST_FILE_H
+#define AST_FILE_H
+
+#include "ast.h"
+#include "memory_manager.h"
+
+// Binary ast files, for caching parsed sources and for tools that only want the ast.
+//
+// A file is a header followed by sections. A section is an array at an offset from
+// the start of the file, so a reader maps the file and uses the arrays in place,
+// without parsing or fixing up anything:
+// - one section per node pool, nodes refer to each other by index as in Ast
+// - the symbols, an Ast_File_Symbol per Token_Value.symbol, and their text
+// - the byte offsets at which the lines of the source start
+// - the source itself, '\0' terminated, tokens refer to it by offset
+//
+// Integers and nodes are stored as they are in memory. The header records the node
+// sizes, and the magic reads differently with another byte order, so files from a
+// different layout are rejected instead of misread.
+#define AST_FILE_MAGIC   0x54534163 // "cAST" in little endian
+#define AST_FILE_VERSION 6
+
+enum {
+    AST_FILE_FUNCTIONS,
+    AST_FILE_PARAMETERS,
+    AST_FILE_DECLARATIONS,
+    AST_FILE_STATEMENTS,
+    AST_FILE_EXPRESSIONS,
+    AST_FILE_ARGUMENTS,
+    AST_FILE_TYPES,
+    AST_FILE_SYMBOLS,     // Ast_File_Symbol, [0] belongs to no symbol
+    AST_FILE_SYMBOL_TEXT, // char
+    AST_FILE_LINES,       // u32, the offset of each line's first byte
+    AST_FILE_SOURCE,      // char, count excludes the '\0'
+    AST_FILE_SECTION_COUNT
+};
+
+typedef struct {
+    u64 offset; // from the start of the file, a multiple of 8
+    u32 count;
+    u32 element_size;
+} Ast_File_Section;
+
+typedef struct {
+    u32 offset; // into the symbol text
+    u32 length;
+} Ast_File_Symbol;
+
+typedef struct {
+    u32 magic;
+    u32 version;
+    u64 file_size;
+    u64 source_hash; // ast_file_hash of the source
+    Ast_File_Section sections[AST_FILE_SECTION_COUNT];
+} Ast_File_Header;
+
+typedef struct {
+    Ast_File_Header *header; // the mapped file
+    size_t size;
+    Memory_Manager memory;   // the globals scope of ast_file_get_ast
+} Ast_File;
+
+u64 ast_file_hash(const char *source, size_t length);
+
+// writes the ast of source, the symbols are taken from the lexer, the bodies must be parsed
+// the file is replaced and not rewritten, so readers that have it mapped keep the old one
+b32 ast_file_write(const char *filepath, Ast *ast, const char *source);
+b32 ast_file_write_copy(const char *filepath, Ast_File *file); // of an opened file
+
+// false without an error message if the file is missing or not a valid ast file
+b32   ast_file_open(Ast_File *file, const char *filepath);
+void  ast_file_close(Ast_File *file);
+void* ast_file_section(Ast_File *file, i32 section);
+
+// the pools point into the file, so the ast must not be grown or freed with ast_free,
+// it stays valid until the file is closed. The lexer's symbols are replaced with the
+// file's, which its tokens refer to.
+void ast_file_get_ast(Ast_File *file, Ast *ast);
+
+#endif // AST_FILE_H
@@ -21,6 +21,9 @@ typedef int16_t i16;
 typedef int32_t i32;
 typedef int64_t i64;
 
+// c99 has no _Thread_local, gcc and clang have this
+#define THREAD_LOCAL __thread
+
 #define KILOBYTES(x) (1024*(x))
 #define MEGABYTES(x) (1024*(KILOBYTES(x)))
 #define GIGABYTES(x) (1024*(MEGABYTES(x)))
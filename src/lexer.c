@@ -1,27 +1,221 @@
 // for nothings state-machine-approach see https://nothings.org/computer/lexing.html
 
 #include "lexer.h"
-#include "memory_manager.h"
+#include "os.h"
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
-#define TOKEN_CACHE_SIZE 2 // 1 + max(x) in lexer_peek_token(x)
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// The structural index is the first lexer stage. It classifies a window of the
+// source in 64-byte blocks into bitmaps (one bit per byte), so that get_token can
+// jump over whitespace, comments, identifiers and strings instead of testing
+// every byte on its own.
+#define INDEX_BLOCK_SIZE 64
+#define INDEX_BLOCK_COUNT 64
+#define INDEX_WINDOW_SIZE (INDEX_BLOCK_SIZE*INDEX_BLOCK_COUNT)
+
+typedef enum {
+    INDEX_WHITESPACE,    // ' ', '\t', '\n' and '\r' if followed by '\n'
+    INDEX_NEWLINE,       // '\n'
+    INDEX_QUOTE,         // '"'
+    INDEX_COMMENT_OPEN,  // '/' followed by '/' or '*'
+    INDEX_COMMENT_CLOSE, // '*' followed by '/'
+    INDEX_IDENTIFIER,    // [a-zA-Z0-9_]
+    INDEX_MASK_COUNT
+} Index_Mask;
+
+typedef struct {
+    u64 space; // ' ' and '\t'
+    u64 newline;
+    u64 cr;
+    u64 quote;
+    u64 slash;
+    u64 star;
+    u64 ident;
+} Block_Classes;
 
 typedef struct {
-    i32 start_index;
-    i32 cnt_cached;
-    Token* token[TOKEN_CACHE_SIZE];
-} Token_Cache;
+    i64 base; // source offset of the first indexed byte, multiple of INDEX_BLOCK_SIZE
+    i64 end;  // source offset one past the last indexed byte
+    u64 masks[INDEX_MASK_COUNT][INDEX_BLOCK_COUNT];
+} Structural_Index;
 
+// offsets of the first byte of every line, built on the first line/column lookup
 typedef struct {
+    i32 count;
+    i32 capacity;
+    u32 *starts;
+    b32 built;
+} Line_Table;
+
+// Large files are cut into chunks that are lexed in parallel, one worker per chunk.
+// A worker other than the first one starts at an arbitrary byte, maybe inside a
+// comment or string, so its tokens are speculative until they are merged.
+#define LEXER_MAX_WORKERS 16
+#define LEXER_MIN_CHUNK_SIZE MEGABYTES(1)
+
+typedef struct {
+    const char *source;
+    i64 source_length;
     const char *parse_point;
-    i32 current_line;
-    i32 current_char;
-    Token_Cache token_cache;
-    Memory_Manager memory_manager;
+    i64 chunk_end; // tokens starting at or after this offset belong to the next chunk
+    Structural_Index index;
+    Token_Buffer tokens;
+} Lexer_Worker;
+
+// Identifiers and string literals are interned after lexing. The table uses open
+// addressing with linear probing and keeps the hashes, which the workers compute
+// while lexing, so probing and growing never have to hash strings.
+typedef struct {
+    u32 hash;
+    u32 symbol; // 0 marks an empty slot
+} Symbol_Slot;
+
+typedef struct {
+    u32 offset; // into the symbol table's text
+    u32 length;
+} Symbol_String;
+
+// the text is copied, so symbols stay valid when lexer_relex moves to an edited source
+typedef struct {
+    i32 count;
+    i32 capacity;
+    Symbol_String *strings; // indexed by symbol
+    char *text;
+    u32 text_used;
+    u32 text_capacity;
+    u32 slot_count;         // power of two, at most half of the slots are used
+    Symbol_Slot *slots;
+} Symbol_Table;
+
+// In stream mode the source is read in parts into a window. Tokens are lexed when
+// the parser peeks at them, and the text before the parser's released tokens is
+// dropped, so memory depends on the largest function instead of the input size.
+#define LEXER_STREAM_WINDOW_SIZE KILOBYTES(64)
+
+typedef struct {
+    Os_File *file;    // 0 if lexer_init got the whole source
+    char *buffer;
+    i64 capacity;
+    b32 at_end;       // the file has been read completely
+    i64 base_line;    // newlines before the window
+    i64 base_column;  // bytes between the last newline and the window
+} Lexer_Stream;
+
+typedef struct {
+    const char *source;
+    i64 source_length;
+    i32 thread_count; // 0 uses one thread per processor
+    Lexer_Worker workers[LEXER_MAX_WORKERS]; // worker 0 lexes the first chunk and owns the merged tokens
+    Lexer_Worker relexer; // lexes the edited range for lexer_relex
+    Line_Table lines;
+    Symbol_Table symbols;
+    Lexer_Stream stream;
 } Lexer;
 
 static Lexer g_lexer;
 
+// index of the parser's current token, per thread so that parser workers can each
+// parse a part of the tokens
+static THREAD_LOCAL i32 g_position;
+
+static i32 count_trailing_zeros(u64 x) {
+    return __builtin_ctzll(x);
+}
+
+#if defined(__SSE2__)
+
+// the avx2 version is compiled for every x86 build and chosen at runtime, see
+// classify_block
+#define TARGET_AVX2 __attribute__((target("avx2")))
+
+static TARGET_AVX2 u64 movemask_32(__m256i mask) {
+    return (u64)(u32)_mm256_movemask_epi8(mask);
+}
+
+static TARGET_AVX2 __m256i in_range_32(__m256i bytes, char lo, char hi) {
+    __m256i above = _mm256_cmpgt_epi8(bytes, _mm256_set1_epi8(lo - 1));
+    __m256i below = _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), bytes);
+    return _mm256_and_si256(above, below);
+}
+
+static TARGET_AVX2 void classify_block_avx2(const char *p, Block_Classes *classes)
+{
+    memset(classes, 0, sizeof(*classes));
+    for (i32 i = 0; i < INDEX_BLOCK_SIZE; i += 32)
+    {
+        __m256i bytes = _mm256_loadu_si256((const __m256i*)(p + i));
+        __m256i lower = _mm256_or_si256(bytes, _mm256_set1_epi8(0x20));
+
+        __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' ')),
+                                        _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\t')));
+        __m256i ident = _mm256_or_si256(in_range_32(lower, 'a', 'z'), in_range_32(bytes, '0', '9'));
+        ident = _mm256_or_si256(ident, _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('_')));
+
+        classes->space   |= movemask_32(space) << i;
+        classes->newline |= movemask_32(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n'))) << i;
+        classes->cr      |= movemask_32(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\r'))) << i;
+        classes->quote   |= movemask_32(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\"'))) << i;
+        classes->slash   |= movemask_32(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('/'))) << i;
+        classes->star    |= movemask_32(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('*'))) << i;
+        classes->ident   |= movemask_32(ident) << i;
+    }
+}
+
+static u64 movemask_16(__m128i mask) {
+    return (u64)(u32)_mm_movemask_epi8(mask);
+}
+
+static __m128i in_range_16(__m128i bytes, char lo, char hi) {
+    __m128i above = _mm_cmpgt_epi8(bytes, _mm_set1_epi8(lo - 1));
+    __m128i below = _mm_cmplt_epi8(bytes, _mm_set1_epi8(hi + 1));
+    return _mm_and_si128(above, below);
+}
+
+static void classify_block_sse2(const char *p, Block_Classes *classes)
+{
+    memset(classes, 0, sizeof(*classes));
+    for (i32 i = 0; i < INDEX_BLOCK_SIZE; i += 16)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(p + i));
+        __m128i lower = _mm_or_si128(bytes, _mm_set1_epi8(0x20));
+
+        __m128i space = _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')),
+                                     _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\t')));
+        __m128i ident = _mm_or_si128(in_range_16(lower, 'a', 'z'), in_range_16(bytes, '0', '9'));
+        ident = _mm_or_si128(ident, _mm_cmpeq_epi8(bytes, _mm_set1_epi8('_')));
+
+        classes->space   |= movemask_16(space) << i;
+        classes->newline |= movemask_16(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n'))) << i;
+        classes->cr      |= movemask_16(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\r'))) << i;
+        classes->quote   |= movemask_16(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\"'))) << i;
+        classes->slash   |= movemask_16(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('/'))) << i;
+        classes->star    |= movemask_16(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('*'))) << i;
+        classes->ident   |= movemask_16(ident) << i;
+    }
+}
+
+// set by build_tables, before any worker classifies a block
+static b32 g_has_avx2;
+
+static void classify_block(const char *p, Block_Classes *classes)
+{
+    if (g_has_avx2)
+    {
+        classify_block_avx2(p, classes);
+    }
+    else
+    {
+        classify_block_sse2(p, classes);
+    }
+}
+
+#else // scalar fallback
+
 static b32 is_alphabetical(char c) {
     return (c>='a' && c<='z') || (c>='A' && c<='Z');
 }
@@ -30,406 +224,1453 @@ static b32 is_numerical(char c) {
     return c>='0' && c<='9';
 }
 
-static b32 is_alphanumerical(char c) {
-    return is_alphabetical(c) || is_numerical(c);
+static void classify_block(const char *p, Block_Classes *classes)
+{
+    memset(classes, 0, sizeof(*classes));
+    for (i32 i = 0; i < INDEX_BLOCK_SIZE; i++)
+    {
+        char c = p[i];
+        u64 bit = (u64)1 << i;
+        if (c == ' ' || c == '\t') classes->space   |= bit;
+        if (c == '\n')             classes->newline |= bit;
+        if (c == '\r')             classes->cr      |= bit;
+        if (c == '\"')             classes->quote   |= bit;
+        if (c == '/')              classes->slash   |= bit;
+        if (c == '*')              classes->star    |= bit;
+        if (is_alphabetical(c) || is_numerical(c) || c == '_')
+        {
+            classes->ident |= bit;
+        }
+    }
+}
+
+#endif
+
+static void classify_block_at(Lexer_Worker *worker, i64 offset, Block_Classes *classes)
+{
+    // the source may only be read up to and including its terminating '\0'
+    i64 readable = worker->source_length + 1 - offset;
+    if (readable >= INDEX_BLOCK_SIZE)
+    {
+        classify_block(worker->source + offset, classes);
+    }
+    else if (readable > 0)
+    {
+        char padded[INDEX_BLOCK_SIZE] = {0};
+        memcpy(padded, worker->source + offset, readable);
+        classify_block(padded, classes);
+    }
+    else
+    {
+        memset(classes, 0, sizeof(*classes));
+    }
 }
 
-static Token* get_token() {
-    Token *token = memory_manager_alloc(&g_lexer.memory_manager, sizeof(Token));
+static void build_index(Lexer_Worker *worker, i64 base)
+{
+    Structural_Index *index = &worker->index;
 
-    const char *p = g_lexer.parse_point;
-    i32 current_line = g_lexer.current_line;
-    i32 current_char = g_lexer.current_char;
+    i64 end = base + INDEX_WINDOW_SIZE;
+    if (end > worker->source_length + 1)
+    {
+        end = worker->source_length + 1;
+    }
+    index->base = base;
+    index->end = end;
 
-    b32 unclosed_comment = false;
-    b32 could_skip = true;
-    while (could_skip)
+    // the masks that depend on the following byte need the next block's classes
+    Block_Classes curr, next;
+    classify_block_at(worker, base, &curr);
+    for (i32 block = 0; base + INDEX_BLOCK_SIZE*block < end; block++)
     {
-        // single-line comment
-        if (p[0] == '/' && p[1] == '/')
+        classify_block_at(worker, base + INDEX_BLOCK_SIZE*(block+1), &next);
+
+        u64 newline_next = (curr.newline >> 1) | (next.newline << 63);
+        u64 slash_next   = (curr.slash   >> 1) | (next.slash   << 63);
+        u64 star_next    = (curr.star    >> 1) | (next.star    << 63);
+
+        index->masks[INDEX_WHITESPACE][block]    = curr.space | curr.newline | (curr.cr & newline_next);
+        index->masks[INDEX_NEWLINE][block]       = curr.newline;
+        index->masks[INDEX_QUOTE][block]         = curr.quote;
+        index->masks[INDEX_COMMENT_OPEN][block]  = curr.slash & (slash_next | star_next);
+        index->masks[INDEX_COMMENT_CLOSE][block] = curr.star & slash_next;
+        index->masks[INDEX_IDENTIFIER][block]    = curr.ident;
+
+        curr = next;
+    }
+}
+
+// Returns the offset of the first byte at or after 'from' whose bit in 'mask' equals 'bit',
+// or the offset of the terminating '\0' if there is none.
+static i64 index_find(Lexer_Worker *worker, Index_Mask mask, i64 from, b32 bit)
+{
+    Structural_Index *index = &worker->index;
+    u64 invert = bit ? 0 : ~(u64)0;
+
+    // most runs end within the 64-byte block they start in
+    if (from >= index->base && from < index->end)
+    {
+        i64 relative = from - index->base;
+        i32 block = relative / INDEX_BLOCK_SIZE;
+        u64 word = (index->masks[mask][block] ^ invert) >> (relative % INDEX_BLOCK_SIZE);
+        if (word)
         {
-            p += 2;
-            current_char += 2;
+            i64 found = from + count_trailing_zeros(word);
+            return found < worker->source_length ? found : worker->source_length;
+        }
+    }
 
-            // skip everything in line
-            while ((p[0] != '\0' && p[0] != '\n') || (p[0] == '\r' && p[1] != '\n'))
-            {
-                p++;
-            }
+    while (from <= worker->source_length)
+    {
+        if (from < index->base || from >= index->end)
+        {
+            build_index(worker, from & ~(i64)(INDEX_BLOCK_SIZE-1));
+        }
 
-            // handle end of line
-            if (p[0] == '\n')
-            {
-                p++;
-                current_line++;
-                current_char = 1;
-            }
-            else if (p[0] == '\r' && p[1] == '\n')
+        i64 relative = from - index->base;
+        i32 block = relative / INDEX_BLOCK_SIZE;
+        u64 from_bits = ~(u64)0 << (relative % INDEX_BLOCK_SIZE);
+        while (index->base + INDEX_BLOCK_SIZE*block < index->end)
+        {
+            u64 word = (index->masks[mask][block] ^ invert) & from_bits;
+            if (word)
             {
-                p += 2;
-                current_line++;
-                current_char = 1;
+                i64 found = index->base + INDEX_BLOCK_SIZE*block + count_trailing_zeros(word);
+                return found < worker->source_length ? found : worker->source_length;
             }
-            continue;
+
+            from_bits = ~(u64)0;
+            block++;
         }
+        from = index->end;
+    }
 
-        // multiline comment
-        else if (p[0] == '/' && p[1] == '*')
-        {
-            p += 2;
-            current_char += 2;
+    return worker->source_length;
+}
 
-            // skip everything in comment
-            while (p[0] != '\0' && !(p[0] == '*' && p[1] == '/'))
-            {
+// The second lexer stage is a DFA over byte equivalence classes. It runs until it
+// reaches a final state, which either completes a token or hands a run over to the
+// structural index (whitespace, comments, identifiers and strings).
 
-                // handle newlines
-                if (p[0] == '\n')
-                {
-                    p++;
-                    current_line++;
-                    current_char = 1;
-                }
-                else if (p[0] == '\r' && p[1] == '\n')
-                {
-                    p += 2;
-                    current_line++;
-                    current_char = 1;
-                }
+typedef enum {
+    CLASS_OTHER,
+    CLASS_NUL,
+    CLASS_SPACE,   // ' ', '\t'
+    CLASS_NEWLINE,
+    CLASS_CR,
+    CLASS_ALPHA,   // [a-zA-Z_]
+    CLASS_DIGIT,
+    CLASS_DOT,
+    CLASS_QUOTE,
+    CLASS_SLASH,
+    CLASS_STAR,
+    CLASS_PLUS,
+    CLASS_MINUS,
+    CLASS_LESS,
+    CLASS_GREATER,
+    CLASS_EQUAL,
+    CLASS_BANG,
+    CLASS_AMP,
+    CLASS_PIPE,
+    CLASS_SINGLE,  // characters that are always a token on their own
+    CLASS_COUNT
+} Char_Class;
 
-                // handle all other characters
-                else
-                {
-                    p++;
-                    current_char++;
-                }
-            }
+typedef enum {
+    STATE_START,
+    STATE_CR,
+    STATE_SLASH,
+    STATE_PLUS,
+    STATE_MINUS,
+    STATE_LESS,
+    STATE_GREATER,
+    STATE_EQUAL,
+    STATE_BANG,
+    STATE_AMP,
+    STATE_PIPE,
+    STATE_INT,
+    STATE_DOUBLE,
 
-            // handle end of comment
-            if (p[0] == '*' && p[1] == '/')
-            {
-                p += 2;
-                current_char += 2;
-            }
-            else
-            {
-                unclosed_comment = true;
-                break;
-            }
-            continue;
+    // final states
+    STATE_FIRST_FINAL,
+    FINAL_CHARACTER = STATE_FIRST_FINAL, // the token type is the character itself
+    FINAL_ERROR,
+    FINAL_LONE_CR,
+    FINAL_EOF,
+    FINAL_SLASH,
+    FINAL_PLUS,
+    FINAL_PLUSPLUS,
+    FINAL_MINUS,
+    FINAL_MINUSMINUS,
+    FINAL_LESS,
+    FINAL_LE,
+    FINAL_GREATER,
+    FINAL_GE,
+    FINAL_EQUAL,
+    FINAL_EQEQ,
+    FINAL_BANG,
+    FINAL_NE,
+    FINAL_AMP,
+    FINAL_ANDAND,
+    FINAL_PIPE,
+    FINAL_OROR,
+    FINAL_INT,
+    FINAL_DOUBLE,
+
+    // final states that continue with the structural index
+    FINAL_WHITESPACE,
+    FINAL_LINE_COMMENT,
+    FINAL_BLOCK_COMMENT,
+    FINAL_IDENTIFIER,
+    FINAL_STRING,
+
+    STATE_COUNT
+} Lexer_State;
+
+typedef struct {
+    u8 char_class[256];
+    u8 class_transitions[STATE_FIRST_FINAL][CLASS_COUNT];
+    u8 transitions[STATE_FIRST_FINAL][256]; // expanded to bytes, saves one lookup per byte
+    i32 final_type[STATE_COUNT];
+    u8 pushback[STATE_COUNT]; // 1 if the final state consumed the first character of the next token
+    b32 built;
+} Lexer_Tables;
+
+static Lexer_Tables g_tables;
+
+static void set_final(Lexer_State state, i32 token_type, b32 pushback)
+{
+    g_tables.final_type[state] = token_type;
+    g_tables.pushback[state] = pushback;
+}
+
+// every class not set afterwards leads to 'otherwise'
+static void set_state(Lexer_State state, Lexer_State otherwise)
+{
+    for (i32 c = 0; c < CLASS_COUNT; c++)
+    {
+        g_tables.class_transitions[state][c] = otherwise;
+    }
+}
+
+static void set_transition(Lexer_State state, Char_Class c, Lexer_State next)
+{
+    g_tables.class_transitions[state][c] = next;
+}
+
+static void set_two_char_operator(Lexer_State state, Char_Class second, Lexer_State one_char, Lexer_State two_chars)
+{
+    set_state(state, one_char);
+    set_transition(state, second, two_chars);
+}
+
+static void build_tables()
+{
+    // byte equivalence classes
+    for (i32 c = 0; c < 256; c++)
+    {
+        u8 char_class = CLASS_OTHER;
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_') char_class = CLASS_ALPHA;
+        else if (c >= '0' && c <= '9')    char_class = CLASS_DIGIT;
+        else if (c == ' ' || c == '\t')   char_class = CLASS_SPACE;
+        else if (c == '\n')               char_class = CLASS_NEWLINE;
+        else if (c == '\r')               char_class = CLASS_CR;
+        else if (c == '\0')               char_class = CLASS_NUL;
+        else if (c == '.')                char_class = CLASS_DOT;
+        else if (c == '\"')               char_class = CLASS_QUOTE;
+        else if (c == '/')                char_class = CLASS_SLASH;
+        else if (c == '*')                char_class = CLASS_STAR;
+        else if (c == '+')                char_class = CLASS_PLUS;
+        else if (c == '-')                char_class = CLASS_MINUS;
+        else if (c == '<')                char_class = CLASS_LESS;
+        else if (c == '>')                char_class = CLASS_GREATER;
+        else if (c == '=')                char_class = CLASS_EQUAL;
+        else if (c == '!')                char_class = CLASS_BANG;
+        else if (c == '&')                char_class = CLASS_AMP;
+        else if (c == '|')                char_class = CLASS_PIPE;
+        else if (strchr("%;,{}()[]", c)) char_class = CLASS_SINGLE;
+        g_tables.char_class[c] = char_class;
+    }
+
+    // final states
+    set_final(FINAL_CHARACTER,     0,                     false);
+    set_final(FINAL_ERROR,         TOKEN_ERROR,           false);
+    set_final(FINAL_LONE_CR,       TOKEN_ERROR,           true);
+    set_final(FINAL_EOF,           '\0',                  true);
+    set_final(FINAL_SLASH,         '/',                   true);
+    set_final(FINAL_PLUS,          '+',                   true);
+    set_final(FINAL_PLUSPLUS,      TOKEN_PLUSPLUS,        false);
+    set_final(FINAL_MINUS,         '-',                   true);
+    set_final(FINAL_MINUSMINUS,    TOKEN_MINUSMINUS,      false);
+    set_final(FINAL_LESS,          '<',                   true);
+    set_final(FINAL_LE,            TOKEN_LE,              false);
+    set_final(FINAL_GREATER,       '>',                   true);
+    set_final(FINAL_GE,            TOKEN_GE,              false);
+    set_final(FINAL_EQUAL,         '=',                   true);
+    set_final(FINAL_EQEQ,          TOKEN_EQEQ,            false);
+    set_final(FINAL_BANG,          '!',                   true);
+    set_final(FINAL_NE,            TOKEN_NE,              false);
+    set_final(FINAL_AMP,           '&',                   true);
+    set_final(FINAL_ANDAND,        TOKEN_ANDAND,          false);
+    set_final(FINAL_PIPE,          '|',                   true);
+    set_final(FINAL_OROR,          TOKEN_OROR,            false);
+    set_final(FINAL_INT,           TOKEN_LITERAL_INT,     true);
+    set_final(FINAL_DOUBLE,        TOKEN_LITERAL_DOUBLE,  true);
+    set_final(FINAL_WHITESPACE,    0,                     false);
+    set_final(FINAL_LINE_COMMENT,  0,                     false);
+    set_final(FINAL_BLOCK_COMMENT, TOKEN_UNCLOSED_COMMENT, false);
+    set_final(FINAL_IDENTIFIER,    TOKEN_IDENTIFIER,      false);
+    set_final(FINAL_STRING,        TOKEN_LITERAL_STRING,  false);
+
+    // start of a token
+    set_state(STATE_START, FINAL_ERROR);
+    set_transition(STATE_START, CLASS_NUL,     FINAL_EOF);
+    set_transition(STATE_START, CLASS_SPACE,   STATE_START);
+    set_transition(STATE_START, CLASS_NEWLINE, FINAL_WHITESPACE);
+    set_transition(STATE_START, CLASS_CR,      STATE_CR);
+    set_transition(STATE_START, CLASS_ALPHA,   FINAL_IDENTIFIER);
+    set_transition(STATE_START, CLASS_DIGIT,   STATE_INT);
+    set_transition(STATE_START, CLASS_DOT,     FINAL_CHARACTER);
+    set_transition(STATE_START, CLASS_QUOTE,   FINAL_STRING);
+    set_transition(STATE_START, CLASS_SLASH,   STATE_SLASH);
+    set_transition(STATE_START, CLASS_STAR,    FINAL_CHARACTER);
+    set_transition(STATE_START, CLASS_PLUS,    STATE_PLUS);
+    set_transition(STATE_START, CLASS_MINUS,   STATE_MINUS);
+    set_transition(STATE_START, CLASS_LESS,    STATE_LESS);
+    set_transition(STATE_START, CLASS_GREATER, STATE_GREATER);
+    set_transition(STATE_START, CLASS_EQUAL,   STATE_EQUAL);
+    set_transition(STATE_START, CLASS_BANG,    STATE_BANG);
+    set_transition(STATE_START, CLASS_AMP,     STATE_AMP);
+    set_transition(STATE_START, CLASS_PIPE,    STATE_PIPE);
+    set_transition(STATE_START, CLASS_SINGLE,  FINAL_CHARACTER);
+
+    // \r is only whitespace as part of \r\n
+    set_state(STATE_CR, FINAL_LONE_CR);
+    set_transition(STATE_CR, CLASS_NEWLINE, FINAL_WHITESPACE);
+
+    // /, // and /*
+    set_state(STATE_SLASH, FINAL_SLASH);
+    set_transition(STATE_SLASH, CLASS_SLASH, FINAL_LINE_COMMENT);
+    set_transition(STATE_SLASH, CLASS_STAR,  FINAL_BLOCK_COMMENT);
+
+    // operators with an optional second character
+    set_two_char_operator(STATE_PLUS,    CLASS_PLUS,  FINAL_PLUS,    FINAL_PLUSPLUS);
+    set_two_char_operator(STATE_MINUS,   CLASS_MINUS, FINAL_MINUS,   FINAL_MINUSMINUS);
+    set_two_char_operator(STATE_LESS,    CLASS_EQUAL, FINAL_LESS,    FINAL_LE);
+    set_two_char_operator(STATE_GREATER, CLASS_EQUAL, FINAL_GREATER, FINAL_GE);
+    set_two_char_operator(STATE_EQUAL,   CLASS_EQUAL, FINAL_EQUAL,   FINAL_EQEQ);
+    set_two_char_operator(STATE_BANG,    CLASS_EQUAL, FINAL_BANG,    FINAL_NE);
+    set_two_char_operator(STATE_AMP,     CLASS_AMP,   FINAL_AMP,     FINAL_ANDAND);
+    set_two_char_operator(STATE_PIPE,    CLASS_PIPE,  FINAL_PIPE,    FINAL_OROR);
+
+    // int and double literals
+    set_state(STATE_INT, FINAL_INT);
+    set_transition(STATE_INT, CLASS_DIGIT, STATE_INT);
+    set_transition(STATE_INT, CLASS_DOT,   STATE_DOUBLE);
+    set_state(STATE_DOUBLE, FINAL_DOUBLE);
+    set_transition(STATE_DOUBLE, CLASS_DIGIT, STATE_DOUBLE);
+
+    for (i32 state = 0; state < STATE_FIRST_FINAL; state++)
+    {
+        for (i32 c = 0; c < 256; c++)
+        {
+            g_tables.transitions[state][c] = g_tables.class_transitions[state][g_tables.char_class[c]];
         }
+    }
+
+#if defined(__SSE2__)
+    g_has_avx2 = __builtin_cpu_supports("avx2");
+#endif
+    g_tables.built = true;
+}
+
+// Minimal perfect hash over KEYWORD_LIST, keyed on length, first and last character.
+// The constants fit the current keyword set; a keyword that collides fails to compile.
+#define KEYWORD_TABLE_SIZE 8
+#define KEYWORD_MAX_LENGTH 8
+#define KEYWORD_HASH(length, first, last) \
+    ((((first)*21 + (last)*14 + (length)) >> 3) & (KEYWORD_TABLE_SIZE-1))
+
+typedef struct {
+    char spelling[KEYWORD_MAX_LENGTH];
+    i32 type;
+} Keyword;
+
+static const Keyword g_keywords[KEYWORD_TABLE_SIZE] = {
+#define KEYWORD_ENTRY(name, spelling, first, last) \
+    [KEYWORD_HASH(sizeof(spelling)-1, first, last)] = { spelling, TOKEN_KEYWORD_##name },
+    KEYWORD_LIST(KEYWORD_ENTRY)
+#undef KEYWORD_ENTRY
+};
+
+// the hashes are distinct exactly if adding their bits equals or-ing them
+#define KEYWORD_HASH_BIT(name, spelling, first, last) (1 << KEYWORD_HASH(sizeof(spelling)-1, first, last))
+#define KEYWORD_HASH_SUM(name, spelling, first, last) + KEYWORD_HASH_BIT(name, spelling, first, last)
+#define KEYWORD_HASH_OR(name, spelling, first, last)  | KEYWORD_HASH_BIT(name, spelling, first, last)
+typedef char keyword_hash_is_perfect[(0 KEYWORD_LIST(KEYWORD_HASH_SUM)) == (0 KEYWORD_LIST(KEYWORD_HASH_OR)) ? 1 : -1];
+
+static i32 keyword_or_identifier(const char *token_start, i32 token_length)
+{
+    if (token_length > KEYWORD_MAX_LENGTH)
+    {
+        return TOKEN_IDENTIFIER;
+    }
+
+    u8 first = token_start[0];
+    u8 last = token_start[token_length-1];
+    const Keyword *keyword = &g_keywords[KEYWORD_HASH(token_length, first, last)];
+
+    u64 word = 0;
+    u64 keyword_word;
+    memcpy(&word, token_start, token_length);
+    memcpy(&keyword_word, keyword->spelling, sizeof(keyword_word));
+    if (word != keyword_word)
+    {
+        return TOKEN_IDENTIFIER;
+    }
+    return keyword->type;
+}
+
+// Numeric literals are decoded while lexing, so the later stages read their values
+// instead of the text. The DFA only accepts [0-9]+ and [0-9]+\.[0-9]* literals.
+
+// converts 8 ascii digits at once (little endian)
+static u64 parse_eight_digits(const char *p)
+{
+    u64 chunk;
+    memcpy(&chunk, p, sizeof(chunk));
+    chunk -= 0x3030303030303030ull;
+    chunk = (chunk * 10) + (chunk >> 8); // pairs of digits
+    chunk = (((chunk & 0x000000ff000000ffull) * (100 + (1000000ull << 32))) +
+             (((chunk >> 16) & 0x000000ff000000ffull) * (1 + (10000ull << 32)))) >> 32;
+    return chunk;
+}
+
+static void decode_int_literal(const char *text, i32 length, Token_Value *value, u8 *flags)
+{
+    while (length > 1 && *text == '0')
+    {
+        text++;
+        length--;
+    }
 
-        // whitespace
-        else if (p[0] == ' ' || p[0] == '\t')
+    // 19 digits always fit into a u64, the 20th is checked
+    u64 result = 0;
+    i32 index = 0;
+    i32 unchecked_length = length < 19 ? length : 19;
+    for (; index + 8 <= unchecked_length; index += 8)
+    {
+        result = result*100000000 + parse_eight_digits(text + index);
+    }
+    for (; index < length; index++)
+    {
+        u64 digit = text[index] - '0';
+        if (index >= 19 && result > (~(u64)0 - digit) / 10)
         {
-            p++;
-            current_char++;
+            value->int_value = ~(u64)0;
+            *flags |= TOKEN_FLAG_OVERFLOW;
+            return;
         }
-        else if (p[0] == '\n')
+        result = result*10 + digit;
+    }
+    value->int_value = result;
+}
+
+// exactly representable powers of ten
+static const double g_exact_powers_of_ten[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static double decode_double_literal(const char *text, i32 length)
+{
+    // Clinger's fast path: if the digits fit into the 53-bit mantissa and the power
+    // of ten is exact, one correctly rounded division gives the correctly rounded result
+    u64 max_exact = (u64)1 << 53;
+    u64 mantissa = 0;
+    i32 fraction_digits = 0;
+    b32 in_fraction = false;
+    b32 exact = true;
+
+    // up to 15 digits (and the '.') always fit, longer literals check every digit
+    b32 check_digits = length > 16;
+    for (i32 i = 0; i < length; i++)
+    {
+        if (text[i] == '.')
         {
-            p++;
-            current_char = 1;
-            current_line++;
+            in_fraction = true;
+            continue;
         }
-        else if (p[0] == '\r' && p[1] == '\n')
+
+        u64 digit = text[i] - '0';
+        if (check_digits && mantissa > (max_exact - digit) / 10)
         {
-            p += 2;
-            current_char = 1;
-            current_line++;
+            exact = false;
+            break;
         }
+        mantissa = mantissa*10 + digit;
+        fraction_digits += in_fraction;
+    }
 
-        else
-            could_skip = 0;
+    if (exact && fraction_digits < (i32)(sizeof(g_exact_powers_of_ten) / sizeof(double)))
+    {
+        return (double)mantissa / g_exact_powers_of_ten[fraction_digits];
     }
 
-    const char *token_start = p;
-    char c = *p;
+    // rare, strtod needs the literal on its own
+    char *copy = (char*)os_allocate_memory(length + 1);
+    if (!copy)
+    {
+        printf("error: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    double result = strtod(copy, 0);
+    os_free_memory(copy);
+    return result;
+}
 
-    // unclosed comment
-    if (unclosed_comment)
+static u32 hash_string(const char *p, i32 length)
+{
+    u64 hash = 0x9e3779b97f4a7c15ull ^ length;
+    while (length >= 8)
     {
-        token->type = TOKEN_UNCLOSED_COMMENT;
+        u64 word;
+        memcpy(&word, p, sizeof(word));
+        hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+        hash ^= hash >> 32;
+        p += 8;
+        length -= 8;
     }
-    // alphanumericals
-    else if (is_alphabetical(c) || c == '_')
+
+    u64 word = 0;
+    memcpy(&word, p, length);
+    hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+    hash ^= hash >> 32;
+    return (u32)hash;
+}
+
+static void token_buffer_reserve(Token_Buffer *tokens, i32 capacity)
+{
+    tokens->type   = os_reallocate_memory(tokens->type,   capacity*sizeof(*tokens->type));
+    tokens->offset = os_reallocate_memory(tokens->offset, capacity*sizeof(*tokens->offset));
+    tokens->length = os_reallocate_memory(tokens->length, capacity*sizeof(*tokens->length));
+    tokens->flags  = os_reallocate_memory(tokens->flags,  capacity*sizeof(*tokens->flags));
+    tokens->value  = os_reallocate_memory(tokens->value,  capacity*sizeof(*tokens->value));
+    if (!tokens->type || !tokens->offset || !tokens->length || !tokens->flags || !tokens->value)
     {
-        p++;
+        printf("error: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    tokens->capacity = capacity;
+}
 
-        char c = *p;
-        while (is_alphanumerical(c) || c == '_')
+// lexes the token at the worker's parse point and appends it to its token buffer
+static inline i32 lex_token(Lexer_Worker *worker) {
+    const char *source = worker->source;
+    const char *terminator = source + worker->source_length;
+    const char *p = worker->parse_point;
+    const char *token_start;
+    u8 state;
+
+    for (;;)
+    {
+        state = STATE_START;
+        do
         {
-            p++;
-            c = *p;
+            // spaces and tabs loop in the start state
+            token_start = state == STATE_START ? p : token_start;
+            state = g_tables.transitions[state][(u8)*p++];
         }
+        while (state < STATE_FIRST_FINAL);
+        p -= g_tables.pushback[state];
 
-        i32 token_length = p - token_start;
-        p--;
-
-        // if, else, while
-        if (strings_equal(token_start, token_length, "if", strlen("if")))
+        if (state == FINAL_WHITESPACE)
         {
-            token->type = TOKEN_KEYWORD_IF;
+            p = source + index_find(worker, INDEX_WHITESPACE, token_start - source, 0);
         }
-        else if (strings_equal(token_start, token_length, "else", strlen("else")))
+        else if (state == FINAL_LINE_COMMENT)
         {
-            token->type = TOKEN_KEYWORD_ELSE;
+            // the newline is skipped as whitespace
+            p = source + index_find(worker, INDEX_NEWLINE, p - source, 1);
         }
-        else if (strings_equal(token_start, token_length, "while", strlen("while")))
+        else if (state == FINAL_BLOCK_COMMENT)
         {
-            token->type = TOKEN_KEYWORD_WHILE;
+            p = source + index_find(worker, INDEX_COMMENT_CLOSE, p - source, 1);
+            if (p == terminator)
+            {
+                token_start = p;
+                break;
+            }
+            p += 2;
         }
+        else
+        {
+            break;
+        }
+    }
 
-        // void, int, bool, string, double
-        else if (strings_equal(token_start, token_length, "void", strlen("void")))
+    i32 type = g_tables.final_type[state];
+    if (state == FINAL_CHARACTER)
+    {
+        type = *token_start;
+    }
+    else if (state == FINAL_IDENTIFIER)
+    {
+        p = source + index_find(worker, INDEX_IDENTIFIER, p - source, 0);
+        type = keyword_or_identifier(token_start, p - token_start);
+    }
+    else if (state == FINAL_STRING)
+    {
+        // TODO: many characters are not allowed in string
+        p = source + index_find(worker, INDEX_QUOTE, p - source, 1);
+        if (p == terminator)
         {
-            token->type = TOKEN_KEYWORD_VOID;
+            type = TOKEN_UNCLOSED_STRING;
         }
-        else if (strings_equal(token_start, token_length, "int", strlen("int")))
+        else
         {
-            token->type = TOKEN_KEYWORD_INT;
+            p++;
         }
-        else if (strings_equal(token_start, token_length, "char", strlen("char")))
+    }
+
+    Token_Value value = {0};
+    u8 flags = 0;
+    if (state == FINAL_INT)
+    {
+        decode_int_literal(token_start, p - token_start, &value, &flags);
+    }
+    else if (state == FINAL_DOUBLE)
+    {
+        value.double_value = decode_double_literal(token_start, p - token_start);
+    }
+    else if (type == TOKEN_IDENTIFIER || type == TOKEN_LITERAL_STRING)
+    {
+        // holds the hash until the tokens are interned
+        value.symbol = hash_string(token_start, p - token_start);
+    }
+
+    Token_Buffer *tokens = &worker->tokens;
+    if (tokens->count == tokens->capacity)
+    {
+        token_buffer_reserve(tokens, 2*tokens->capacity);
+    }
+
+    i32 index = tokens->count++;
+    tokens->type[index] = type;
+    tokens->offset[index] = token_start - source;
+    tokens->length[index] = p - token_start;
+    tokens->flags[index] = flags;
+    tokens->value[index] = value;
+
+    // update lexer position
+    worker->parse_point = p;
+
+    return type;
+}
+
+void lexer_eat_token()
+{
+    g_position++;
+}
+
+static void stream_lex_tokens(i32 index);
+
+Token lexer_peek_token(i32 lookahead)
+{
+    Token_Buffer *tokens = &g_lexer.workers[0].tokens;
+
+    i32 index = g_position + lookahead;
+    if (index >= tokens->count && g_lexer.stream.file)
+    {
+        stream_lex_tokens(index);
+    }
+
+    // the last token is eof, it repeats forever
+    if (index >= tokens->count)
+    {
+        index = tokens->count - 1;
+    }
+
+    Token token;
+    token.type = tokens->type[index];
+    token.offset = tokens->offset[index];
+    token.flags = tokens->flags[index];
+    token.value = tokens->value[index];
+    return token;
+}
+
+const i32 *lexer_token_types(i32 *count)
+{
+    assert(!g_lexer.stream.file);
+    *count = g_lexer.workers[0].tokens.count;
+    return g_lexer.workers[0].tokens.type;
+}
+
+u64 lexer_hash_tokens(i32 start, i32 end)
+{
+    assert(!g_lexer.stream.file);
+    Token_Buffer *tokens = &g_lexer.workers[0].tokens;
+
+    u64 hash = 0x9e3779b97f4a7c15ull;
+    for (i32 i = start; i < end; i++)
+    {
+        // only the member of the value that the type uses is set
+        i32 type = tokens->type[i];
+        u64 value = 0;
+        if (type == TOKEN_IDENTIFIER || type == TOKEN_LITERAL_STRING)
+        {
+            value = tokens->value[i].symbol;
+        }
+        else if (type == TOKEN_LITERAL_INT || type == TOKEN_LITERAL_DOUBLE)
+        {
+            value = tokens->value[i].int_value;
+        }
+
+        // the length tells 1.0 from 1.00
+        hash = (hash ^ ((u64)(u32)type << 40 | (u64)tokens->flags[i] << 32 | tokens->length[i])) * 0xff51afd7ed558ccdull;
+        hash = (hash ^ value) * 0xc4ceb9fe1a85ec53ull;
+        hash ^= hash >> 32;
+    }
+    return hash;
+}
+
+i32 lexer_get_position()
+{
+    return g_position;
+}
+
+void lexer_set_position(i32 position)
+{
+    g_position = position;
+}
+
+// Tokens don't keep their length. Identifiers and string literals are their symbol's
+// text, a number literal ends where the lexer's tables end it, they decide it without
+// the structural index.
+StringRef lexer_token_string(Token *token)
+{
+    if (token->type == TOKEN_IDENTIFIER || token->type == TOKEN_LITERAL_STRING)
+    {
+        return lexer_symbol_string(token->value.symbol);
+    }
+    assert(token->type == TOKEN_LITERAL_INT || token->type == TOKEN_LITERAL_DOUBLE);
+
+    const char *start = g_lexer.source + token->offset;
+    const char *end = start;
+    u8 state = STATE_START;
+    do
+    {
+        state = g_tables.transitions[state][(u8)*end++];
+    }
+    while (state < STATE_FIRST_FINAL);
+    end -= g_tables.pushback[state];
+
+    StringRef str_ref;
+    str_ref.location = start;
+    str_ref.length = end - start;
+    return str_ref;
+}
+
+static void build_line_table()
+{
+    Line_Table *lines = &g_lexer.lines;
+    lines->count = 0;
+
+    const char *p = g_lexer.source;
+    const char *end = g_lexer.source + g_lexer.source_length;
+    for (;;)
+    {
+        if (lines->count == lines->capacity)
         {
-            token->type = TOKEN_KEYWORD_CHAR;
+            i32 capacity = lines->capacity ? 2*lines->capacity : 1024;
+            lines->starts = os_reallocate_memory(lines->starts, capacity*sizeof(*lines->starts));
+            if (!lines->starts)
+            {
+                printf("error: out of memory\n");
+                exit(EXIT_FAILURE);
+            }
+            lines->capacity = capacity;
         }
-        else if (strings_equal(token_start, token_length, "double", strlen("double")))
+        lines->starts[lines->count++] = p - g_lexer.source;
+
+        p = memchr(p, '\n', end - p);
+        if (!p)
         {
-            token->type = TOKEN_KEYWORD_DOUBLE;
+            break;
         }
+        p++;
+    }
+
+    lines->built = true;
+}
 
-        else if (strings_equal(token_start, token_length, "return", strlen("return")))
+// line and column are 1-based, this is only called for diagnostics
+void lexer_get_line_column(u32 offset, i32 *line, i32 *column)
+{
+    Line_Table *lines = &g_lexer.lines;
+    if (!lines->built)
+    {
+        build_line_table();
+    }
+
+    // last line that starts at or before offset
+    i32 lo = 0;
+    i32 hi = lines->count - 1;
+    while (lo < hi)
+    {
+        i32 mid = lo + (hi - lo + 1) / 2;
+        if (lines->starts[mid] <= offset)
         {
-            token->type = TOKEN_KEYWORD_RETURN;
+            lo = mid;
         }
         else
         {
-            token->type = TOKEN_IDENTIFIER;
+            hi = mid - 1;
         }
+    }
 
-        token->str_ref.location = token_start;
-        token->str_ref.length = token_length;
+    // in stream mode the window starts somewhere in the input
+    *line = g_lexer.stream.base_line + lo + 1;
+    *column = offset - lines->starts[lo] + 1;
+    if (lo == 0)
+    {
+        *column += g_lexer.stream.base_column;
     }
+}
+
+// moves count tokens, the ranges may overlap
+static void move_tokens(Token_Buffer *to, i32 to_index, Token_Buffer *from, i32 from_index, i32 count)
+{
+    memmove(to->type   + to_index, from->type   + from_index, count*sizeof(*to->type));
+    memmove(to->offset + to_index, from->offset + from_index, count*sizeof(*to->offset));
+    memmove(to->length + to_index, from->length + from_index, count*sizeof(*to->length));
+    memmove(to->flags  + to_index, from->flags  + from_index, count*sizeof(*to->flags));
+    memmove(to->value  + to_index, from->value  + from_index, count*sizeof(*to->value));
+}
 
-    // int/double literal
-    else if (is_numerical(c))
+// lexes the tokens that start within the worker's chunk
+static void lex_chunk(void *data)
+{
+    Lexer_Worker *worker = (Lexer_Worker*)data;
+    Token_Buffer *tokens = &worker->tokens;
+    i64 chunk_start = worker->parse_point - worker->source;
+
+    // forces the structural index to be built on the first lookup
+    worker->index.base = 0;
+    worker->index.end = 0;
+
+    // the buffer is kept between files, it starts at about one token per 4 bytes
+    tokens->count = 0;
+    i32 estimated_count = 1024 + (worker->chunk_end - chunk_start) / 4;
+    if (tokens->capacity < estimated_count)
     {
-        p++;
-        while (is_numerical(*p))
+        token_buffer_reserve(tokens, estimated_count);
+    }
+
+    for (;;)
+    {
+        i32 type = lex_token(worker);
+        if (tokens->offset[tokens->count-1] >= worker->chunk_end)
         {
-            p++;
+            tokens->count--;
+            break;
+        }
+        if (type == '\0')
+        {
+            break;
         }
+    }
+
+    // continue after the last token of the chunk
+    if (tokens->count > 0)
+    {
+        i32 last = tokens->count - 1;
+        worker->parse_point = worker->source + tokens->offset[last] + tokens->length[last];
+    }
+    else
+    {
+        worker->parse_point = worker->source + chunk_start;
+    }
+}
+
+// Moves index to the first of the tokens that doesn't start before offset and tells
+// if it is the same token as the one of the given type at offset. Lexing on from the
+// same token gives the same tokens, only the eof and an unclosed comment start at the
+// same offset, hence the type.
+static b32 find_synced_token(Token_Buffer *tokens, i32 *index, i64 offset, i32 type)
+{
+    while (*index < tokens->count && tokens->offset[*index] < offset)
+    {
+        (*index)++;
+    }
+    return *index < tokens->count && tokens->offset[*index] == offset && tokens->type[*index] == type;
+}
 
-        b8 is_double = false;
-        if (*p == '.')
+// Appends the chunk's tokens to the first worker's tokens. The first worker lexes on
+// from its parse point until it produces a token that the chunk's worker also
+// produced; both workers agree on everything after a common token, so the rest of
+// the chunk's tokens are copied. If no common token is found within the chunk, it
+// was lexed from a wrong start throughout and the first worker lexes it itself.
+static void merge_chunk(Lexer_Worker *chunk)
+{
+    Lexer_Worker *first = &g_lexer.workers[0];
+    Token_Buffer *tokens = &first->tokens;
+    Token_Buffer *speculative = &chunk->tokens;
+
+    i32 index = 0;
+    for (;;)
+    {
+        if (tokens->count > 0)
         {
-            is_double = true;
-            p++;
-            while (is_numerical(*p))
+            i32 last = tokens->count - 1;
+            u32 start = tokens->offset[last];
+            if (tokens->type[last] == '\0' || start >= chunk->chunk_end)
             {
-                p++;
+                return;
+            }
+
+            if (find_synced_token(speculative, &index, start, tokens->type[last]))
+            {
+                i32 copy_count = speculative->count - (index + 1);
+                if (tokens->capacity < tokens->count + copy_count)
+                {
+                    token_buffer_reserve(tokens, tokens->count + copy_count + 1024);
+                }
+
+                move_tokens(tokens, tokens->count, speculative, index + 1, copy_count);
+                tokens->count += copy_count;
+                first->parse_point = chunk->parse_point;
+                return;
             }
         }
 
-        i32 token_length = p - token_start;
-        token->type = is_double ? TOKEN_LITERAL_DOUBLE : TOKEN_LITERAL_INT;
-        token->str_ref.location = token_start;
-        token->str_ref.length = token_length;
-        p--;
+        lex_token(first);
     }
+}
 
-    // string literal
-    else if (c == '\"')
+static void grow_symbol_slots(Symbol_Table *symbols)
+{
+    u32 old_count = symbols->slot_count;
+    Symbol_Slot *old_slots = symbols->slots;
+
+    symbols->slot_count = old_count ? 2*old_count : 1024;
+    symbols->slots = (Symbol_Slot*)os_allocate_memory(symbols->slot_count*sizeof(Symbol_Slot));
+    if (!symbols->slots)
     {
-        // TODO: many characters are not allowed in string
-        p++;
-        while (*p != '\0' && *p != '\"')
+        printf("error: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    memset(symbols->slots, 0, symbols->slot_count*sizeof(Symbol_Slot));
+
+    u32 mask = symbols->slot_count - 1;
+    for (u32 i = 0; i < old_count; i++)
+    {
+        if (old_slots[i].symbol)
         {
-            p++;
+            u32 index = old_slots[i].hash & mask;
+            while (symbols->slots[index].symbol)
+            {
+                index = (index + 1) & mask;
+            }
+            symbols->slots[index] = old_slots[i];
         }
+    }
+    os_free_memory(old_slots);
+}
 
-        if (*p == '\"')
+// the slot of the string, or the empty slot it goes into, there is room for one more symbol
+static Symbol_Slot* find_symbol_slot(const char *string, u32 length, u32 hash)
+{
+    Symbol_Table *symbols = &g_lexer.symbols;
+    if (2*(u32)(symbols->count + 1) > symbols->slot_count)
+    {
+        grow_symbol_slots(symbols);
+    }
+
+    u32 mask = symbols->slot_count - 1;
+    u32 index = hash & mask;
+    for (;;)
+    {
+        Symbol_Slot *slot = &symbols->slots[index];
+        if (!slot->symbol)
         {
-            i32 token_length = p - token_start + 1;
-            token->type = TOKEN_LITERAL_STRING;
-            token->str_ref.location = token_start;
-            token->str_ref.length = token_length;
+            return slot;
         }
-        else
+        if (slot->hash == hash)
         {
-            token->type = TOKEN_UNCLOSED_STRING;
+            Symbol_String existing = symbols->strings[slot->symbol];
+            if (existing.length == length && memcmp(symbols->text + existing.offset, string, length) == 0)
+            {
+                return slot;
+            }
         }
+        index = (index + 1) & mask;
     }
+}
 
-    // /, *, %
-    else if (c == '/') token->type = '/';
-    else if (c == '*') token->type = '*';
-    else if (c == '%') token->type = '%';
+// copies the string into the table as the next symbol
+static u32 append_symbol(const char *string, u32 length)
+{
+    Symbol_Table *symbols = &g_lexer.symbols;
 
-    // + and ++
-    else if (c == '+')
+    // strings[0] belongs to no symbol
+    if (symbols->count + 2 > symbols->capacity)
     {
-        if (p[1] == '+')
+        symbols->capacity = symbols->capacity ? 2*symbols->capacity : 1024;
+        symbols->strings = os_reallocate_memory(symbols->strings, symbols->capacity*sizeof(Symbol_String));
+        if (!symbols->strings)
         {
-            token->type = TOKEN_PLUSPLUS;
-            p++;
+            printf("error: out of memory\n");
+            exit(EXIT_FAILURE);
         }
-        else
-            token->type = '+';
     }
-
-    // - and --
-    else if (c == '-')
+    if (symbols->text_used + length > symbols->text_capacity)
     {
-        if (p[1] == '-')
+        symbols->text_capacity = 2*(symbols->text_capacity + length) + KILOBYTES(16);
+        symbols->text = os_reallocate_memory(symbols->text, symbols->text_capacity);
+        if (!symbols->text)
         {
-            token->type = TOKEN_MINUSMINUS;
-            p++;
+            printf("error: out of memory\n");
+            exit(EXIT_FAILURE);
         }
-        else
-            token->type = '-';
     }
 
-    // > and >=
-    else if (c == '>')
+    u32 symbol = ++symbols->count;
+    symbols->strings[symbol].offset = symbols->text_used;
+    symbols->strings[symbol].length = length;
+    memcpy(symbols->text + symbols->text_used, string, length);
+    symbols->text_used += length;
+    return symbol;
+}
+
+static u32 intern(const char *string, u32 length, u32 hash)
+{
+    Symbol_Slot *slot = find_symbol_slot(string, length, hash);
+    if (!slot->symbol)
+    {
+        slot->hash = hash;
+        slot->symbol = append_symbol(string, length);
+    }
+    return slot->symbol;
+}
+
+// replaces the hash of an identifier or string literal with its symbol
+static void intern_token(Token_Buffer *tokens, i32 index)
+{
+    i32 type = tokens->type[index];
+    if (type == TOKEN_IDENTIFIER || type == TOKEN_LITERAL_STRING)
     {
-        if (p[1] == '=')
+        Token_Value *value = &tokens->value[index];
+        value->symbol = intern(g_lexer.source + tokens->offset[index], tokens->length[index], value->symbol);
+    }
+}
+
+static void intern_tokens(Token_Buffer *tokens)
+{
+    for (i32 i = 0; i < tokens->count; i++)
+    {
+        intern_token(tokens, i);
+    }
+}
+
+static void reset_symbols()
+{
+    Symbol_Table *symbols = &g_lexer.symbols;
+    symbols->count = 0;
+    symbols->text_used = 0;
+    if (symbols->slots)
+    {
+        memset(symbols->slots, 0, symbols->slot_count*sizeof(Symbol_Slot));
+    }
+}
+
+void lexer_reset_symbols()
+{
+    reset_symbols();
+}
+
+// a string that is a symbol already keeps the old id in the table, but gets the new one
+// too, so that the ids of a saved table don't shift
+u32 lexer_add_symbol(const char *string, u32 length)
+{
+    u32 hash = hash_string(string, length);
+    Symbol_Slot *slot = find_symbol_slot(string, length, hash);
+    u32 symbol = append_symbol(string, length);
+    if (!slot->symbol)
+    {
+        slot->hash = hash;
+        slot->symbol = symbol;
+    }
+    return symbol;
+}
+
+i32 lexer_symbol_count()
+{
+    return g_lexer.symbols.count;
+}
+
+StringRef lexer_symbol_string(u32 symbol)
+{
+    assert(symbol > 0 && symbol <= (u32)g_lexer.symbols.count);
+    Symbol_String string = g_lexer.symbols.strings[symbol];
+
+    StringRef str_ref;
+    str_ref.location = g_lexer.symbols.text + string.offset;
+    str_ref.length = string.length;
+    return str_ref;
+}
+
+void lexer_set_thread_count(i32 thread_count)
+{
+    g_lexer.thread_count = thread_count;
+}
+
+void lexer_set_source(const char *file_as_string)
+{
+    // lexer_token_string runs the tables over number literals
+    if (!g_tables.built)
+    {
+        build_tables();
+    }
+
+    g_lexer.source = file_as_string;
+    g_lexer.source_length = strlen(file_as_string);
+    g_lexer.lines.built = false;
+    g_lexer.stream.file = 0;
+    g_lexer.stream.base_line = 0;
+    g_lexer.stream.base_column = 0;
+}
+
+void lexer_init(const char *file_as_string) {
+    lexer_set_source(file_as_string);
+
+    // every chunk has at least one byte
+    i32 worker_count = os_get_worker_count(g_lexer.thread_count, g_lexer.source_length, LEXER_MIN_CHUNK_SIZE, LEXER_MAX_WORKERS);
+    if (worker_count > g_lexer.source_length && g_lexer.source_length > 0)
+    {
+        worker_count = g_lexer.source_length;
+    }
+    for (i32 i = 0; i < worker_count; i++)
+    {
+        Lexer_Worker *worker = &g_lexer.workers[i];
+        worker->source = g_lexer.source;
+        worker->source_length = g_lexer.source_length;
+        worker->parse_point = g_lexer.source + g_lexer.source_length * i / worker_count;
+
+        // the last chunk includes the eof token
+        worker->chunk_end = g_lexer.source_length * (i+1) / worker_count;
+        if (i == worker_count - 1)
         {
-            p++;
-            token->type = TOKEN_GE;
+            worker->chunk_end = g_lexer.source_length + 1;
         }
-        else
-            token->type = '>';
     }
 
-    // < and <=
-    else if (c == '<')
+    // a worker whose thread can't be created lexes its chunk right away
+    Os_Thread *threads[LEXER_MAX_WORKERS];
+    for (i32 i = 1; i < worker_count; i++)
     {
-        if (p[1] == '=')
+        threads[i] = os_create_thread(lex_chunk, &g_lexer.workers[i]);
+        if (!threads[i])
         {
-            p++;
-            token->type = TOKEN_LE;
+            lex_chunk(&g_lexer.workers[i]);
         }
-        else
-            token->type = '<';
     }
+    lex_chunk(&g_lexer.workers[0]);
 
-    // = and ==
-    else if (c == '=')
+    for (i32 i = 1; i < worker_count; i++)
     {
-        if (p[1] == '=')
+        if (threads[i])
         {
-            p++;
-            token->type = TOKEN_EQEQ;
+            os_join_thread(threads[i]);
         }
-        else token->type = '=';
+        merge_chunk(&g_lexer.workers[i]);
     }
 
-    // ! and !=
-    else if (c == '!')
+    reset_symbols();
+    intern_tokens(&g_lexer.workers[0].tokens);
+
+    g_position = 0;
+}
+
+// Relexes from the last token that ends before the edit until a relexed token starts
+// at the same place (after the edit) as an old token. From there on the old tokens
+// are still valid and only their offsets are shifted. Symbols of unchanged names
+// keep their ids.
+Lexer_Edit lexer_relex(const char *edited_source, u32 offset, u32 removed_length, u32 inserted_length)
+{
+    assert(!g_lexer.stream.file);
+
+    Token_Buffer *tokens = &g_lexer.workers[0].tokens;
+    i64 delta = (i64)inserted_length - (i64)removed_length;
+    i64 edit_end = (i64)offset + inserted_length; // in the edited source
+
+    g_lexer.source = edited_source;
+    g_lexer.source_length += delta;
+    g_lexer.lines.built = false;
+    g_position = 0;
+    assert(g_lexer.source_length == (i64)strlen(edited_source));
+
+    // keep the tokens that end before the edit, a token that ends right at the edit
+    // may grow into it because the lexer looks one byte ahead
+    i32 lo = 0;
+    i32 hi = tokens->count;
+    while (lo < hi)
     {
-        if (p[1] == '=')
+        i32 mid = lo + (hi - lo) / 2;
+        if ((i64)tokens->offset[mid] + tokens->length[mid] < offset)
         {
-            p++;
-            token->type = TOKEN_NE;
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
         }
-        else token->type = '!';
     }
+    i32 kept_count = lo;
 
-    // &&
-    else if (c == '&')
+    Lexer_Worker *relexer = &g_lexer.relexer;
+    relexer->source = edited_source;
+    relexer->source_length = g_lexer.source_length;
+    relexer->parse_point = edited_source;
+    if (kept_count > 0)
     {
-        if (p[1] == '&')
+        relexer->parse_point += tokens->offset[kept_count-1] + tokens->length[kept_count-1];
+    }
+    relexer->index.base = 0;
+    relexer->index.end = 0;
+    relexer->tokens.count = 0;
+    if (relexer->tokens.capacity == 0)
+    {
+        token_buffer_reserve(&relexer->tokens, 1024);
+    }
+
+    // old tokens from 'synced' on are still valid, if there is no such token all of
+    // them are replaced
+    i32 synced = tokens->count;
+    i32 old_index = kept_count;
+    for (;;)
+    {
+        i32 type = lex_token(relexer);
+        i32 last = relexer->tokens.count - 1;
+        i64 start = relexer->tokens.offset[last];
+        if (start >= edit_end)
         {
-            p++;
-            token->type = TOKEN_ANDAND;
+            if (find_synced_token(tokens, &old_index, start - delta, type))
+            {
+                relexer->tokens.count--;
+                synced = old_index;
+                break;
+            }
+        }
+        if (type == '\0')
+        {
+            break;
         }
-        else token->type = '&';
     }
+    intern_tokens(&relexer->tokens);
 
-    // ||
-    else if (c == '|')
+    // kept tokens, relexed tokens, old tokens after the sync point
+    i32 relexed_count = relexer->tokens.count;
+    i32 tail_count = tokens->count - synced;
+    i32 new_count = kept_count + relexed_count + tail_count;
+    if (tokens->capacity < new_count)
     {
-        if (p[1] == '|')
+        token_buffer_reserve(tokens, new_count + 1024);
+    }
+    if (kept_count + relexed_count != synced)
+    {
+        move_tokens(tokens, kept_count + relexed_count, tokens, synced, tail_count);
+    }
+    move_tokens(tokens, kept_count, &relexer->tokens, 0, relexed_count);
+    tokens->count = new_count;
+
+    if (delta != 0)
+    {
+        for (i32 i = kept_count + relexed_count; i < new_count; i++)
         {
-            p++;
-            token->type = TOKEN_OROR;
+            tokens->offset[i] += delta;
         }
-        else token->type = '|';
     }
-    
-    // ., ;
-    else if (c == ';') token->type = ';';
-    else if (c == '.') token->type = '.';
-    else if (c == ',') token->type = ',';
 
-    // parenthesis (), braces {}, brackets []
-    else if (c == '{') token->type = '{';
-    else if (c == '}') token->type = '}';
-    else if (c == '(') token->type = '(';
-    else if (c == ')') token->type = ')';
-    else if (c == '[') token->type = '[';
-    else if (c == ']') token->type = ']';
+    Lexer_Edit edit;
+    edit.start = kept_count;
+    edit.old_end = synced;
+    edit.new_end = kept_count + relexed_count;
+    edit.offset_delta = delta;
+    return edit;
+}
 
-    else if (c == '\0') token->type = '\0';
-    else token->type = TOKEN_ERROR;
+const char *lexer_get_source()
+{
+    return g_lexer.source;
+}
 
-    i32 token_length = p - token_start + 1;
+// the window moved or got more input
+static void stream_update_source(i64 parse_offset)
+{
+    Lexer_Stream *stream = &g_lexer.stream;
+    Lexer_Worker *worker = &g_lexer.workers[0];
 
-    // update token location
-    i32 c0 = current_char;
-    token->c0 = c0;
-    token->c1 = c0 + token_length - 1;
-    token->line = current_line;
+    g_lexer.source = stream->buffer;
+    g_lexer.lines.built = false;
+    worker->source = g_lexer.source;
+    worker->source_length = g_lexer.source_length;
+    worker->parse_point = worker->source + parse_offset;
+    worker->index.base = 0;
+    worker->index.end = 0;
+}
 
-    // update lexer position
-    g_lexer.parse_point = p + 1;
-    g_lexer.current_char = current_char + token_length;
-    g_lexer.current_line = current_line;
+static void stream_read()
+{
+    Lexer_Stream *stream = &g_lexer.stream;
+    Lexer_Worker *worker = &g_lexer.workers[0];
+    i64 parse_offset = worker->parse_point - worker->source;
+    if (g_lexer.source_length + 1 == stream->capacity)
+    {
+        stream->capacity *= 2;
+        stream->buffer = os_reallocate_memory(stream->buffer, stream->capacity);
+        if (!stream->buffer)
+        {
+            printf("error: out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+    }
 
-    return token;
+    i64 size_read = os_read_file(stream->file, stream->buffer + g_lexer.source_length,
+                                 stream->capacity - 1 - g_lexer.source_length);
+    if (size_read <= 0)
+    {
+        stream->at_end = true;
+        size_read = 0;
+    }
+    g_lexer.source_length += size_read;
+    stream->buffer[g_lexer.source_length] = '\0';
+    stream_update_source(parse_offset);
 }
 
-void lexer_eat_token()
+// lexes tokens until the one at index exists or eof is reached
+static void stream_lex_tokens(i32 index)
 {
-    if (g_lexer.token_cache.start_index == TOKEN_CACHE_SIZE-1)
-        g_lexer.token_cache.start_index = 0;
-    else
-        g_lexer.token_cache.start_index++;
+    Lexer_Worker *worker = &g_lexer.workers[0];
+    Token_Buffer *tokens = &worker->tokens;
+    while (tokens->count <= index &&
+           (tokens->count == 0 || tokens->type[tokens->count-1] != '\0'))
+    {
+        for (;;)
+        {
+            i64 parse_offset = worker->parse_point - worker->source;
+            lex_token(worker);
 
-    g_lexer.token_cache.cnt_cached--;
+            // a token that reaches the end of the window may continue in the input
+            // that has not been read yet (the lexer looks one byte ahead)
+            i32 last = tokens->count - 1;
+            if (g_lexer.stream.at_end ||
+                (i64)tokens->offset[last] + tokens->length[last] < g_lexer.source_length)
+            {
+                break;
+            }
+            tokens->count--;
+            worker->parse_point = worker->source + parse_offset;
+            stream_read();
+        }
+        intern_token(tokens, tokens->count - 1);
+    }
 }
 
-Token* lexer_peek_token(i32 lookahead)
+b32 lexer_init_stream(const char *filepath)
 {
-    i32 cnt_cached  = g_lexer.token_cache.cnt_cached;
-    i32 start_index = g_lexer.token_cache.start_index;
-
-    // find index
-    i32 index = start_index + lookahead;
-    if (index >= TOKEN_CACHE_SIZE)
+    Lexer_Stream *stream = &g_lexer.stream;
+    stream->file = os_open_file_for_reading(filepath);
+    if (!stream->file)
     {
-        index -= TOKEN_CACHE_SIZE;
+        return false;
     }
+    stream->at_end = false;
+    stream->base_line = 0;
+    stream->base_column = 0;
+    if (!stream->buffer)
+    {
+        stream->capacity = LEXER_STREAM_WINDOW_SIZE;
+        stream->buffer = (char*)os_allocate_memory(stream->capacity);
+        if (!stream->buffer)
+        {
+            printf("error: out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    stream->buffer[0] = '\0';
 
-    // possibly insert new token to cache
-    if (lookahead == cnt_cached)
+    if (!g_tables.built)
     {
-        Token *token = get_token();
-        g_lexer.token_cache.token[index] = token;
-        g_lexer.token_cache.cnt_cached++;
+        build_tables();
     }
 
-    return g_lexer.token_cache.token[index];
+    Lexer_Worker *worker = &g_lexer.workers[0];
+    g_lexer.source_length = 0;
+    stream_update_source(0);
+
+    worker->tokens.count = 0;
+    if (worker->tokens.capacity == 0)
+    {
+        token_buffer_reserve(&worker->tokens, 1024);
+    }
+    reset_symbols();
+    g_position = 0;
+    return true;
 }
 
-void lexer_init(const char *file_as_string) {
-    g_lexer.parse_point = file_as_string;
-    g_lexer.current_line = 1;
-    g_lexer.current_char = 1;
+void lexer_release_tokens()
+{
+    Lexer_Stream *stream = &g_lexer.stream;
+    Lexer_Worker *worker = &g_lexer.workers[0];
+    Token_Buffer *tokens = &worker->tokens;
+
+    // keep the tokens that were peeked at but not eaten
+    i32 position = g_position;
+    move_tokens(tokens, 0, tokens, position, tokens->count - position);
+    tokens->count -= position;
+    g_position = 0;
 
-    g_lexer.token_cache.start_index = 0;
-    g_lexer.token_cache.cnt_cached = 0;
+    // Drop the text before the remaining tokens. It is only moved once half of the
+    // window is unused, so every byte is moved a constant number of times.
+    i64 unused = tokens->count > 0 ? tokens->offset[0] : worker->parse_point - worker->source;
+    if (!stream->file || unused < stream->capacity / 2)
+    {
+        return;
+    }
 
-    memory_manager_init(&g_lexer.memory_manager, MEGABYTES(1));
+    const char *text = stream->buffer;
+    const char *end = stream->buffer + unused;
+    for (;;)
+    {
+        const char *newline = memchr(text, '\n', end - text);
+        if (!newline)
+        {
+            break;
+        }
+        stream->base_line++;
+        stream->base_column = 0;
+        text = newline + 1;
+    }
+    stream->base_column += end - text;
+
+    memmove(stream->buffer, stream->buffer + unused, g_lexer.source_length + 1 - unused);
+    g_lexer.source_length -= unused;
+    for (i32 i = 0; i < tokens->count; i++)
+    {
+        tokens->offset[i] -= unused;
+    }
+    stream_update_source(worker->parse_point - worker->source - unused);
 }
 
+void lexer_close_stream()
+{
+    Lexer_Stream *stream = &g_lexer.stream;
+    if (stream->file)
+    {
+        os_close_file(stream->file);
+        stream->file = 0;
+    }
+}
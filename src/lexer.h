@@ -5,8 +5,62 @@
 #include "string.h"
 #include "token.h"
 
+// the whole file's tokens as parallel arrays
+typedef struct {
+    i32 count;
+    i32 capacity;
+    i32 *type;
+    u32 *offset;
+    u32 *length;
+    u8 *flags;
+    Token_Value *value;
+} Token_Buffer;
+
+// 0 threads (the default) uses one thread per processor for large files
+void lexer_set_thread_count(i32 thread_count);
 void lexer_init(const char *file_as_string);
-Token* lexer_peek_token(i32 lookahead);
+
+// sets the source without lexing it, for an ast that was loaded instead of parsed,
+// so lexer_token_string and lexer_get_line_column work on its tokens, the symbols
+// are the ones added after lexer_reset_symbols
+void lexer_set_source(const char *file_as_string);
+
+// Stream mode reads the file (or stdin for "-") in parts while tokens are peeked at.
+// lexer_release_tokens drops the eaten tokens, after it the parser may not use their
+// text or locations anymore.
+b32 lexer_init_stream(const char *filepath);
+void lexer_release_tokens();
+void lexer_close_stream();
+
+// which tokens lexer_relex replaced: the tokens before start are unchanged, and the
+// old tokens from old_end on are the tokens from new_end on, with shifted offsets
+typedef struct {
+    i32 start;
+    i32 old_end;
+    i32 new_end;
+    i64 offset_delta;
+} Lexer_Edit;
+
+// updates the tokens of the last lexed source after an edit, which replaced
+// removed_length bytes at offset with inserted_length bytes to give edited_source
+Lexer_Edit lexer_relex(const char *edited_source, u32 offset, u32 removed_length, u32 inserted_length);
+const char *lexer_get_source();
+Token lexer_peek_token(i32 lookahead);
 void lexer_eat_token();
+// the position is per thread, the tokens of lexer_init may be peeked at from several threads
+i32 lexer_get_position();
+void lexer_set_position(i32 position);
+const i32 *lexer_token_types(i32 *count); // all of them up to eof, not in stream mode
+u64 lexer_hash_tokens(i32 start, i32 end); // of their types and values, not of where they are
+StringRef lexer_token_string(Token *token); // of an identifier, string or number literal
+
+// symbols are dense ids from 1 to lexer_symbol_count(), 0 is no symbol
+i32 lexer_symbol_count();
+StringRef lexer_symbol_string(u32 symbol);
+
+// replaces the symbols with the ones of an earlier run, each string added is the next id
+void lexer_reset_symbols();
+u32  lexer_add_symbol(const char *string, u32 length);
+void lexer_get_line_column(u32 offset, i32 *line, i32 *column);
 
 #endif // LEXER_H
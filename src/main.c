@@ -1,27 +1,250 @@
+#include "ast_file.h"
+#include "lexer.h"
+#include "os.h"
 #include "parser.h"
+#include "result_cache.h"
 #include "typer.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
-int main(int argc, char **argv)
+// parses, checks and prints one function at a time, the input may be stdin ("-")
+static int run_stream(const char *filepath)
 {
-    if (argc != 2) {
-        printf("error: no filepath specified\n");
-        return false;
+    Ast ast;
+    if (!parse_stream_open(filepath, &ast)) {
+        return 0;
+    }
+
+    for (;;) {
+        Ast_Function *function;
+        if (!parse_next_function(&ast, &function)) {
+            return 0;
+        }
+        if (!function) {
+            break;
+        }
+
+        if (!check_ast_function(&ast, function)) {
+            return 0;
+        }
+
+        ast_print_function(&ast, function);
+        parse_release_function(function);
     }
-    const char *filepath = argv[1];
+
+    return 0;
+}
+
+// bump when the printed output changes, it is part of the result cache key
+#define FRONTEND_VERSION "c-frontend 5"
+
+typedef struct {
+    b32 stream;
+    b32 signatures_only;
+    const char *ast_cache_dir;
+    const char *emit_filepath;
+    const char *cache_dir;
+    u64 cache_max_size;
+    b32 cache_stats;
+} Options;
+
+// parses the source, or with an ast cache directory loads its ast from there if the
+// cache has an ast of the same source, true if the source typechecks. With only the
+// signatures the bodies are skipped and not checked.
+static b32 run_source(const char *source, Options *options)
+{
+    size_t source_length = strlen(source);
+    const char *cache_dir = options->ast_cache_dir;
 
     Ast ast;
+    Ast_File file;
+    b32 cached = false;
+    char cache_filepath[4096];
+    if (cache_dir) {
+        u64 hash = ast_file_hash(source, source_length);
+        snprintf(cache_filepath, sizeof(cache_filepath), "%s/%016llx.ast", cache_dir, (unsigned long long)hash);
 
-    if (!parse_file(filepath, &ast)) {
-        return 0;
+        // another source with the same hash is a miss
+        if (ast_file_open(&file, cache_filepath)) {
+            Ast_File_Section *cached_source = &file.header->sections[AST_FILE_SOURCE];
+            cached = file.header->source_hash == hash &&
+                     cached_source->count == source_length &&
+                     memcmp(ast_file_section(&file, AST_FILE_SOURCE), source, source_length) == 0;
+            if (!cached) {
+                ast_file_close(&file);
+            }
+        }
+    }
+
+    if (cached) {
+        ast_file_get_ast(&file, &ast);
+        lexer_set_source(source);
+    }
+    else {
+        parse_set_lazy_bodies(options->signatures_only);
+        if (!parse_source(source, &ast)) {
+            return false;
+        }
+        // a cache that can't be written only costs the next run a parse, and an ast
+        // without its bodies can't be written
+        if (cache_dir && !options->signatures_only && os_create_directory(cache_dir)) {
+            ast_file_write(cache_filepath, &ast, source);
+        }
+    }
+
+    if (options->emit_filepath) {
+        b32 emitted = cached ? ast_file_write_copy(options->emit_filepath, &file)
+                             : ast_file_write(options->emit_filepath, &ast, source);
+        if (!emitted) {
+            return false;
+        }
+    }
+
+    if (options->signatures_only) {
+        ast_print_signatures(&ast);
+        return true;
     }
 
     if (!check_ast(&ast)) {
-        return 0;
+        return false;
     }
 
     ast_print(&ast);
 
+    return true;
+}
+
+// with a result cache directory a run whose output is in the cache only prints it
+static int run_file(const char *filepath, Options *options)
+{
+    char *source = os_read_file_as_string(filepath);
+    if (!source) {
+        return 0;
+    }
+
+    // an emitted ast file is a result the cache doesn't have
+    Result_Cache cache;
+    if (!options->cache_dir || options->emit_filepath || !result_cache_init(&cache, options->cache_dir, options->cache_max_size)) {
+        run_source(source, options);
+        return 0;
+    }
+
+    const char *key = options->signatures_only ? FRONTEND_VERSION " --signatures-only" : FRONTEND_VERSION;
+    b32 verdict;
+    if (result_cache_lookup(&cache, key, source, strlen(source), &verdict)) {
+        return 0;
+    }
+
+    if (!result_cache_begin_store(&cache)) {
+        run_source(source, options);
+        return 0;
+    }
+    verdict = run_source(source, options);
+    result_cache_store(&cache, verdict);
+
     return 0;
 }
+
+static b32 parse_size_option(const char *string, u64 *megabytes)
+{
+    char *end;
+    unsigned long long value = strtoull(string, &end, 10);
+    if (end == string || *end != '\0') {
+        printf("error: invalid size %s\n", string);
+        return false;
+    }
+    *megabytes = value;
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    Options options = {0};
+    options.cache_max_size = RESULT_CACHE_DEFAULT_MAX_SIZE;
+
+    const char *filepath = 0;
+    for (i32 i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        b32 has_value = i + 1 < argc;
+        if (strcmp(arg, "--stream") == 0) {
+            options.stream = true;
+        }
+        else if (strcmp(arg, "--signatures-only") == 0) {
+            options.signatures_only = true;
+        }
+        else if (has_value && strcmp(arg, "--ast-cache") == 0) {
+            options.ast_cache_dir = argv[++i];
+        }
+        else if (has_value && strcmp(arg, "--emit-ast") == 0) {
+            options.emit_filepath = argv[++i];
+        }
+        else if (has_value && strcmp(arg, "--cache") == 0) {
+            options.cache_dir = argv[++i];
+        }
+        else if (has_value && strcmp(arg, "--cache-max-size") == 0) {
+            u64 megabytes;
+            if (!parse_size_option(argv[++i], &megabytes)) {
+                return false;
+            }
+            options.cache_max_size = megabytes * MEGABYTES(1);
+        }
+        else if (strcmp(arg, "--cache-stats") == 0) {
+            options.cache_stats = true;
+        }
+        else if (arg[0] == '-' && arg[1] != '\0') {
+            printf("error: unknown option %s\n", arg);
+            return false;
+        }
+        else if (!filepath) {
+            filepath = arg;
+        }
+        else {
+            printf("error: more than one filepath specified\n");
+            return false;
+        }
+    }
+
+    // --cache-stats only prints the stats when there's no file
+    if (options.cache_stats) {
+        if (!options.cache_dir) {
+            printf("error: --cache-stats needs --cache\n");
+            return false;
+        }
+        if (!filepath) {
+            Result_Cache cache;
+            if (result_cache_init(&cache, options.cache_dir, options.cache_max_size)) {
+                result_cache_print_stats(&cache);
+            }
+            return 0;
+        }
+    }
+
+    if (!filepath) {
+        printf("error: no filepath specified\n");
+        return false;
+    }
+
+    if (options.signatures_only && options.emit_filepath) {
+        printf("error: --emit-ast needs the bodies, it can't be used with --signatures-only\n");
+        return false;
+    }
+
+    if (options.stream) {
+        if (options.ast_cache_dir || options.emit_filepath || options.cache_dir || options.signatures_only) {
+            printf("error: --ast-cache, --emit-ast, --cache and --signatures-only need the whole file\n");
+            return false;
+        }
+        return run_stream(filepath);
+    }
+
+    int result = run_file(filepath, &options);
+    if (options.cache_stats) {
+        Result_Cache cache;
+        if (result_cache_init(&cache, options.cache_dir, options.cache_max_size)) {
+            result_cache_print_stats(&cache);
+        }
+    }
+    return result;
+}
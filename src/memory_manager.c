@@ -57,3 +57,30 @@ void memory_manager_init(Memory_Manager *manager, size_t first_slot_size)
     memory_slot_init(&manager->slots[0], first_slot_size);
 }
 
+// everything allocated so far is freed at once, the memory is kept for reuse
+void memory_manager_reset(Memory_Manager *manager)
+{
+    size_t size_total = manager->slots[manager->curr_slot_index].size_total;
+    if (manager->curr_slot_index > 0)
+    {
+        for (size_t i = 0; i <= manager->curr_slot_index; i++)
+        {
+            os_free_memory(manager->slots[i].memory);
+        }
+
+        // one slot as large as the last one
+        manager->curr_slot_index = 0;
+        memory_slot_init(&manager->slots[0], size_total);
+    }
+    manager->slots[0].size_used = 0;
+}
+
+void memory_manager_free(Memory_Manager *manager)
+{
+    for (size_t i = 0; i <= manager->curr_slot_index; i++)
+    {
+        os_free_memory(manager->slots[i].memory);
+        manager->slots[i].memory = 0;
+    }
+    manager->curr_slot_index = 0;
+}
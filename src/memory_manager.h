@@ -18,5 +18,7 @@ typedef struct {
 
 void  memory_manager_init(Memory_Manager *manager, size_t first_slot_size);
 void* memory_manager_alloc(Memory_Manager *manager, size_t size);
+void  memory_manager_reset(Memory_Manager *manager);
+void  memory_manager_free(Memory_Manager *manager);
 
 #endif // MEMORY_MANAGER_H
@@ -1,13 +1,34 @@
+// pthreads and sysconf need POSIX with -std=c99
+#ifdef OS_LINUX
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include "os.h"
 
 #ifdef OS_LINUX
 
+#include <dirent.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <malloc.h>
+#include <pthread.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+struct Os_Thread {
+    pthread_t handle;
+    Os_Thread_Proc *proc;
+    void *data;
+};
+
+struct Os_File {
+    int file_descriptor;
+};
 
 void *os_allocate_memory(size_t size)
 {
@@ -15,6 +36,12 @@ void *os_allocate_memory(size_t size)
     return memory;
 }
 
+void *os_reallocate_memory(void *memory, size_t size)
+{
+    memory = realloc(memory, size);
+    return memory;
+}
+
 void os_free_memory(void *memory)
 {
     free(memory);
@@ -22,17 +49,18 @@ void os_free_memory(void *memory)
 
 char *os_read_file_as_string(const char *filepath)
 {
-    int file_descriptor = open(pathname, O_RDONLY, 0);
+    int file_descriptor = open(filepath, O_RDONLY, 0);
     if (file_descriptor == -1)
     {
-        printf("error: failed to open %s for reading\n", pathname);
+        printf("error: failed to open %s for reading\n", filepath);
         return 0;
     }
 
     struct stat file_status;
     if (fstat(file_descriptor, &file_status) == -1)
     {
-        printf("error: fstat failed on %s\n", pathname);
+        printf("error: fstat failed on %s\n", filepath);
+        close(file_descriptor);
         return 0;
     }
 
@@ -40,13 +68,14 @@ char *os_read_file_as_string(const char *filepath)
     if (!file_as_string)
     {
         printf("error: out of memory\n");
+        close(file_descriptor);
         return 0;
     }
 
     ssize_t file_size_read = read(file_descriptor, file_as_string, file_status.st_size);
     if (file_size_read != file_status.st_size)
     {
-        printf("error: only %ld/%ld bytes read of %s\n", file_size_read, file_status.st_size, pathname);
+        printf("error: only %ld/%ld bytes read of %s\n", (long)file_size_read, (long)file_status.st_size, filepath);
         close(file_descriptor);
         free(file_as_string);
         return 0;
@@ -58,29 +87,345 @@ char *os_read_file_as_string(const char *filepath)
     return file_as_string;
 }
 
-b32 os_write_file(const char *filepath, void *buffer, size_t size)
+b32 os_write_file(const char *filepath, Memory_Manager *memory_manager)
+{
+    int file_descriptor = open(filepath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file_descriptor == -1)
+    {
+        printf("error: failed to open %s for writing\n", filepath);
+        return false;
+    }
+
+    size_t max_slot_index = memory_manager->curr_slot_index;
+    for (size_t i = 0; i <= max_slot_index; i++)
+    {
+        Memory_Slot *slot = &memory_manager->slots[i];
+        ssize_t written = write(file_descriptor, slot->memory, slot->size_used);
+        if (written != (ssize_t)slot->size_used)
+        {
+            printf("error: only %ld/%zu bytes written to %s\n", (long)written, slot->size_used, filepath);
+            close(file_descriptor);
+            return false;
+        }
+    }
+
+    close(file_descriptor);
+    return true;
+}
+
+b32 os_write_buffer_to_file(const char *filepath, const void *buffer, size_t size)
+{
+    int file_descriptor = open(filepath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file_descriptor == -1)
+    {
+        printf("error: failed to open %s for writing\n", filepath);
+        return false;
+    }
+
+    const char *p = (const char*)buffer;
+    while (size > 0)
+    {
+        ssize_t written = write(file_descriptor, p, size);
+        if (written == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            printf("error: write to %s failed\n", filepath);
+            close(file_descriptor);
+            return false;
+        }
+        p += written;
+        size -= written;
+    }
+
+    close(file_descriptor);
+    return true;
+}
+
+b32 os_create_directory(const char *path)
 {
-    int file_descriptor = open(pathname, O_WRONLY);
+    if (mkdir(path, 0755) == -1 && errno != EEXIST)
+    {
+        printf("error: failed to create directory %s\n", path);
+        return false;
+    }
+    return true;
+}
+
+void *os_map_file(const char *filepath, size_t *size)
+{
+    int file_descriptor = open(filepath, O_RDONLY, 0);
     if (file_descriptor == -1)
     {
-        printf("error: failed to open %s for writing\n", pathname);
         return 0;
     }
 
-    ssize_t written = write(file_descriptor, buffer, size);
-    if (written != size)
+    struct stat file_status;
+    if (fstat(file_descriptor, &file_status) == -1 || file_status.st_size == 0)
     {
-        printf("error: only %ld/%d bytes written to %s\n", written, size, pathname);
+        close(file_descriptor);
         return 0;
     }
 
-    return 1;
+    void *memory = mmap(0, file_status.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file_descriptor, 0);
+    close(file_descriptor);
+    if (memory == MAP_FAILED)
+    {
+        return 0;
+    }
+
+    *size = file_status.st_size;
+    return memory;
+}
+
+void os_unmap_file(void *memory, size_t size)
+{
+    munmap(memory, size);
+}
+
+b32 os_rename_file(const char *from, const char *to)
+{
+    if (rename(from, to) == -1)
+    {
+        printf("error: failed to rename %s to %s\n", from, to);
+        return false;
+    }
+    return true;
+}
+
+b32 os_delete_file(const char *filepath)
+{
+    return unlink(filepath) == 0;
+}
+
+b32 os_touch_file(const char *filepath)
+{
+    return utimensat(AT_FDCWD, filepath, 0, 0) == 0;
+}
+
+b32 os_list_directory(const char *path, Os_Directory_Proc *proc, void *data)
+{
+    DIR *directory = opendir(path);
+    if (!directory)
+    {
+        printf("error: failed to open directory %s\n", path);
+        return false;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(directory)))
+    {
+        // files may be deleted by others while the directory is listed
+        struct stat file_status;
+        if (fstatat(dirfd(directory), entry->d_name, &file_status, 0) == 0 && S_ISREG(file_status.st_mode))
+        {
+            proc(entry->d_name, file_status.st_size, file_status.st_mtime, data);
+        }
+    }
+
+    closedir(directory);
+    return true;
+}
+
+Os_File *os_lock_file(const char *filepath)
+{
+    Os_File *file = (Os_File*)os_allocate_memory(sizeof(Os_File));
+    if (!file)
+    {
+        printf("error: out of memory\n");
+        return 0;
+    }
+
+    file->file_descriptor = open(filepath, O_RDWR | O_CREAT, 0644);
+    if (file->file_descriptor == -1)
+    {
+        printf("error: failed to open %s for locking\n", filepath);
+        os_free_memory(file);
+        return 0;
+    }
+
+    struct flock lock = {0};
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    int result;
+    do
+    {
+        result = fcntl(file->file_descriptor, F_SETLKW, &lock);
+    }
+    while (result == -1 && errno == EINTR);
+
+    if (result == -1)
+    {
+        printf("error: failed to lock %s\n", filepath);
+        close(file->file_descriptor);
+        os_free_memory(file);
+        return 0;
+    }
+    return file;
+}
+
+// closing the file releases the lock
+void os_unlock_file(Os_File *file)
+{
+    close(file->file_descriptor);
+    os_free_memory(file);
+}
+
+static int g_saved_stdout = -1;
+
+b32 os_redirect_stdout(const char *filepath)
+{
+    assert(g_saved_stdout == -1);
+
+    int file_descriptor = open(filepath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file_descriptor == -1)
+    {
+        printf("error: failed to open %s for writing\n", filepath);
+        return false;
+    }
+
+    fflush(stdout);
+    g_saved_stdout = dup(STDOUT_FILENO);
+    if (g_saved_stdout == -1 || dup2(file_descriptor, STDOUT_FILENO) == -1)
+    {
+        printf("error: failed to redirect stdout\n");
+        if (g_saved_stdout != -1)
+        {
+            close(g_saved_stdout);
+            g_saved_stdout = -1;
+        }
+        close(file_descriptor);
+        return false;
+    }
+
+    close(file_descriptor);
+    return true;
+}
+
+void os_restore_stdout()
+{
+    assert(g_saved_stdout != -1);
+
+    fflush(stdout);
+    dup2(g_saved_stdout, STDOUT_FILENO);
+    close(g_saved_stdout);
+    g_saved_stdout = -1;
+}
+
+i64 os_get_process_id()
+{
+    return getpid();
+}
+
+Os_File *os_open_file_for_reading(const char *filepath)
+{
+    Os_File *file = (Os_File*)os_allocate_memory(sizeof(Os_File));
+    if (!file)
+    {
+        printf("error: out of memory\n");
+        return 0;
+    }
+
+    if (strcmp(filepath, "-") == 0)
+    {
+        file->file_descriptor = STDIN_FILENO;
+        return file;
+    }
+
+    file->file_descriptor = open(filepath, O_RDONLY, 0);
+    if (file->file_descriptor == -1)
+    {
+        printf("error: failed to open %s for reading\n", filepath);
+        os_free_memory(file);
+        return 0;
+    }
+    return file;
+}
+
+i64 os_read_file(Os_File *file, void *buffer, size_t size)
+{
+    ssize_t size_read;
+    do
+    {
+        size_read = read(file->file_descriptor, buffer, size);
+    }
+    while (size_read == -1 && errno == EINTR);
+
+    if (size_read == -1)
+    {
+        printf("error: read failed\n");
+    }
+    return size_read;
+}
+
+void os_close_file(Os_File *file)
+{
+    if (file->file_descriptor != STDIN_FILENO)
+    {
+        close(file->file_descriptor);
+    }
+    os_free_memory(file);
+}
+
+static void *thread_start(void *parameter)
+{
+    Os_Thread *thread = (Os_Thread*)parameter;
+    thread->proc(thread->data);
+    return 0;
+}
+
+Os_Thread *os_create_thread(Os_Thread_Proc *proc, void *data)
+{
+    Os_Thread *thread = (Os_Thread*)os_allocate_memory(sizeof(Os_Thread));
+    if (!thread)
+    {
+        return 0;
+    }
+    thread->proc = proc;
+    thread->data = data;
+
+    if (pthread_create(&thread->handle, 0, thread_start, thread) != 0)
+    {
+        os_free_memory(thread);
+        return 0;
+    }
+    return thread;
+}
+
+void os_join_thread(Os_Thread *thread)
+{
+    pthread_join(thread->handle, 0);
+    os_free_memory(thread);
+}
+
+i32 os_get_processor_count()
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? count : 1;
+}
+
+u64 os_atomic_load(volatile u64 *value)
+{
+    return __atomic_load_n(value, __ATOMIC_SEQ_CST);
+}
+
+void os_atomic_store(volatile u64 *value, u64 new_value)
+{
+    __atomic_store_n(value, new_value, __ATOMIC_SEQ_CST);
+}
+
+b32 os_atomic_compare_exchange(volatile u64 *value, u64 expected, u64 desired)
+{
+    return __atomic_compare_exchange_n(value, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
 }
 
 #else // no supported os specified
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 void *os_allocate_memory(size_t size)
 {
@@ -88,6 +433,12 @@ void *os_allocate_memory(size_t size)
     return memory;
 }
 
+void *os_reallocate_memory(void *memory, size_t size)
+{
+    memory = realloc(memory, size);
+    return memory;
+}
+
 void os_free_memory(void *memory)
 {
     free(memory);
@@ -158,4 +509,236 @@ b32 os_write_file(const char *filepath, Memory_Manager *memory_manager)
     return true;
 }
 
+b32 os_write_buffer_to_file(const char *filepath, const void *buffer, size_t size)
+{
+    FILE *fd = fopen(filepath, "wb");
+    if (!fd)
+    {
+        printf("error: %s could not be opened for writing\n", filepath);
+        return false;
+    }
+
+    size_t written = fwrite(buffer, 1, size, fd);
+    fclose(fd);
+    if (written != size)
+    {
+        printf("error: invalid count of bytes written\n");
+        return false;
+    }
+    return true;
+}
+
+// without os support the directory has to exist already
+b32 os_create_directory(const char *path)
+{
+    return true;
+}
+
+// without os support the file is read into memory instead
+void *os_map_file(const char *filepath, size_t *size)
+{
+    FILE *fd = fopen(filepath, "rb");
+    if (!fd)
+    {
+        return 0;
+    }
+
+    fseek(fd, 0L, SEEK_END);
+    long bytes = ftell(fd);
+    fseek(fd, 0L, SEEK_SET);
+    if (bytes <= 0)
+    {
+        fclose(fd);
+        return 0;
+    }
+
+    void *memory = os_allocate_memory(bytes);
+    if (!memory || fread(memory, 1, bytes, fd) != (size_t)bytes)
+    {
+        os_free_memory(memory);
+        fclose(fd);
+        return 0;
+    }
+
+    fclose(fd);
+    *size = bytes;
+    return memory;
+}
+
+void os_unmap_file(void *memory, size_t size)
+{
+    os_free_memory(memory);
+}
+
+struct Os_File {
+    FILE *fd;
+};
+
+// stdio's rename may refuse to replace a file, so this isn't atomic without os support
+b32 os_rename_file(const char *from, const char *to)
+{
+    remove(to);
+    if (rename(from, to) != 0)
+    {
+        printf("error: %s could not be renamed\n", from);
+        return false;
+    }
+    return true;
+}
+
+b32 os_delete_file(const char *filepath)
+{
+    return remove(filepath) == 0;
+}
+
+// without os support there are no modification times, listing and locking files,
+// and stdout can't be redirected
+b32 os_touch_file(const char *filepath)
+{
+    return false;
+}
+
+b32 os_list_directory(const char *path, Os_Directory_Proc *proc, void *data)
+{
+    return false;
+}
+
+Os_File *os_lock_file(const char *filepath)
+{
+    Os_File *file = (Os_File*)os_allocate_memory(sizeof(Os_File));
+    if (file)
+    {
+        file->fd = 0;
+    }
+    return file;
+}
+
+void os_unlock_file(Os_File *file)
+{
+    os_free_memory(file);
+}
+
+b32 os_redirect_stdout(const char *filepath)
+{
+    return false;
+}
+
+void os_restore_stdout()
+{
+}
+
+i64 os_get_process_id()
+{
+    return 0;
+}
+
+Os_File *os_open_file_for_reading(const char *filepath)
+{
+    Os_File *file = (Os_File*)os_allocate_memory(sizeof(Os_File));
+    if (!file)
+    {
+        printf("error: out of memory\n");
+        return 0;
+    }
+
+    if (strcmp(filepath, "-") == 0)
+    {
+        file->fd = stdin;
+        return file;
+    }
+
+    file->fd = fopen(filepath, "rb");
+    if (!file->fd)
+    {
+        printf("error: %s could not be opened for reading\n", filepath);
+        os_free_memory(file);
+        return 0;
+    }
+    return file;
+}
+
+i64 os_read_file(Os_File *file, void *buffer, size_t size)
+{
+    size_t size_read = fread(buffer, 1, size, file->fd);
+    if (size_read == 0 && ferror(file->fd))
+    {
+        printf("error: read failed\n");
+        return -1;
+    }
+    return size_read;
+}
+
+void os_close_file(Os_File *file)
+{
+    if (file->fd != stdin)
+    {
+        fclose(file->fd);
+    }
+    os_free_memory(file);
+}
+
+// without os support threads run to completion when they are created
+struct Os_Thread {
+    int unused;
+};
+
+Os_Thread *os_create_thread(Os_Thread_Proc *proc, void *data)
+{
+    Os_Thread *thread = (Os_Thread*)os_allocate_memory(sizeof(Os_Thread));
+    if (!thread)
+    {
+        return 0;
+    }
+    proc(data);
+    return thread;
+}
+
+void os_join_thread(Os_Thread *thread)
+{
+    os_free_memory(thread);
+}
+
+i32 os_get_processor_count()
+{
+    return 1;
+}
+
+// there is only one thread
+u64 os_atomic_load(volatile u64 *value)
+{
+    return *value;
+}
+
+void os_atomic_store(volatile u64 *value, u64 new_value)
+{
+    *value = new_value;
+}
+
+b32 os_atomic_compare_exchange(volatile u64 *value, u64 expected, u64 desired)
+{
+    if (*value != expected)
+    {
+        return false;
+    }
+    *value = desired;
+    return true;
+}
+
 #endif
+
+i32 os_get_worker_count(i32 thread_count, u64 work, u64 min_work, i32 max_workers)
+{
+    i64 count = thread_count;
+    if (count == 0)
+    {
+        count = os_get_processor_count();
+        if ((u64)count > work / min_work)
+        {
+            count = work / min_work;
+        }
+    }
+
+    if (count > max_workers) count = max_workers;
+    if (count < 1)           count = 1;
+    return count;
+}
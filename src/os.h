@@ -5,9 +5,58 @@
 #include "memory_manager.h"
 
 char* os_read_file_as_string(const char *filepath);
+
+// for reading a file in parts, "-" is stdin
+typedef struct Os_File Os_File;
+Os_File* os_open_file_for_reading(const char *filepath);
+i64      os_read_file(Os_File *file, void *buffer, size_t size); // 0 at the end, -1 on errors
+void     os_close_file(Os_File *file);
 b32   os_write_file(const char *filepath, Memory_Manager *memory_manager);
+b32   os_write_buffer_to_file(const char *filepath, const void *buffer, size_t size);
+b32   os_create_directory(const char *path); // true if it exists afterwards
+
+// maps a whole file copy-on-write, writes to the memory don't reach the file,
+// returns 0 without an error message if the file can't be mapped
+void* os_map_file(const char *filepath, size_t *size);
+void  os_unmap_file(void *memory, size_t size);
+
+b32 os_rename_file(const char *from, const char *to); // replaces to atomically
+b32 os_delete_file(const char *filepath);
+b32 os_touch_file(const char *filepath);              // sets the modification time to now
+
+// calls proc for every regular file in the directory
+typedef void Os_Directory_Proc(const char *name, u64 size, i64 modification_time, void *data);
+b32 os_list_directory(const char *path, Os_Directory_Proc *proc, void *data);
+
+// creates the file if needed and waits for an exclusive lock between processes,
+// the lock is released by os_unlock_file, returns 0 on errors
+Os_File* os_lock_file(const char *filepath);
+void     os_unlock_file(Os_File *file);
+
+// sends stdout into a file until os_restore_stdout
+b32  os_redirect_stdout(const char *filepath);
+void os_restore_stdout();
+i64  os_get_process_id();
 void* os_allocate_memory(size_t size);
+void* os_reallocate_memory(void *memory, size_t size);
 void  os_free_memory(void *buffer);
 
+typedef struct Os_Thread Os_Thread;
+typedef void Os_Thread_Proc(void *data);
+
+// returns 0 if the thread could not be created
+Os_Thread* os_create_thread(Os_Thread_Proc *proc, void *data);
+void       os_join_thread(Os_Thread *thread);
+i32        os_get_processor_count();
+
+// the threads to split work into parts of at least min_work on, thread_count 0 is one
+// per processor, the count is between 1 and max_workers
+i32 os_get_worker_count(i32 thread_count, u64 work, u64 min_work, i32 max_workers);
+
+// atomic operations on values shared between threads, each is a full memory barrier
+u64 os_atomic_load(volatile u64 *value);
+void os_atomic_store(volatile u64 *value, u64 new_value);
+b32 os_atomic_compare_exchange(volatile u64 *value, u64 expected, u64 desired); // true if it was expected and is desired now
+
 #endif // OS_H
 
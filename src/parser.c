@@ -6,38 +6,126 @@
 #include "string.h"
 #include "token.h"
 #include "os.h"
+#include "scope.h"
 
 #include <stdio.h>
 #include <string.h>
 
+typedef enum {
+    EXPRESSION_FRAME_EXPRESSION, // ends at the first token that is not a binary operator
+    EXPRESSION_FRAME_PARENTHESES,
+    EXPRESSION_FRAME_CALL,
+} Expression_Frame_Type;
+
+// a parenthesized expression or call whose ')' is still ahead
+typedef struct {
+    Expression_Frame_Type type;
+    Token token; // the '(' or the called identifier
+    u32 unary_start; // the unary operators in front of it, on the unary stack
+    u32 operand_start;
+    u32 operator_start;
+    u32 argument_start;
+} Expression_Frame;
+
+// reported errors are collected and printed when the parse is done
+typedef struct {
+    Token token;
+    const char *message;
+} Parser_Error;
+
+// a block, while or if whose statements are still ahead
+typedef struct {
+    Ast_Statement statement;
+    u32 statement_start; // of a block, on the statement stack
+} Statement_Frame;
+
 typedef struct {
     const char *filename;
-    Memory_Manager memory_manager;
+    Ast *ast;
+    Memory_Manager memory_manager; // the scopes
+
+    // lists are collected here while their nodes are parsed, nested lists on top
+    // of the outer ones, and then copied into the ast as consecutive nodes
+    AST_POOL(Ast_Statement) statement_stack;
+    AST_POOL(Ast_Index)     argument_stack;
+
+    // the nesting of statements and expressions, see parse_statement and parse_expression_frames
+    AST_POOL(Statement_Frame)  statement_frames;
+    AST_POOL(Expression_Frame) expression_frames;
+    AST_POOL(Ast_Index)        operand_stack;
+    AST_POOL(Token)            operator_stack;
+    AST_POOL(Token)            unary_stack;
+
+    // stream mode, a released function's body is dropped from the pools from these counts on
+    Memory_Manager globals_memory;
+    u32 body_declarations_start;
+    u32 body_statements_start;
+    u32 body_expressions_start;
+    u32 body_arguments_start;
+
+    Scope *globals;
+    Scope *scope; // innermost
+
+    AST_POOL(Parser_Error) errors;
+
+    // workers and the incremental parse give up at the first error and don't print it,
+    // the file is parsed again on one thread then
+    b32 quiet;
+    b32 whole_file; // the lexer has all tokens, not stream mode
+    b32 lazy_bodies; // only the signatures are parsed, file mode only
+
+    // the source of ast if parse_source_incremental can reuse it, the lexer still has its tokens
+    const char *reusable_source;
 } Parser;
 
-static Parser g_parser;
+// per thread, parser workers parse the functions of a file in parallel
+static THREAD_LOCAL Parser g_parser;
+
+static b32 g_lazy_bodies;
 
 #define GET_MEMORY(size) (memory_manager_alloc(&g_parser.memory_manager, (size)))
 
-static b32 parse_statement(Ast_Statement **statement);
-static b32 parse_statements(Ast_Statement **statements_root);
-static b32 parse_expression(Ast_Expression **ast_expression, b32 is_in_parenthesis);
+// only valid until the next expression is pushed
+#define EXPRESSION(index) (&g_parser.ast->expressions.nodes[index])
+
+static b32 parse_statement(Ast_Statement *statement);
+static b32 parse_statements();
+static b32 parse_expression(Ast_Index *expr);
 
 
 static void report_error(Token *t, const char *message)
 {
-    if (t->type == TOKEN_UNCLOSED_COMMENT)
-    {
-        printf("parser error (%d,%d): unclosed comment\n", t->line, t->c0);
-    }
-    else if (t->type == TOKEN_UNCLOSED_STRING)
-    {
-        printf("parser error (%d,%d): unclosed string\n", t->line, t->c0);
-    }
-    else
+    u32 index = AST_POOL_PUSH(g_parser.errors);
+    g_parser.errors.nodes[index].token = *t;
+    g_parser.errors.nodes[index].message = message;
+}
+
+// prints the collected errors while the lexer still has their source and drops them,
+// true if there were none
+static b32 print_errors()
+{
+    b32 result = g_parser.errors.count == 0;
+    for (u32 i = 0; i < g_parser.errors.count && !g_parser.quiet; i++)
     {
-        printf("parser error (%d,%d): %s (found token type = %d)\n", t->line, t->c0, message, t->type);
+        Token *t = &g_parser.errors.nodes[i].token;
+        i32 line, column;
+        lexer_get_line_column(t->offset, &line, &column);
+
+        if (t->type == TOKEN_UNCLOSED_COMMENT)
+        {
+            printf("parser error (%d,%d): unclosed comment\n", line, column);
+        }
+        else if (t->type == TOKEN_UNCLOSED_STRING)
+        {
+            printf("parser error (%d,%d): unclosed string\n", line, column);
+        }
+        else
+        {
+            printf("parser error (%d,%d): %s (found token type = %d)\n", line, column, g_parser.errors.nodes[i].message, t->type);
+        }
     }
+    g_parser.errors.count = 0;
+    return result;
 }
 
 static b32 is_literal(i32 token_type)
@@ -57,336 +145,491 @@ static b32 is_type_keyword(i32 token_type)
     return result;
 }
 
-static b32 parse_type(Ast_Type **type)
+static b32 parse_type(Ast_Index *type)
 {
-    Token *token = lexer_peek_token(0);
-    if (!is_type_keyword(token->type))
+    Token token = lexer_peek_token(0);
+    if (!is_type_keyword(token.type))
     {
         return false;
     }
-    *type = GET_MEMORY(sizeof(Ast_Type));
-    (*type)->token = token;
-    (*type)->next = 0;
+    i32 base = token.type;
+    u32 pointer_count = 0;
     lexer_eat_token();
 
     token = lexer_peek_token(0);
-    while (token->type == '*')
+    while (token.type == '*')
     {
-        (*type)->next = GET_MEMORY(sizeof(Ast_Type));
-        (*type)->next->token = token;
-        (*type)->next->next = 0;
+        pointer_count++;
         lexer_eat_token();
         token = lexer_peek_token(0);
-        type = &(*type)->next;
     }
 
+    *type = ast_intern_type(g_parser.ast, base, pointer_count);
     return true;
 }
 
-static b32 ident_already_defined_in_function(StringRef ident_str, Ast_Parameter *params_root, Ast_Statement *statements_root)
+// a type, an identifier and '(' can only be the start of a function
+static b32 starts_function()
+{
+    if (!is_type_keyword(lexer_peek_token(0).type))
+    {
+        return false;
+    }
+    i32 index = 1;
+    while (lexer_peek_token(index).type == '*')
+    {
+        index++;
+    }
+    b32 result = lexer_peek_token(index).type == TOKEN_IDENTIFIER &&
+                 lexer_peek_token(index + 1).type == '(';
+    return result;
+}
+
+// Panic mode: after an error in a statement or declaration the tokens up to and
+// including the next ';' are skipped, or up to and including the '}' of a block
+// that starts in between, or up to the '}' that ends the enclosing block. The
+// parse goes on from there. False if the next function or the end of the file comes
+// first, the function ends there then. Every token is skipped at most once.
+static b32 recover_statement()
 {
-    // search in parameters
-    Ast_Parameter *param = params_root;
-    while (param)
+    if (g_parser.quiet)
+    {
+        return false;
+    }
+
+    i32 depth = 0;
+    for (;;)
     {
-        if (param->ident)
+        Token token = lexer_peek_token(0);
+        if (token.type == '\0' || starts_function())
+        {
+            return false;
+        }
+        if (token.type == '}' && depth == 0)
+        {
+            return true;
+        }
+
+        lexer_eat_token();
+        if (token.type == '{')
+        {
+            depth++;
+        }
+        else if (token.type == '}')
         {
-            if (strings_equal_ref(param->ident->str_ref, ident_str))
+            depth--;
+            if (depth == 0)
             {
                 return true;
             }
         }
-        param = param->next;
-    }
-
-    // search in declarations
-    Ast_Statement *stmt = statements_root;
-    while (stmt && stmt->type == AST_DECLARATION)
-    {
-        if (strings_equal_ref(stmt->stmt_decl.ident->str_ref, ident_str))
+        else if (token.type == ';' && depth == 0)
         {
             return true;
         }
-        stmt = stmt->next;
     }
-
-    return false;
 }
 
-static b32 parse_function_invocation(Ast_Function_Invocation *invocation)
+// after an error outside of a body the tokens up to the next function are skipped
+static b32 recover_function()
 {
-    Token *token;
-    invocation->args_root = 0;
-
-    token = lexer_peek_token(0);
-    assert(token->type == TOKEN_IDENTIFIER);
-    invocation->ident = token;
-    lexer_eat_token();
-
-    token = lexer_peek_token(0);
-    assert(token->type == '(');
-    lexer_eat_token();
-
-    token = lexer_peek_token(0);
-    if (token->type == ')')
+    if (g_parser.quiet)
     {
-        lexer_eat_token();
-        return true;
+        return false;
     }
 
-    Ast_Argument **arg = &invocation->args_root;
     for (;;)
     {
-        *arg = GET_MEMORY(sizeof(Ast_Argument));
-        (*arg)->expr = 0;
-        (*arg)->next = 0;
-
-        if (!parse_expression(&(*arg)->expr, false))
-        {
-            return false;
-        }
-
-        token = lexer_peek_token(0);
-        if (token->type != ',')
+        Token token = lexer_peek_token(0);
+        if (token.type == '\0' || starts_function())
         {
-            break;
+            return true;
         }
-
         lexer_eat_token();
-        arg = &(*arg)->next;
     }
+}
 
-    if (token->type != ')')
+// identifiers that are not found are functions defined further down, the typer resolves those
+static Ast_Binding resolve_ident(Token *ident)
+{
+    Ast_Binding binding = {AST_NONE};
+    Ast_Binding *found = scope_lookup(g_parser.scope, ident->value.symbol);
+    if (found)
     {
-        report_error(token, "')' after last function-call argument expected");
-        return false;
+        binding = *found;
     }
-    lexer_eat_token();
+    return binding;
+}
 
-    return true;
+// copies the arguments collected from argument_start on into the ast
+static Ast_Span pop_arguments(u32 argument_start)
+{
+    Ast *ast = g_parser.ast;
+    Ast_Span span;
+    span.start = ast->arguments.count;
+    span.count = g_parser.argument_stack.count - argument_start;
+    for (u32 i = 0; i < span.count; i++)
+    {
+        u32 index = AST_POOL_PUSH(ast->arguments);
+        ast->arguments.nodes[index] = g_parser.argument_stack.nodes[argument_start + i];
+    }
+    g_parser.argument_stack.count = argument_start;
+    return span;
 }
 
-static b32 expression_is_unary(Ast_Expression *expr)
+static Ast_Span pop_statements(u32 statement_start)
 {
-    b32 is_unary = true;
-    while (expr)
+    Ast *ast = g_parser.ast;
+    Ast_Span span;
+    span.start = ast->statements.count;
+    span.count = g_parser.statement_stack.count - statement_start;
+    for (u32 i = 0; i < span.count; i++)
     {
-        i32 token_type = expr->token->type;
-        if ((token_type != '+' && token_type != '-' && token_type != '!'))
-        {
-            is_unary = false;
-            break;
-        }
-        expr = expr->left;
+        u32 index = AST_POOL_PUSH(ast->statements);
+        ast->statements.nodes[index] = g_parser.statement_stack.nodes[statement_start + i];
     }
-    return is_unary;
+    g_parser.statement_stack.count = statement_start;
+    return span;
 }
 
-static i32 get_possible_operator_precedence(i32 token_type, b32 is_unary)
+static Ast_Index push_statement(Ast_Statement *statement)
 {
-    i32 precedence;
+    Ast_Index index = AST_POOL_PUSH(g_parser.ast->statements);
+    g_parser.ast->statements.nodes[index] = *statement;
+    return index;
+}
 
-    switch (token_type)
+// binary operator precedences, tokens with precedence 0 end an expression
+static const u8 g_binary_precedence[TOKEN_OROR + 1] = {
+    [TOKEN_OROR]   = 1,
+    [TOKEN_ANDAND] = 2,
+    [TOKEN_EQEQ]   = 3,
+    [TOKEN_NE]     = 3,
+    [TOKEN_GE]     = 4,
+    [TOKEN_LE]     = 4,
+    ['>']          = 4,
+    ['<']          = 4,
+    ['+']          = 5,
+    ['-']          = 5,
+    ['*']          = 6,
+    ['/']          = 6,
+    ['%']          = 6,
+};
+
+static i32 get_binary_precedence(i32 token_type)
+{
+    if (token_type < 0 || token_type > TOKEN_OROR)
     {
-        case TOKEN_OROR:
-            precedence = 1;
-        break;
+        return 0;
+    }
+    return g_binary_precedence[token_type];
+}
 
-        case TOKEN_ANDAND:
-            precedence = 2;
-        break;
+static b32 is_unary_operator(i32 token_type)
+{
+    b32 result = token_type == '+' ||
+                 token_type == '-' ||
+                 token_type == '!';
+    return result;
+}
 
-        case TOKEN_EQEQ:
-        case TOKEN_NE:
-            precedence = 3;
-        break;
+static Ast_Index new_expression(Token token, Ast_Index left, Ast_Index right)
+{
+    Ast_Index index = AST_POOL_PUSH(g_parser.ast->expressions);
+    Ast_Expression *expr = EXPRESSION(index);
+    expr->token = token;
+    expr->left = left;
+    expr->right = right;
+    return index;
+}
 
-        case TOKEN_GE:
-        case TOKEN_LE:
-        case '>':
-        case '<':
-            precedence = 4;
-        break;
+// The unary operators from unary_start on apply to operand. They are chained through
+// left, the last one holds the operand on its right. They are pushed after their
+// operand, so the children of every expression come before it in the pool.
+static Ast_Index apply_unary(u32 unary_start, Ast_Index operand)
+{
+    if (g_parser.unary_stack.count == unary_start)
+    {
+        return operand;
+    }
 
-        case '+':
-        case '-':
-        case '!':
-            if (is_unary) precedence = 7;
-            else          precedence = 5;
+    Ast_Index unary = 0;
+    for (u32 i = unary_start; i < g_parser.unary_stack.count; i++)
+    {
+        unary = new_expression(g_parser.unary_stack.nodes[i], unary, 0);
+    }
+    EXPRESSION(unary)->right = operand;
+    g_parser.unary_stack.count = unary_start;
+    return unary;
+}
 
-        break;
+static void push_operand(Ast_Index operand)
+{
+    u32 index = AST_POOL_PUSH(g_parser.operand_stack);
+    g_parser.operand_stack.nodes[index] = operand;
+}
 
-        case '*':
-        case '/':
-        case '%':
-            precedence = 6;
-        break;
+static Ast_Index pop_operand()
+{
+    assert(g_parser.operand_stack.count > 0);
+    Ast_Index operand = g_parser.operand_stack.nodes[--g_parser.operand_stack.count];
+    return operand;
+}
 
-        default:
-            precedence = 0;
-        break;
+static void push_expression_frame(Expression_Frame_Type type, Token token, u32 unary_start)
+{
+    u32 index = AST_POOL_PUSH(g_parser.expression_frames);
+    Expression_Frame *frame = &g_parser.expression_frames.nodes[index];
+    frame->type = type;
+    frame->token = token;
+    frame->unary_start = unary_start;
+    frame->operand_start = g_parser.operand_stack.count;
+    frame->operator_start = g_parser.operator_stack.count;
+    frame->argument_start = g_parser.argument_stack.count;
+}
+
+// combines the waiting operators of at least min_precedence with their operands, the
+// later ones first, since those bind tighter or come after ones of equal precedence
+static void reduce_operators(u32 operator_start, i32 min_precedence)
+{
+    while (g_parser.operator_stack.count > operator_start)
+    {
+        Token operator = g_parser.operator_stack.nodes[g_parser.operator_stack.count - 1];
+        if (get_binary_precedence(operator.type) < min_precedence)
+        {
+            break;
+        }
+        g_parser.operator_stack.count--;
+
+        Ast_Index right = pop_operand();
+        Ast_Index left = pop_operand();
+        push_operand(new_expression(operator, left, right));
     }
-    
-    return precedence;
 }
 
-static b32 parse_expression(Ast_Expression **root, b32 is_in_parenthesis)
+// the call of a frame whose ')' has been eaten
+static Ast_Index close_call(Expression_Frame *frame)
 {
-    Ast_Expression **curr = root;
-    i32 prev_precedence = -1;
+    Ast_Index call = AST_POOL_PUSH(g_parser.ast->expressions);
+    Ast_Expression *expr = EXPRESSION(call);
+    expr->token = frame->token;
+    expr->is_call = true;
+    expr->binding = resolve_ident(&frame->token);
+    expr->arguments = pop_arguments(frame->argument_start);
+    return call;
+}
 
-    while (1)
-    {
-        // an iteration starts at the unallocated right node of an operator (root behaves the same)
-        // a valid expression iteration is:
-        // 1) unary operator
-        // 2) operand + operator
+// drops the frames from frame_base on after an error
+static void abandon_expression_frames(u32 frame_base)
+{
+    Expression_Frame *bottom = &g_parser.expression_frames.nodes[frame_base];
+    g_parser.operand_stack.count = bottom->operand_start;
+    g_parser.operator_stack.count = bottom->operator_start;
+    g_parser.argument_stack.count = bottom->argument_start;
+    g_parser.unary_stack.count = bottom->unary_start;
+    g_parser.expression_frames.count = frame_base;
+}
 
-        Token *token;
-        Ast_Expression *operand_expr = 0;
-        Token *operator = 0;
-        b32 is_unary = false;
+// Parentheses and calls are parsed on the expression frame stack instead of recursively,
+// so how deep they nest is only limited by memory. In a frame the operands and binary
+// operators wait on their stacks until an operator of lower or equal precedence or the
+// end of the frame combines them, so equal precedences associate to the left. Every token
+// is looked at a constant number of times.
+// The caller pushes the bottom frame, which is done when its expression or call ends.
+static b32 parse_expression_frames(Ast_Index *expr)
+{
+    u32 frame_base = g_parser.expression_frames.count - 1;
 
-        // 1) unary operator
-        token = lexer_peek_token(0);
-        if (token->type == '+' || token->type == '-' || token->type == '!')
+    for (;;)
+    {
+        Expression_Frame *frame = &g_parser.expression_frames.nodes[g_parser.expression_frames.count - 1];
+        Token token = lexer_peek_token(0);
+
+        // an operand, or a call without arguments
+        b32 closed_call = false;
+        if (frame->type == EXPRESSION_FRAME_CALL &&
+            token.type == ')' &&
+            g_parser.argument_stack.count == frame->argument_start &&
+            g_parser.operand_stack.count == frame->operand_start)
         {
-            operator = token;
-            is_unary = true;
+            lexer_eat_token();
+            closed_call = true;
         }
-        // 2) process operand / prepare for operator
-        else if (token->type == TOKEN_IDENTIFIER || is_literal(token->type) || token->type == '(')
+        else
         {
-            // operand_expr
-            operand_expr = GET_MEMORY(sizeof(Ast_Expression));
-            memset(operand_expr, 0, sizeof(Ast_Expression));
-            operand_expr->token = token;
+            u32 unary_start = g_parser.unary_stack.count;
+            while (is_unary_operator(token.type))
+            {
+                u32 index = AST_POOL_PUSH(g_parser.unary_stack);
+                g_parser.unary_stack.nodes[index] = token;
+                lexer_eat_token();
+                token = lexer_peek_token(0);
+            }
 
-            // just parenthesis
-            if (token->type == '(')
+            if (token.type == '(')
             {
                 lexer_eat_token();
-                if (!parse_expression(&operand_expr->left, true))
-                {
-                    return false;
-                }
+                push_expression_frame(EXPRESSION_FRAME_PARENTHESES, token, unary_start);
+                continue;
+            }
+            else if (token.type == TOKEN_IDENTIFIER && lexer_peek_token(1).type == '(')
+            {
                 lexer_eat_token();
+                lexer_eat_token();
+                push_expression_frame(EXPRESSION_FRAME_CALL, token, unary_start);
+                continue;
+            }
+
+            Ast_Index operand;
+            if (token.type == TOKEN_IDENTIFIER)
+            {
+                operand = new_expression(token, 0, 0);
+                EXPRESSION(operand)->binding = resolve_ident(&token);
             }
-            else if (token->type == TOKEN_IDENTIFIER)
+            else if (is_literal(token.type))
             {
-                Token *token1 = lexer_peek_token(1);
-                if (token1->type == '(')
+                operand = new_expression(token, 0, 0);
+            }
+            else
+            {
+                report_error(&token, "not an expression");
+                abandon_expression_frames(frame_base);
+                return false;
+            }
+            lexer_eat_token();
+            push_operand(apply_unary(unary_start, operand));
+        }
+
+        // after an operand a binary operator continues the frame, anything else ends it
+        for (;;)
+        {
+            frame = &g_parser.expression_frames.nodes[g_parser.expression_frames.count - 1];
+            Ast_Index closed;
+            if (closed_call)
+            {
+                closed_call = false;
+                closed = apply_unary(frame->unary_start, close_call(frame));
+            }
+            else
+            {
+                token = lexer_peek_token(0);
+                i32 precedence = get_binary_precedence(token.type);
+                if (precedence > 0)
+                {
+                    reduce_operators(frame->operator_start, precedence);
+                    u32 index = AST_POOL_PUSH(g_parser.operator_stack);
+                    g_parser.operator_stack.nodes[index] = token;
+                    lexer_eat_token();
+                    break;
+                }
+
+                reduce_operators(frame->operator_start, 1);
+                Ast_Index inner = pop_operand();
+                assert(g_parser.operand_stack.count == frame->operand_start);
+
+                if (frame->type == EXPRESSION_FRAME_EXPRESSION)
+                {
+                    closed = inner;
+                }
+                else if (frame->type == EXPRESSION_FRAME_PARENTHESES)
                 {
-                    operand_expr->function_invocation = GET_MEMORY(sizeof(Ast_Function_Invocation));
-                    memset(operand_expr->function_invocation, 0, sizeof(Ast_Function_Invocation));
-                    if (!parse_function_invocation(operand_expr->function_invocation))
+                    if (token.type != ')')
                     {
+                        report_error(&token, "')' expected after parenthesized expression");
+                        abandon_expression_frames(frame_base);
                         return false;
                     }
+                    lexer_eat_token();
+
+                    // the parenthesized expression is the left node of the '(' node
+                    closed = apply_unary(frame->unary_start, new_expression(frame->token, inner, 0));
                 }
                 else
                 {
+                    u32 index = AST_POOL_PUSH(g_parser.argument_stack);
+                    g_parser.argument_stack.nodes[index] = inner;
+
+                    if (token.type == ',')
+                    {
+                        lexer_eat_token();
+                        break;
+                    }
+                    if (token.type != ')')
+                    {
+                        report_error(&token, "')' after last function-call argument expected");
+                        abandon_expression_frames(frame_base);
+                        return false;
+                    }
                     lexer_eat_token();
+                    closed = apply_unary(frame->unary_start, close_call(frame));
                 }
             }
-            else
+
+            g_parser.expression_frames.count--;
+            if (g_parser.expression_frames.count == frame_base)
             {
-                lexer_eat_token();
+                *expr = closed;
+                return true;
             }
-            operator = lexer_peek_token(0);
-        }
-        else if (is_in_parenthesis && token->type == ')')
-        {
-            return true;
-        }
-        else
-        {
-            report_error(token, "not an expression");
-            return false;
-        }
-
-        i32 precedence = get_possible_operator_precedence(operator->type, is_unary);
-        if (precedence == 0)
-        {
-            *curr = operand_expr;
-            return true;
-        }
-        lexer_eat_token(); // operator viable and can be eaten
-
-        if (precedence > prev_precedence)
-        {
-            *curr = GET_MEMORY(sizeof(Ast_Expression));
-            memset(*curr, 0, sizeof(Ast_Expression));
-
-            (*curr)->token = operator;
-            (*curr)->left = operand_expr; // is 0 for unary
-
-            curr = &(*curr)->right;
-            prev_precedence = precedence;
+            push_operand(closed);
         }
-        else
-        {
-            *curr = operand_expr;
+    }
+}
 
-            // find the operator node that is to be substituted: go rightwards from root by precedence
-            curr = root;
-            b32 curr_is_unary = expression_is_unary(*curr);
-            i32 curr_precedence = get_possible_operator_precedence((*curr)->token->type, curr_is_unary);
-            while (precedence > curr_precedence)
-            {
-                curr = &(*curr)->right;
-                b32 curr_is_unary = expression_is_unary(*curr);
-                i32 curr_token_type = (*curr)->token->type;
-                curr_precedence = get_possible_operator_precedence(curr_token_type, curr_is_unary);
-            }
+static b32 parse_expression(Ast_Index *expr)
+{
+    Token none = {0};
+    push_expression_frame(EXPRESSION_FRAME_EXPRESSION, none, g_parser.unary_stack.count);
+    b32 result = parse_expression_frames(expr);
+    return result;
+}
 
-            // substitute
-            Ast_Expression *substitute = GET_MEMORY(sizeof(struct Ast_Expression));
-            substitute->token = operator;
-            substitute->left = *curr;
-            substitute->right = 0;
-            substitute->function_invocation = 0;
-            *curr = substitute;
+// parses ident(args) into a new expression
+static b32 parse_function_invocation(Ast_Index *call)
+{
+    Token token = lexer_peek_token(0);
+    assert(token.type == TOKEN_IDENTIFIER);
+    lexer_eat_token();
+    assert(lexer_peek_token(0).type == '(');
+    lexer_eat_token();
 
-            // update loop variables
-            curr = &substitute->right;
-            prev_precedence = precedence;
-        }
-    }
-    return true;
+    push_expression_frame(EXPRESSION_FRAME_CALL, token, g_parser.unary_stack.count);
+    b32 result = parse_expression_frames(call);
+    return result;
 }
 
 static b32 parse_assignment(Ast_Assignment *ast_assignment)
 {
-    Token *token;
+    Token token;
 
     token = lexer_peek_token(0);
-    if (token->type != TOKEN_IDENTIFIER)
+    if (token.type != TOKEN_IDENTIFIER)
     {
-        report_error(token, "identifier for assignment expected");
+        report_error(&token, "identifier for assignment expected");
         return false;
     }
     ast_assignment->ident = token;
+    ast_assignment->binding = resolve_ident(&token);
     lexer_eat_token();
 
     token = lexer_peek_token(0);
-    if (token->type != '=')
+    if (token.type != '=')
     {
-        report_error(token, "'=' for assignment expected");
+        report_error(&token, "'=' for assignment expected");
         return false;
     }
     lexer_eat_token();
 
-    b32 expr_parsed = parse_expression(&ast_assignment->expr, false);
+    b32 expr_parsed = parse_expression(&ast_assignment->expr);
     if (!expr_parsed)
     {
         return false;
     }
 
     token = lexer_peek_token(0);
-    if (token->type != ';')
+    if (token.type != ';')
     {
-        report_error(token, "';' at the end of assignment expected");
+        report_error(&token, "';' at the end of assignment expected");
         return false;
     }
     lexer_eat_token();
@@ -394,134 +637,79 @@ static b32 parse_assignment(Ast_Assignment *ast_assignment)
     return true;
 }
 
-static b32 parse_while(Ast_While *ast_while)
+// while (expr), the statement is parsed by parse_statement
+static b32 parse_while_head(Ast_While *ast_while)
 {
-    Token *token;
+    Token token;
 
     // while
     token = lexer_peek_token(0);
-    if (token->type != TOKEN_KEYWORD_WHILE)
+    if (token.type != TOKEN_KEYWORD_WHILE)
     {
-        report_error(token, "while keyword expected (internal error)");
+        report_error(&token, "while keyword expected (internal error)");
         return false;
     }
     lexer_eat_token();
 
     // (
     token = lexer_peek_token(0);
-    if (token->type != '(')
+    if (token.type != '(')
     {
-        report_error(token, "'(' expected before while keyword");
+        report_error(&token, "'(' expected before while keyword");
         return false;
     }
     lexer_eat_token();
 
     // expression
-    if (!parse_expression(&ast_while->expr, false))
+    if (!parse_expression(&ast_while->expr))
     {
         return false;
     }
 
     // )
     token = lexer_peek_token(0);
-    if (token->type != ')')
+    if (token.type != ')')
     {
-        report_error(token, "')' expected after while expression");
+        report_error(&token, "')' expected after while expression");
         return false;
     }
     lexer_eat_token();
 
-    // statement
-    if (!parse_statement(&ast_while->statement))
-    {
-        return false;
-    }
-
     return true;
 }
 
-static b32 parse_if(Ast_If *ast_if)
+// if (expr), the statements are parsed by parse_statement
+static b32 parse_if_head(Ast_If *ast_if)
 {
-    Token *token = lexer_peek_token(0);
+    Token token = lexer_peek_token(0);
     // if
-    if (token->type != TOKEN_KEYWORD_IF)
+    if (token.type != TOKEN_KEYWORD_IF)
     {
-        report_error(token, "if keyword expected (internal error)");
+        report_error(&token, "if keyword expected (internal error)");
         return false;
     }
     lexer_eat_token();
 
     // (
     token = lexer_peek_token(0);
-    if (token->type != '(')
+    if (token.type != '(')
     {
-        report_error(token, "'(' expected before if expression");
+        report_error(&token, "'(' expected before if expression");
         return false;
     }
     lexer_eat_token();
 
     // if-expression
-    if (!parse_expression(&ast_if->expr, false))
-    {
-        return false;
-    }
-    
-    // )
-    token = lexer_peek_token(0);
-    if (token->type != ')')
-    {
-        report_error(token, "')' expected after if expression");
-        return false;
-    }
-    lexer_eat_token();
-
-    // if-statement
-    if (!parse_statement(&ast_if->statement_if))
-    {
-        return false;
-    }
-
-    // else
-    token = lexer_peek_token(0);
-    if (token->type != TOKEN_KEYWORD_ELSE)
-    {
-        return true;
-    }
-    lexer_eat_token();
-
-    // else-statement
-    if (!parse_statement(&ast_if->statement_else))
-    {
-        return false;
-    }
-
-    return true;
-}
-
-static b32 parse_block(Ast_Block *ast_block)
-{
-    Token *token;
-
-    // {
-    token = lexer_peek_token(0);
-    if (token->type != '{')
-    {
-        report_error(token, "'{' expected for beginning of block (internal error)");
-        return false;
-    }
-    lexer_eat_token();
-
-    // statements
-    if (!parse_statements(&ast_block->statements_root))
+    if (!parse_expression(&ast_if->expr))
     {
         return false;
     }
 
-    // }
+    // )
     token = lexer_peek_token(0);
-    if (token->type != '}')
+    if (token.type != ')')
     {
-        report_error(token, "not a statement and not '}' for end of block");
+        report_error(&token, "')' expected after if expression");
         return false;
     }
     lexer_eat_token();
@@ -531,88 +719,81 @@ static b32 parse_block(Ast_Block *ast_block)
 
 static b32 parse_return(Ast_Return *ast_return)
 {
-    Token *token = lexer_peek_token(0);
-    if (token->type != TOKEN_KEYWORD_RETURN)
+    Token token = lexer_peek_token(0);
+    if (token.type != TOKEN_KEYWORD_RETURN)
     {
-        report_error(token, "return keyword expected (internal error)");
+        report_error(&token, "return keyword expected (internal error)");
         return false;
     }
     lexer_eat_token();
 
     token = lexer_peek_token(0);
     // ;
-    if (token->type == ';')
+    if (token.type == ';')
     {
         lexer_eat_token();
         return true;
     }
 
     // expr ;
-    if (!parse_expression(&ast_return->expr, false))
+    if (!parse_expression(&ast_return->expr))
     {
         return false;
     }
     token  = lexer_peek_token(0);
-    if (token->type != ';')
+    if (token.type != ';')
     {
-        report_error(token, "missing ';' after at the end of return statement");
+        report_error(&token, "missing ';' after at the end of return statement");
         return false;
     }
     lexer_eat_token();
     return true;
 }
 
-static void allocate_and_init_statement(Ast_Statement **statement, Ast_Node_Type type)
+static void init_statement(Ast_Statement *statement, Ast_Node_Type type, Token *first)
+{
+    memset(statement, 0, sizeof(Ast_Statement));
+    statement->type = type;
+    statement->offset = first->offset;
+}
+
+static b32 starts_statement(i32 token_type)
 {
-    *statement = GET_MEMORY(sizeof(Ast_Statement));
-    memset(*statement, 0, sizeof(Ast_Statement));
-    (*statement)->type = type;
+    b32 result = token_type == '{' ||
+                 token_type == TOKEN_KEYWORD_WHILE ||
+                 token_type == TOKEN_KEYWORD_IF ||
+                 token_type == TOKEN_KEYWORD_RETURN ||
+                 token_type == TOKEN_IDENTIFIER;
+    return result;
 }
 
-static b32 parse_statement(Ast_Statement **statement)
+// a statement that has no statements in it
+static b32 parse_simple_statement(Ast_Statement *statement)
 {
-    Token *token = lexer_peek_token(0);
-    if (token->type == '{')
+    Token token = lexer_peek_token(0);
+    if (token.type == TOKEN_IDENTIFIER)
     {
-        allocate_and_init_statement(statement, AST_BLOCK);
-        b32 parsed = parse_block(&(*statement)->stmt_block);
-        return parsed;
-    }
-    else if (token->type == TOKEN_KEYWORD_WHILE)
-    {
-        allocate_and_init_statement(statement, AST_WHILE);
-        b32 parsed = parse_while(&(*statement)->stmt_while);
-        return parsed;
-    }
-    else if (token->type == TOKEN_KEYWORD_IF)
-    {
-        allocate_and_init_statement(statement, AST_IF);
-        b32 parsed = parse_if(&(*statement)->stmt_if);
-        return parsed;
-    }
-    else if (token->type == TOKEN_IDENTIFIER)
-    {
-        Token *token1 = lexer_peek_token(1);
+        Token token1 = lexer_peek_token(1);
         // ident = expr;
-        if (token1->type == '=')
+        if (token1.type == '=')
         {
-            allocate_and_init_statement(statement, AST_ASSIGNMENT);
-            b32 parsed = parse_assignment(&(*statement)->stmt_assignment);
+            init_statement(statement, AST_ASSIGNMENT, &token);
+            b32 parsed = parse_assignment(&statement->stmt_assignment);
             return parsed;
         }
         // Func(...);
-        else if (token1->type == '(')
+        else if (token1.type == '(')
         {
-            allocate_and_init_statement(statement, AST_EXPRESSION);
-            if (!parse_function_invocation((*statement)->stmt_expr.function_invocation))
+            init_statement(statement, AST_EXPRESSION, &token);
+            if (!parse_function_invocation(&statement->stmt_expr))
             {
                 return false;
             }
 
             token = lexer_peek_token(0);
-            if (token->type != ';')
+            if (token.type != ';')
             {
-                report_error(token, "';' expected after function call statement (in parse_statement)");
+                report_error(&token, "';' expected after function call statement (in parse_statement)");
                 return false;
             }
             lexer_eat_token();
@@ -621,206 +802,294 @@ static b32 parse_statement(Ast_Statement **statement)
         }
         else
         {
-            report_error(token1, "invalid statement after an identifier has been found (n_parse_statement)");
+            report_error(&token1, "invalid statement after an identifier has been found (n_parse_statement)");
             return false;
         }
     }
-    else if (token->type == TOKEN_KEYWORD_RETURN)
+    else if (token.type == TOKEN_KEYWORD_RETURN)
     {
-        allocate_and_init_statement(statement, AST_RETURN);
-        b32 parsed = parse_return(&(*statement)->stmt_return);
+        init_statement(statement, AST_RETURN, &token);
+        b32 parsed = parse_return(&statement->stmt_return);
         return parsed;
     }
 
-    report_error(token, "not a statement");
+    report_error(&token, "not a statement");
     return false;
 }
 
-static b32 parse_statements(Ast_Statement **statements_root)
+static void push_statement_frame(Ast_Statement *statement)
 {
-    Ast_Statement **curr = statements_root;
+    u32 index = AST_POOL_PUSH(g_parser.statement_frames);
+    Statement_Frame *frame = &g_parser.statement_frames.nodes[index];
+    frame->statement = *statement;
+    frame->statement_start = g_parser.statement_stack.count;
+}
 
-    // workaround for declarations
-    while (*curr)
+// drops the frames from frame_base on after an error
+static void abandon_statement_frames(u32 frame_base)
+{
+    while (g_parser.statement_frames.count > frame_base)
     {
-        curr = &(*curr)->next;
+        Statement_Frame *frame = &g_parser.statement_frames.nodes[--g_parser.statement_frames.count];
+        if (frame->statement.type == AST_BLOCK)
+        {
+            g_parser.statement_stack.count = frame->statement_start;
+        }
     }
+}
 
-    while (1)
+// Blocks, whiles and ifs wait on the statement frame stack for their statements instead
+// of parsing them recursively, so how deep they nest is only limited by memory. The
+// statements of a block are collected on the statement stack, the ones of whiles and
+// ifs are pushed into the ast when they are done, as before.
+// Blocks can't declare anything, so they don't get a scope of their own, which would
+// make every lookup walk through one empty scope per nesting level.
+static b32 parse_statement(Ast_Statement *result)
+{
+    u32 frame_base = g_parser.statement_frames.count;
+
+    for (;;)
     {
+        // down to the next statement that has no statements in it
+        Ast_Statement statement;
+        b32 has_statement = true;
         b32 parsed = true;
-        Token *token = lexer_peek_token(0);
-        if (token->type == '{')
+        Token token = lexer_peek_token(0);
+        if (token.type == '{')
         {
-            allocate_and_init_statement(curr, AST_BLOCK);
-            parsed = parse_block(&(*curr)->stmt_block);
+            lexer_eat_token();
+            init_statement(&statement, AST_BLOCK, &token);
+            push_statement_frame(&statement);
+            if (starts_statement(lexer_peek_token(0).type))
+            {
+                continue;
+            }
+            has_statement = false;
+        }
+        else if (token.type == TOKEN_KEYWORD_WHILE)
+        {
+            init_statement(&statement, AST_WHILE, &token);
+            parsed = parse_while_head(&statement.stmt_while);
+            if (parsed)
+            {
+                push_statement_frame(&statement);
+                continue;
+            }
         }
-        else if (token->type == TOKEN_KEYWORD_WHILE)
+        else if (token.type == TOKEN_KEYWORD_IF)
         {
-            allocate_and_init_statement(curr, AST_WHILE);
-            parsed = parse_while(&(*curr)->stmt_while);
+            init_statement(&statement, AST_IF, &token);
+            parsed = parse_if_head(&statement.stmt_if);
+            if (parsed)
+            {
+                push_statement_frame(&statement);
+                continue;
+            }
         }
-        else if (token->type == TOKEN_KEYWORD_IF)
+        else
         {
-            allocate_and_init_statement(curr, AST_IF);
-            parsed = parse_if(&(*curr)->stmt_if);
+            parsed = parse_simple_statement(&statement);
         }
-        else if (token->type == TOKEN_KEYWORD_RETURN)
+
+        // a statement with an error is replaced by an error statement
+        if (!parsed)
         {
-            allocate_and_init_statement(curr, AST_RETURN);
-            parsed = parse_return(&(*curr)->stmt_return);
+            if (!recover_statement())
+            {
+                abandon_statement_frames(frame_base);
+                return false;
+            }
+            init_statement(&statement, AST_ERROR, &token);
         }
-        else if (token->type == TOKEN_IDENTIFIER)
+
+        // up through the frames the statement completes
+        for (;;)
         {
-            Token *token1 = lexer_peek_token(1);
-            // assignment
-            if (token1->type == '=')
+            if (g_parser.statement_frames.count == frame_base)
             {
-                allocate_and_init_statement(curr, AST_ASSIGNMENT);
-                parsed = parse_assignment(&(*curr)->stmt_assignment);
+                *result = statement;
+                return true;
             }
-            // function invocation
-            else if (token1->type == '(')
+
+            Statement_Frame *frame = &g_parser.statement_frames.nodes[g_parser.statement_frames.count - 1];
+            if (frame->statement.type == AST_BLOCK)
             {
-                allocate_and_init_statement(curr, AST_EXPRESSION);
-                if (!parse_function_invocation((*curr)->stmt_expr.function_invocation))
+                if (has_statement)
                 {
-                    return false;
+                    u32 index = AST_POOL_PUSH(g_parser.statement_stack);
+                    g_parser.statement_stack.nodes[index] = statement;
                 }
-                
+
                 token = lexer_peek_token(0);
-                if (token->type != ';')
+                if (starts_statement(token.type))
+                {
+                    break;
+                }
+
+                // }
+                if (token.type != '}')
                 {
-                    report_error(token, "';' expected after function call statement (in parse_statements)");
-                    return false;
+                    report_error(&token, "not a statement and not '}' for end of block");
+                    if (!recover_statement())
+                    {
+                        abandon_statement_frames(frame_base);
+                        return false;
+                    }
+                    has_statement = false;
+                    continue;
                 }
                 lexer_eat_token();
-                parsed = true;
+
+                frame->statement.stmt_block.statements = pop_statements(frame->statement_start);
+            }
+            else if (frame->statement.type == AST_WHILE)
+            {
+                frame->statement.stmt_while.statement = push_statement(&statement);
+            }
+            else if (!frame->statement.stmt_if.statement_if)
+            {
+                frame->statement.stmt_if.statement_if = push_statement(&statement);
+
+                // else
+                if (lexer_peek_token(0).type == TOKEN_KEYWORD_ELSE)
+                {
+                    lexer_eat_token();
+                    break;
+                }
             }
             else
             {
-                report_error(token1, "invalid statement after an identifier has been found (in parse_statements)");
-                parsed = false;
+                frame->statement.stmt_if.statement_else = push_statement(&statement);
             }
+
+            statement = frame->statement;
+            has_statement = true;
+            g_parser.statement_frames.count--;
         }
-        else
-        {
-            break;
-        }
+    }
+}
 
-        if (!parsed)
+// pushes the statements up to the first token that can't start one onto the statement stack
+static b32 parse_statements()
+{
+    while (starts_statement(lexer_peek_token(0).type))
+    {
+        Ast_Statement statement;
+        if (!parse_statement(&statement))
         {
             return false;
         }
 
-        curr = &(*curr)->next;
+        u32 index = AST_POOL_PUSH(g_parser.statement_stack);
+        g_parser.statement_stack.nodes[index] = statement;
     }
     return true;
 }
 
-static b32 parse_declarations(Ast_Statement **statements_root, Ast_Function *function)
+static b32 parse_declaration(Ast_Span *declarations)
 {
-    Ast_Statement **statement_it = statements_root;
+    Ast *ast = g_parser.ast;
+    Ast_Index type;
+    Token ident;
+    Token token;
 
-    Token *token = lexer_peek_token(0);
-    while (is_type_keyword(token->type))
+    if (!parse_type(&type))
     {
-        Ast_Type *type = 0;
-        Token *ident;
+        return false;
+    }
 
-        if (!parse_type(&type))
-        {
-            return false;
-        }
+    // identifier
+    token = lexer_peek_token(0);
+    if (token.type != TOKEN_IDENTIFIER)
+    {
+        report_error(&token, "identifier expected for declaration");
+        return false;
+    }
+    ident = token;
 
-        // identifier
-        token = lexer_peek_token(0);
-        if (token->type != TOKEN_IDENTIFIER)
-        {
-            report_error(token, "identifier expected for declaration");
-            return false;
-        }
-        if (ident_already_defined_in_function(token->str_ref, function->params_root, function->statements_root))
-        {
-            report_error(token, "ident is already defined");
-            return false;
-        }
-        ident = token;
-        lexer_eat_token();
+    Ast_Index decl_index = AST_POOL_PUSH(ast->declarations);
+    ast->declarations.nodes[decl_index].type = type;
+    ast->declarations.nodes[decl_index].ident = ident;
+    declarations->count++;
 
-        allocate_and_init_statement(statement_it, AST_DECLARATION);
-        Ast_Declaration *decl = &(*statement_it)->stmt_decl;
-        decl->type = type;
-        decl->ident = ident;
-        decl->expr = 0;
-        decl->next = 0;
+    // in scope for its own initializer already, like in c
+    Ast_Binding binding = {AST_DECLARATION, decl_index};
+    if (!scope_insert(g_parser.scope, ident.value.symbol, binding))
+    {
+        report_error(&token, "ident is already defined");
+    }
+    lexer_eat_token();
 
-        // ;
-        token = lexer_peek_token(0);
-        if (token->type == ';')
-        {
-            lexer_eat_token();
-        }
-        // =
-        else
-        {
-            if (token->type != '=')
-            {
-                report_error(token, "'=' expected for declaration");
-                return false;
-            }
-            lexer_eat_token();
+    // ;
+    token = lexer_peek_token(0);
+    if (token.type == ';')
+    {
+        lexer_eat_token();
+        return true;
+    }
 
-            // expr
-            if (!parse_expression(&decl->expr, false))
-            {
-                return false;
-            }
+    // =
+    if (token.type != '=')
+    {
+        report_error(&token, "'=' expected for declaration");
+        return false;
+    }
+    lexer_eat_token();
 
-            // ;
-            token = lexer_peek_token(0);
-            if (token->type != ';')
-            {
-                report_error(token, "';' expected at the end of the declaration");
-                return false;
-            }
-            lexer_eat_token();
-        }
+    // expr
+    Ast_Index expr;
+    if (!parse_expression(&expr))
+    {
+        return false;
+    }
+    ast->declarations.nodes[decl_index].expr = expr;
 
-        token = lexer_peek_token(0);
-        statement_it = &(*statement_it)->next;
+    // ;
+    token = lexer_peek_token(0);
+    if (token.type != ';')
+    {
+        report_error(&token, "';' expected at the end of the declaration");
+        return false;
     }
+    lexer_eat_token();
+
     return true;
 }
 
-
-static void allocate_and_zero_param(Ast_Parameter **param)
+// a function's declarations come before its statements, so they are consecutive in the pool
+static b32 parse_declarations(Ast_Span *declarations)
 {
-    *param = GET_MEMORY(sizeof(Ast_Parameter));
-    memset(*param, 0, sizeof(Ast_Parameter));
+    declarations->start = g_parser.ast->declarations.count;
+    declarations->count = 0;
+
+    while (is_type_keyword(lexer_peek_token(0).type))
+    {
+        if (!parse_declaration(declarations) && !recover_statement())
+        {
+            return false;
+        }
+    }
+    return true;
 }
 
-static b32 parse_function_parameters(Ast_Parameter **params_root)
+static b32 parse_function_parameters(Ast_Span *params)
 {
-    Ast_Parameter **param = params_root;
-    Token *token;
+    Ast *ast = g_parser.ast;
+    params->start = ast->parameters.count;
+    params->count = 0;
+    Token token;
 
     // void
     token = lexer_peek_token(0);
-    if (token->type == ')')
+    if (token.type == ')')
     {
-        allocate_and_zero_param(param);
         return true;
     }
-    if (token->type == TOKEN_KEYWORD_VOID)
+    if (token.type == TOKEN_KEYWORD_VOID)
     {
-        Token *token1 = lexer_peek_token(1);
-        if (token1->type == ')')
+        Token token1 = lexer_peek_token(1);
+        if (token1.type == ')')
         {
-            allocate_and_zero_param(param);
-            (*param)->type = GET_MEMORY(sizeof(Ast_Type));
-            (*param)->type->token = token;
-            (*param)->type->next = 0;
             lexer_eat_token();
             return true;
         }
@@ -829,180 +1098,1150 @@ static b32 parse_function_parameters(Ast_Parameter **params_root)
     // real arguments
     while (1)
     {
-        Ast_Type *type;
-        Token *ident = 0;
+        Ast_Index type;
+        Token ident;
 
-        Token *token = lexer_peek_token(0);
-        if (!is_type_keyword(token->type))
+        Token token = lexer_peek_token(0);
+        if (!parse_type(&type))
         {
-            report_error(token, "not a valid parameter type");
+            report_error(&token, "not a valid parameter type");
             return false;
         }
-        parse_type(&type);
 
         token = lexer_peek_token(0);
-        if (token->type != TOKEN_IDENTIFIER)
+        if (token.type != TOKEN_IDENTIFIER)
         {
-            report_error(token, "identifier expected after parameter type");
+            report_error(&token, "identifier expected after parameter type");
             return false;
         }
-        Ast_Parameter *param_defined_searcher = *params_root;
-        while (param_defined_searcher)
+        ident = token;
+
+        Ast_Index param_index = AST_POOL_PUSH(ast->parameters);
+        ast->parameters.nodes[param_index].type = type;
+        ast->parameters.nodes[param_index].ident = ident;
+        params->count++;
+
+        Ast_Binding binding = {AST_PARAMETER, param_index};
+        if (!scope_insert(g_parser.scope, ident.value.symbol, binding))
         {
-            if (strings_equal_ref(param_defined_searcher->ident->str_ref, token->str_ref))
-            {
-                report_error(token, "parameter is already defined");
-                return false;
-            }
-            param_defined_searcher = param_defined_searcher->next;
+            report_error(&token, "parameter is already defined");
         }
-        ident = token;
         lexer_eat_token();
 
-        allocate_and_zero_param(param);
-        (*param)->type = type;
-        (*param)->ident = ident;
-
         token = lexer_peek_token(0);
-        if (token->type != ',')
+        if (token.type != ',')
         {
             break;
         }
 
         lexer_eat_token(); // eat ','
-        param = &(*param)->next;
     }
     return true;
 }
 
-static b32 parse_functions(Ast_Function **functions_root)
+// parses the function at the current token and adds it to the globals
+// moves past the '}' that closes the body whose '{' was just eaten, the body is
+// parsed when parse_function_body is called
+static b32 skip_function_body(Ast_Function *function)
 {
-    Ast_Function **function = functions_root;
+    i32 token_count;
+    const i32 *types = lexer_token_types(&token_count);
+    i32 position = lexer_get_position();
+    function->body_start = position;
 
-    Token *token = lexer_peek_token(0);
-    while (is_type_keyword(token->type)) // global variables not existing yet
+    i32 depth = 0;
+    for (;; position++)
     {
-        Ast_Type *type;
-        Token *ident;
-
-        if (!parse_type(&type))
+        i32 type = types[position];
+        if (type == '\0' || type == TOKEN_UNCLOSED_COMMENT || type == TOKEN_UNCLOSED_STRING)
         {
+            lexer_set_position(position);
+            Token token = lexer_peek_token(0);
+            report_error(&token, "'}' expected for function declaration");
             return false;
         }
-
-        // ident
-        ident = lexer_peek_token(0);
-        if (ident->type != TOKEN_IDENTIFIER)
+        if (type == '{')
         {
-            report_error(ident, "identifier expected for function declaration");
-            return false;
+            depth++;
         }
-        lexer_eat_token();
-
-        // verify that ident is not already defined as a function
-        Ast_Function *function_it = *functions_root;
-        while (function_it)
+        else if (type == '}')
         {
-            if (strings_equal_ref(function_it->ident->str_ref, ident->str_ref))
+            if (depth == 0)
             {
-                report_error(ident, "function identifier is already defined");
-                return false;
+                break;
             }
-            function_it = function_it->next;
-        }
-
-        token = lexer_peek_token(0);
-        if (token->type != '(')
-        {
-            report_error(token, "'(' expected for function declaration");
-            return false;
+            depth--;
         }
-        lexer_eat_token();
-
-        *function = GET_MEMORY(sizeof(Ast_Function));
-        memset(*function, 0, sizeof(Ast_Function));
-        (*function)->type = type;
-        (*function)->ident = ident;
+    }
 
-        if (!parse_function_parameters(&(*function)->params_root))
-        {
-            return false;
-        }
+    function->body_end = position;
+    function->body_pending = true;
+    lexer_set_position(position + 1);
+    return true;
+}
 
-        // )
-        token = lexer_peek_token(0);
-        if (token->type != ')')
-        {
-            report_error(token, "not a function parameter");
-            return false;
-        }
-        lexer_eat_token();
+// the declarations and statements up to the '}' that closes the body, which is not eaten
+static b32 parse_body(Ast_Function *function)
+{
+    Ast *ast = g_parser.ast;
+    u32 statement_nodes_start = ast->statements.count;
+    u32 expression_nodes_start = ast->expressions.count;
 
-        // {
-        token = lexer_peek_token(0);
-        if (token->type != '{')
-        {
-            report_error(token, "'{' expected for function declaration");
-            return false;
-        }
-        lexer_eat_token();
+    if (!parse_declarations(&function->declarations))
+    {
+        return false;
+    }
 
-        // declarations
-        if (!parse_declarations(&(*function)->statements_root, *function))
+    u32 statement_start = g_parser.statement_stack.count;
+    for (;;)
+    {
+        if (!parse_statements())
         {
+            g_parser.statement_stack.count = statement_start;
             return false;
         }
 
-        // statements
-        if (!parse_statements(&(*function)->statements_root))
+        Token token = lexer_peek_token(0);
+        if (token.type == '}')
         {
-            return false;
+            break;
         }
-        
-        // }
-        token = lexer_peek_token(0);
-        if (token->type != '}')
+        report_error(&token, "'}' expected for function declaration");
+        if (!recover_statement())
         {
-            report_error(token, "'}' expected for function declaration");
+            g_parser.statement_stack.count = statement_start;
             return false;
         }
-        lexer_eat_token();
-
-        token = lexer_peek_token(0);
-        function = &(*function)->next;
     }
+    function->statements = pop_statements(statement_start);
 
+    function->statement_nodes.start = statement_nodes_start;
+    function->statement_nodes.count = ast->statements.count - statement_nodes_start;
+    function->expression_nodes.start = expression_nodes_start;
+    function->expression_nodes.count = ast->expressions.count - expression_nodes_start;
     return true;
 }
 
-b32 parse_file(const char *filepath, Ast *ast)
+static b32 parse_function(Ast_Index *function_index)
 {
-    char *source_code = os_read_file_as_string(filepath);
-    if (!source_code)
+    Ast *ast = g_parser.ast;
+    Ast_Index type;
+    Token ident;
+    Token token;
+    i32 token_start = lexer_get_position();
+
+    if (!parse_type(&type))
     {
         return false;
     }
-    lexer_init(source_code);
 
-    g_parser.filename = filepath;
-    memory_manager_init(&g_parser.memory_manager, MEGABYTES(1));
+    // ident
+    ident = lexer_peek_token(0);
+    if (ident.type != TOKEN_IDENTIFIER)
+    {
+        report_error(&ident, "identifier expected for function declaration");
+        return false;
+    }
+    lexer_eat_token();
+
+    token = lexer_peek_token(0);
+    if (token.type != '(')
+    {
+        report_error(&token, "'(' expected for function declaration");
+        return false;
+    }
+    lexer_eat_token();
+
+    // no other function is pushed while this one is parsed
+    *function_index = AST_POOL_PUSH(ast->functions);
+    Ast_Function *function = &ast->functions.nodes[*function_index];
+    function->type = type;
+    function->ident = ident;
+    function->token_start = token_start;
+
+    // added before the body, so recursive calls resolve
+    Ast_Binding binding = {AST_FUNCTION, *function_index};
+    if (!scope_insert(g_parser.globals, ident.value.symbol, binding))
+    {
+        report_error(&ident, "function identifier is already defined");
+    }
+
+    // parameters and declarations
+    g_parser.scope = scope_create(&g_parser.memory_manager, g_parser.globals);
 
-    Token *token;
-    ast->functions_root = 0;
-    if (!parse_functions(&ast->functions_root))
+    if (!parse_function_parameters(&function->params))
     {
         return false;
     }
 
-    // eof
+    // )
+    token = lexer_peek_token(0);
+    if (token.type != ')')
+    {
+        report_error(&token, "not a function parameter");
+        return false;
+    }
+    lexer_eat_token();
+
+    // {
     token = lexer_peek_token(0);
-    if (token->type != '\0')
+    if (token.type != '{')
     {
-        report_error(token, "eof expected");
+        report_error(&token, "'{' expected for function declaration");
         return false;
     }
     lexer_eat_token();
 
+    if (g_parser.lazy_bodies)
+    {
+        if (!skip_function_body(function))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        if (!parse_body(function))
+        {
+            return false;
+        }
+        lexer_eat_token(); // '}'
+    }
+
+    function->token_end = lexer_get_position();
+    if (g_parser.whole_file)
+    {
+        function->fingerprint = lexer_hash_tokens(function->token_start, function->token_end);
+    }
+
+    g_parser.scope = g_parser.globals;
     return true;
 }
 
+// the functions up to the end of the file, which is not eaten
+static b32 parse_functions()
+{
+    for (;;)
+    {
+        Token token = lexer_peek_token(0);
+        if (is_type_keyword(token.type)) // global variables not existing yet
+        {
+            Ast_Index function;
+            if (parse_function(&function))
+            {
+                continue;
+            }
+        }
+        else if (token.type == '\0')
+        {
+            return true;
+        }
+        else
+        {
+            report_error(&token, "eof expected");
+        }
+
+        if (!recover_function())
+        {
+            return false;
+        }
+    }
+}
+
+b32 parse_file(const char *filepath, Ast *ast)
+{
+    char *source_code = os_read_file_as_string(filepath);
+    if (!source_code)
+    {
+        return false;
+    }
+
+    g_parser.filename = filepath;
+    b32 result = parse_source(source_code, ast);
+    return result;
+}
+
+// Files with many functions are parsed in parallel. A scan over the tokens finds the
+// functions by matching braces, each worker parses a run of consecutive functions into
+// an ast of its own, and the workers' asts are appended in source order with their
+// indices shifted. Calls to functions of other workers stay unresolved for the typer.
+// If the scan or a worker fails, the file is parsed again on one thread, which then
+// reports the errors as usual.
+#define PARSER_MAX_WORKERS 16
+#define PARSER_MIN_CHUNK_TOKENS 16384
+
+typedef struct {
+    i32 token_start;
+    i32 token_end;
+    u32 function_count;
+    b32 parsed;
+    Ast ast;
+
+    // where the nodes go in the merged ast, the worker's node i goes to base + i
+    Ast *merged;
+    u32 function_base;
+    u32 parameter_base;
+    u32 declaration_base;
+    u32 statement_base;
+    u32 expression_base;
+    u32 argument_base;
+    AST_POOL(Ast_Index) type_map; // the index in the merged ast of each of the worker's types
+} Parser_Worker;
+
+typedef AST_POOL(i32) Position_List;
+
+static i32 g_thread_count; // 0 uses one thread per processor for large files
+
+void parse_set_thread_count(i32 thread_count)
+{
+    g_thread_count = thread_count;
+}
+
+// the first token of each function and then the eof token, false if the tokens
+// are not functions with balanced braces
+static b32 find_functions(Position_List *starts)
+{
+    i32 token_count;
+    const i32 *types = lexer_token_types(&token_count);
+
+    i32 position = 0;
+    for (;;)
+    {
+        u32 index = AST_POOL_PUSH(*starts);
+        starts->nodes[index] = position;
+        if (types[position] == '\0')
+        {
+            return true;
+        }
+        if (!is_type_keyword(types[position]))
+        {
+            return false;
+        }
+
+        // up to the brace that closes the first one, the last token is eof
+        i32 depth = 0;
+        for (;;)
+        {
+            i32 type = types[++position];
+            if (type == '\0' || (type == '}' && depth == 0))
+            {
+                return false;
+            }
+            if (type == '{')
+            {
+                depth++;
+            }
+            else if (type == '}' && --depth == 0)
+            {
+                break;
+            }
+        }
+        position++;
+    }
+}
+
+static void parse_chunk(void *data)
+{
+    Parser_Worker *worker = (Parser_Worker*)data;
+
+    // the first worker runs on the calling thread
+    Parser saved_parser = g_parser;
+    memset(&g_parser, 0, sizeof(Parser));
+    g_parser.quiet = true;
+    g_parser.whole_file = true;
+    memory_manager_init(&g_parser.memory_manager, KILOBYTES(256));
+    ast_init(&worker->ast);
+    g_parser.ast = &worker->ast;
+    g_parser.globals = scope_create(&g_parser.memory_manager, 0);
+    g_parser.scope = g_parser.globals;
+
+    lexer_set_position(worker->token_start);
+    worker->parsed = true;
+    for (u32 i = 0; i < worker->function_count && worker->parsed; i++)
+    {
+        Ast_Index function;
+        worker->parsed = parse_function(&function);
+    }
+    // the parser has to agree with the scan on where the functions end
+    worker->parsed = worker->parsed && lexer_get_position() == worker->token_end;
+    worker->parsed = print_errors() && worker->parsed;
+
+    os_free_memory(g_parser.statement_stack.nodes);
+    os_free_memory(g_parser.argument_stack.nodes);
+    os_free_memory(g_parser.statement_frames.nodes);
+    os_free_memory(g_parser.expression_frames.nodes);
+    os_free_memory(g_parser.operand_stack.nodes);
+    os_free_memory(g_parser.operator_stack.nodes);
+    os_free_memory(g_parser.unary_stack.nodes);
+    os_free_memory(g_parser.errors.nodes);
+    memory_manager_free(&g_parser.memory_manager);
+    g_parser = saved_parser;
+}
+
+static Ast_Index rebase_index(Ast_Index index, u32 base)
+{
+    Ast_Index result = index ? index + base : 0;
+    return result;
+}
+
+static void rebase_binding(Parser_Worker *worker, Ast_Binding *binding)
+{
+    if (binding->type == AST_FUNCTION)
+    {
+        binding->index += worker->function_base;
+    }
+    else if (binding->type == AST_PARAMETER)
+    {
+        binding->index += worker->parameter_base;
+    }
+    else if (binding->type == AST_DECLARATION)
+    {
+        binding->index += worker->declaration_base;
+    }
+}
+
+static void rebase_statement(Parser_Worker *worker, Ast_Statement *statement)
+{
+    u32 expression_base = worker->expression_base;
+    u32 statement_base = worker->statement_base;
+    switch (statement->type)
+    {
+        case AST_ASSIGNMENT:
+        {
+            rebase_binding(worker, &statement->stmt_assignment.binding);
+            statement->stmt_assignment.expr = rebase_index(statement->stmt_assignment.expr, expression_base);
+        }
+        break;
+
+        case AST_IF:
+        {
+            Ast_If *ast_if = &statement->stmt_if;
+            ast_if->expr = rebase_index(ast_if->expr, expression_base);
+            ast_if->statement_if = rebase_index(ast_if->statement_if, statement_base);
+            ast_if->statement_else = rebase_index(ast_if->statement_else, statement_base);
+        }
+        break;
+
+        case AST_WHILE:
+        {
+            statement->stmt_while.expr = rebase_index(statement->stmt_while.expr, expression_base);
+            statement->stmt_while.statement = rebase_index(statement->stmt_while.statement, statement_base);
+        }
+        break;
+
+        case AST_BLOCK:
+        {
+            statement->stmt_block.statements.start += statement_base;
+        }
+        break;
+
+        case AST_RETURN:
+        {
+            statement->stmt_return.expr = rebase_index(statement->stmt_return.expr, expression_base);
+        }
+        break;
+
+        case AST_EXPRESSION:
+        {
+            statement->stmt_expr = rebase_index(statement->stmt_expr, expression_base);
+        }
+        break;
+
+        default: assert(0);
+    }
+}
+
+// copies the worker's nodes into the merged ast, the workers merge in parallel
+static void merge_chunk(void *data)
+{
+    Parser_Worker *worker = (Parser_Worker*)data;
+    Ast *ast = &worker->ast;
+    Ast *merged = worker->merged;
+
+    for (u32 i = 1; i < ast->functions.count; i++)
+    {
+        Ast_Function *function = &merged->functions.nodes[worker->function_base + i];
+        *function = ast->functions.nodes[i];
+        function->type = worker->type_map.nodes[function->type];
+        function->params.start += worker->parameter_base;
+        function->declarations.start += worker->declaration_base;
+        function->statements.start += worker->statement_base;
+        function->statement_nodes.start += worker->statement_base;
+        function->expression_nodes.start += worker->expression_base;
+    }
+    for (u32 i = 1; i < ast->parameters.count; i++)
+    {
+        Ast_Parameter *param = &merged->parameters.nodes[worker->parameter_base + i];
+        *param = ast->parameters.nodes[i];
+        param->type = worker->type_map.nodes[param->type];
+    }
+    for (u32 i = 1; i < ast->declarations.count; i++)
+    {
+        Ast_Declaration *decl = &merged->declarations.nodes[worker->declaration_base + i];
+        *decl = ast->declarations.nodes[i];
+        decl->type = worker->type_map.nodes[decl->type];
+        decl->expr = rebase_index(decl->expr, worker->expression_base);
+    }
+    for (u32 i = 1; i < ast->statements.count; i++)
+    {
+        Ast_Statement *statement = &merged->statements.nodes[worker->statement_base + i];
+        *statement = ast->statements.nodes[i];
+        rebase_statement(worker, statement);
+    }
+    for (u32 i = 1; i < ast->expressions.count; i++)
+    {
+        Ast_Expression *expr = &merged->expressions.nodes[worker->expression_base + i];
+        *expr = ast->expressions.nodes[i];
+        if (expr->is_call)
+        {
+            expr->arguments.start += worker->argument_base;
+        }
+        else
+        {
+            expr->left = rebase_index(expr->left, worker->expression_base);
+            expr->right = rebase_index(expr->right, worker->expression_base);
+        }
+        rebase_binding(worker, &expr->binding);
+    }
+    for (u32 i = 1; i < ast->arguments.count; i++)
+    {
+        merged->arguments.nodes[worker->argument_base + i] = rebase_index(ast->arguments.nodes[i], worker->expression_base);
+    }
+
+    os_free_memory(worker->type_map.nodes);
+    ast_free(ast);
+}
+
+// runs proc for every worker, a worker whose thread can't be created runs right away
+static void run_workers(Os_Thread_Proc *proc, Parser_Worker *workers, i32 worker_count)
+{
+    Os_Thread *threads[PARSER_MAX_WORKERS];
+    for (i32 i = 1; i < worker_count; i++)
+    {
+        threads[i] = os_create_thread(proc, &workers[i]);
+        if (!threads[i])
+        {
+            proc(&workers[i]);
+        }
+    }
+    proc(&workers[0]);
+
+    for (i32 i = 1; i < worker_count; i++)
+    {
+        if (threads[i])
+        {
+            os_join_thread(threads[i]);
+        }
+    }
+}
+
+#define RESERVE_MERGED_POOL(pool, base) \
+    merged_count = 1; \
+    for (i32 i = 0; i < worker_count; i++) \
+    { \
+        workers[i].base = merged_count - 1; \
+        merged_count += workers[i].ast.pool.count - 1; \
+    } \
+    AST_POOL_RESERVE(ast->pool, merged_count); \
+    ast->pool.count = merged_count
+
+// false if the file is too small, or the scan or a worker failed
+static b32 parse_functions_in_parallel(Ast *ast)
+{
+    i32 token_count;
+    lexer_token_types(&token_count);
+    i32 worker_count = os_get_worker_count(g_thread_count, token_count, PARSER_MIN_CHUNK_TOKENS, PARSER_MAX_WORKERS);
+    if (worker_count < 2)
+    {
+        return false;
+    }
+
+    Position_List starts = {0};
+    b32 found = find_functions(&starts);
+    u32 function_count = starts.count - 1;
+    if (!found || function_count < (u32)worker_count)
+    {
+        os_free_memory(starts.nodes);
+        return false;
+    }
+
+    // about the same count of tokens for each worker
+    Parser_Worker workers[PARSER_MAX_WORKERS];
+    memset(workers, 0, sizeof(workers));
+    u32 function = 0;
+    for (i32 i = 0; i < worker_count; i++)
+    {
+        i32 token_end = (i64)token_count * (i+1) / worker_count;
+        u32 function_start = function;
+        while (function < function_count && (starts.nodes[function] < token_end || i == worker_count - 1))
+        {
+            function++;
+        }
+        workers[i].token_start = starts.nodes[function_start];
+        workers[i].token_end = starts.nodes[function];
+        workers[i].function_count = function - function_start;
+    }
+    os_free_memory(starts.nodes);
+
+    run_workers(parse_chunk, workers, worker_count);
+
+    b32 parsed = true;
+    for (i32 i = 0; i < worker_count; i++)
+    {
+        parsed = parsed && workers[i].parsed;
+    }
+    if (!parsed)
+    {
+        for (i32 i = 0; i < worker_count; i++)
+        {
+            ast_free(&workers[i].ast);
+        }
+        return false;
+    }
+
+    u32 merged_count;
+    RESERVE_MERGED_POOL(functions,    function_base);
+    RESERVE_MERGED_POOL(parameters,   parameter_base);
+    RESERVE_MERGED_POOL(declarations, declaration_base);
+    RESERVE_MERGED_POOL(statements,   statement_base);
+    RESERVE_MERGED_POOL(expressions,  expression_base);
+    RESERVE_MERGED_POOL(arguments,    argument_base);
+    for (i32 i = 0; i < worker_count; i++)
+    {
+        workers[i].merged = ast;
+
+        // the workers have few types, they are interned here and not while merging in parallel
+        Ast *worker_ast = &workers[i].ast;
+        for (u32 j = 0; j < worker_ast->types.count; j++)
+        {
+            Ast_Type *type = &worker_ast->types.nodes[j];
+            u32 index = AST_POOL_PUSH(workers[i].type_map);
+            workers[i].type_map.nodes[index] = j ? ast_intern_type(ast, type->base, type->pointer_count) : 0;
+        }
+    }
+    run_workers(merge_chunk, workers, worker_count);
+
+    // the workers only checked the function names against their own functions
+    for (u32 i = 1; i < ast->functions.count; i++)
+    {
+        Ast_Binding binding = {AST_FUNCTION, i};
+        if (!scope_insert(g_parser.globals, ast->functions.nodes[i].ident.value.symbol, binding))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+#undef RESERVE_MERGED_POOL
+
+b32 parse_source(const char *source_code, Ast *ast)
+{
+    lexer_init(source_code);
+    memory_manager_init(&g_parser.memory_manager, MEGABYTES(1));
+    ast_init(ast);
+    g_parser.ast = ast;
+    g_parser.globals = scope_create(&g_parser.memory_manager, 0);
+    g_parser.scope = g_parser.globals;
+    g_parser.whole_file = true;
+    g_parser.lazy_bodies = g_lazy_bodies;
+    g_parser.reusable_source = 0;
+    ast->globals = g_parser.globals;
+
+    // skipping the bodies is about as fast as the scan for the parallel parse
+    if (!g_parser.lazy_bodies && parse_functions_in_parallel(ast))
+    {
+        g_parser.reusable_source = source_code;
+        return true;
+    }
+
+    // the parallel parse may have left nodes and globals behind
+    memory_manager_reset(&g_parser.memory_manager);
+    ast_free(ast);
+    ast_init(ast);
+    g_parser.ast = ast;
+    g_parser.globals = scope_create(&g_parser.memory_manager, 0);
+    g_parser.scope = g_parser.globals;
+    ast->globals = g_parser.globals;
+    lexer_set_position(0);
+    g_parser.errors.count = 0;
+
+    // every error is reported, the parse goes on after each one
+    b32 parsed = parse_functions();
+    parsed = print_errors() && parsed;
+    if (!parsed)
+    {
+        return false;
+    }
+    lexer_eat_token(); // eof
+
+    g_parser.reusable_source = source_code;
+    return true;
+}
+
+// The incremental parse relexes only the edited part of the source, which it finds by
+// comparing the old and the new source. The functions before the first relexed token
+// and after the last one are kept. In between the functions are found by matching
+// braces, and a function whose fingerprint is the one of an old function there keeps
+// that function's nodes, so only the functions whose tokens changed are parsed.
+// Kept functions stay where they are in the pools, the offsets of their tokens after
+// the edit are shifted, and their calls are resolved again if the functions before
+// them are not the same anymore.
+//
+// The nodes of replaced functions stay in the pools as garbage until there are more
+// of them than live ones (and many), then the file is parsed from scratch. Whenever anything
+// fails the file is parsed from scratch too, so errors are the ones parse_source
+// reports.
+#define PARSER_MIN_DEAD_EXPRESSIONS 65536
+
+typedef AST_POOL(Ast_Function) Function_List;
+
+// removed_length bytes at offset were replaced by inserted_length bytes
+typedef struct {
+    u32 offset;
+    u32 removed_length;
+    u32 inserted_length;
+} Source_Edit;
+
+static u32 shift_offset(u32 offset, Source_Edit *edit)
+{
+    u32 result = offset < edit->offset ? offset : offset - edit->removed_length + edit->inserted_length;
+    return result;
+}
+
+static b32 is_in_edit(u32 offset, u32 edit_offset, u32 edit_length)
+{
+    b32 result = offset >= edit_offset && offset - edit_offset < edit_length;
+    return result;
+}
+
+static void rebind_ident(Ast_Binding *binding, u32 symbol)
+{
+    // only functions are bound through the globals, locals belong to the function
+    if (binding->type != AST_NONE && binding->type != AST_FUNCTION)
+    {
+        return;
+    }
+
+    Ast_Binding *found = scope_lookup(g_parser.globals, symbol);
+    binding->type = found ? found->type : AST_NONE;
+    binding->index = found ? found->index : 0;
+}
+
+// appends a copy of an old function to the functions, its tokens moved by token_delta,
+// without an edit the function is before it and stays as it is. Its calls only have
+// to be resolved again if the functions before it are not the ones they were.
+static b32 reuse_function(Ast_Function *old_function, i32 token_delta, Source_Edit *edit, b32 rebind)
+{
+    Ast *ast = g_parser.ast;
+    Ast_Index function_index = AST_POOL_PUSH(ast->functions);
+    Ast_Function *function = &ast->functions.nodes[function_index];
+    *function = *old_function;
+
+    Ast_Binding binding = {AST_FUNCTION, function_index};
+    if (!scope_insert(g_parser.globals, function->ident.value.symbol, binding))
+    {
+        return false;
+    }
+    if (!edit)
+    {
+        return true;
+    }
+
+    function->token_start += token_delta;
+    function->token_end += token_delta;
+    if (function->body_pending)
+    {
+        function->body_start += token_delta;
+        function->body_end += token_delta;
+    }
+    if (edit->removed_length == edit->inserted_length && !rebind)
+    {
+        return true;
+    }
+
+    function->ident.offset = shift_offset(function->ident.offset, edit);
+    for (u32 i = 0; i < function->params.count; i++)
+    {
+        Token *ident = &ast->parameters.nodes[function->params.start + i].ident;
+        ident->offset = shift_offset(ident->offset, edit);
+    }
+    for (u32 i = 0; i < function->declarations.count; i++)
+    {
+        Token *ident = &ast->declarations.nodes[function->declarations.start + i].ident;
+        ident->offset = shift_offset(ident->offset, edit);
+    }
+    for (u32 i = 0; i < function->statement_nodes.count; i++)
+    {
+        Ast_Statement *statement = &ast->statements.nodes[function->statement_nodes.start + i];
+        statement->offset = shift_offset(statement->offset, edit);
+        if (statement->type == AST_ASSIGNMENT)
+        {
+            Ast_Assignment *assignment = &statement->stmt_assignment;
+            assignment->ident.offset = shift_offset(assignment->ident.offset, edit);
+            if (rebind)
+            {
+                rebind_ident(&assignment->binding, assignment->ident.value.symbol);
+            }
+        }
+    }
+    for (u32 i = 0; i < function->expression_nodes.count; i++)
+    {
+        Ast_Expression *expr = &ast->expressions.nodes[function->expression_nodes.start + i];
+        expr->token.offset = shift_offset(expr->token.offset, edit);
+        if (rebind && expr->token.type == TOKEN_IDENTIFIER)
+        {
+            rebind_ident(&expr->binding, expr->token.value.symbol);
+        }
+    }
+    return true;
+}
+
+// A function with the same tokens as an old one can still have had the edit in between
+// them, in whitespace or a comment, so its tokens are not all shifted by the same
+// amount. Only tokens that start inside the edit can't be shifted.
+static b32 is_reusable(Ast_Function *old_function, i32 start, i32 end, Source_Edit *edit)
+{
+    Ast *ast = g_parser.ast;
+    for (i32 position = start; position < end; position++)
+    {
+        lexer_set_position(position);
+        if (is_in_edit(lexer_peek_token(0).offset, edit->offset, edit->inserted_length))
+        {
+            return false;
+        }
+    }
+
+    // the old tokens are gone, but every token that can't be shifted is in a node
+    u32 removed_start = edit->offset;
+    u32 removed_length = edit->removed_length;
+    b32 reusable = !is_in_edit(old_function->ident.offset, removed_start, removed_length);
+    for (u32 i = 0; i < old_function->params.count && reusable; i++)
+    {
+        u32 offset = ast->parameters.nodes[old_function->params.start + i].ident.offset;
+        reusable = !is_in_edit(offset, removed_start, removed_length);
+    }
+    for (u32 i = 0; i < old_function->declarations.count && reusable; i++)
+    {
+        u32 offset = ast->declarations.nodes[old_function->declarations.start + i].ident.offset;
+        reusable = !is_in_edit(offset, removed_start, removed_length);
+    }
+    for (u32 i = 0; i < old_function->statement_nodes.count && reusable; i++)
+    {
+        Ast_Statement *statement = &ast->statements.nodes[old_function->statement_nodes.start + i];
+        reusable = statement->type != AST_ASSIGNMENT ||
+                   !is_in_edit(statement->stmt_assignment.ident.offset, removed_start, removed_length);
+    }
+    for (u32 i = 0; i < old_function->expression_nodes.count && reusable; i++)
+    {
+        u32 offset = ast->expressions.nodes[old_function->expression_nodes.start + i].token.offset;
+        reusable = !is_in_edit(offset, removed_start, removed_length);
+    }
+    return reusable;
+}
+
+// the position after the '}' that closes the function at position, or -1
+static i32 find_function_end(const i32 *types, i32 position)
+{
+    if (!is_type_keyword(types[position]))
+    {
+        return -1;
+    }
+
+    i32 depth = 0;
+    for (;;)
+    {
+        i32 type = types[++position];
+        if (type == '\0' || (type == '}' && depth == 0))
+        {
+            return -1;
+        }
+        if (type == '{')
+        {
+            depth++;
+        }
+        else if (type == '}' && --depth == 0)
+        {
+            return position + 1;
+        }
+    }
+}
+
+// parses or reuses the functions from the token start up to end, old_functions from
+// first up to last are the ones that were there
+static b32 reparse_functions(i32 start, i32 end, Function_List *old_functions, u32 first, u32 last, Source_Edit *edit)
+{
+    i32 token_count;
+    const i32 *types = lexer_token_types(&token_count);
+
+    i32 position = start;
+    while (position < end)
+    {
+        i32 function_end = find_function_end(types, position);
+        if (function_end < 0 || function_end > end)
+        {
+            return false;
+        }
+
+        u64 fingerprint = lexer_hash_tokens(position, function_end);
+        Ast_Function *reused = 0;
+        for (u32 i = first; i < last && !reused; i++)
+        {
+            Ast_Function *old_function = &old_functions->nodes[i];
+            if (old_function->fingerprint == fingerprint &&
+                old_function->token_end - old_function->token_start == function_end - position &&
+                is_reusable(old_function, position, function_end, edit))
+            {
+                reused = old_function;
+            }
+        }
+
+        if (reused)
+        {
+            if (!reuse_function(reused, position - reused->token_start, edit, true))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            Ast_Index function;
+            lexer_set_position(position);
+            if (!parse_function(&function) || lexer_get_position() != function_end)
+            {
+                return false;
+            }
+        }
+        position = function_end;
+    }
+    return true;
+}
+
+static b32 parse_incremental(const char *source_code, Ast *ast)
+{
+    const char *old_source = lexer_get_source();
+    size_t old_length = strlen(old_source);
+    size_t new_length = strlen(source_code);
+
+    // the edit is between the longest common prefix and suffix, compared in blocks first
+    size_t min_length = old_length < new_length ? old_length : new_length;
+    size_t prefix = 0;
+    while (prefix + 64 <= min_length && memcmp(old_source + prefix, source_code + prefix, 64) == 0)
+    {
+        prefix += 64;
+    }
+    while (prefix < min_length && old_source[prefix] == source_code[prefix])
+    {
+        prefix++;
+    }
+    size_t suffix = 0;
+    while (suffix + 64 <= min_length - prefix &&
+           memcmp(old_source + old_length - suffix - 64, source_code + new_length - suffix - 64, 64) == 0)
+    {
+        suffix += 64;
+    }
+    while (suffix < min_length - prefix &&
+           old_source[old_length - 1 - suffix] == source_code[new_length - 1 - suffix])
+    {
+        suffix++;
+    }
+
+    Source_Edit source_edit = {prefix, old_length - prefix - suffix, new_length - prefix - suffix};
+    Lexer_Edit edit = lexer_relex(source_code, source_edit.offset, source_edit.removed_length, source_edit.inserted_length);
+    i32 token_delta = edit.new_end - edit.old_end;
+
+    Function_List old_functions = {ast->functions.nodes, ast->functions.count, ast->functions.capacity};
+    memset(&ast->functions, 0, sizeof(ast->functions));
+    AST_POOL_PUSH(ast->functions);
+
+    memory_manager_reset(&g_parser.memory_manager);
+    g_parser.ast = ast;
+    g_parser.globals = scope_create(&g_parser.memory_manager, 0);
+    g_parser.scope = g_parser.globals;
+    g_parser.lazy_bodies = g_lazy_bodies;
+    ast->globals = g_parser.globals;
+
+    // before the edit, after it and the ones in between
+    u32 first_changed = 1;
+    while (first_changed < old_functions.count && old_functions.nodes[first_changed].token_end <= edit.start)
+    {
+        first_changed++;
+    }
+    u32 first_after = first_changed;
+    while (first_after < old_functions.count && old_functions.nodes[first_after].token_start < edit.old_end)
+    {
+        first_after++;
+    }
+
+    b32 parsed = true;
+    for (u32 i = 1; i < first_changed && parsed; i++)
+    {
+        parsed = reuse_function(&old_functions.nodes[i], 0, 0, false);
+    }
+
+    i32 token_count;
+    lexer_token_types(&token_count);
+    i32 start = first_changed > 1 ? old_functions.nodes[first_changed - 1].token_end : 0;
+    i32 end = first_after < old_functions.count ? old_functions.nodes[first_after].token_start + token_delta : token_count - 1;
+    parsed = parsed && reparse_functions(start, end, &old_functions, first_changed, first_after, &source_edit);
+
+    // the same functions by name in the same places resolve the calls as before
+    b32 rebind = ast->functions.count != first_after;
+    for (u32 i = first_changed; i < first_after && parsed && !rebind; i++)
+    {
+        rebind = ast->functions.nodes[i].ident.value.symbol != old_functions.nodes[i].ident.value.symbol;
+    }
+
+    for (u32 i = first_after; i < old_functions.count && parsed; i++)
+    {
+        parsed = reuse_function(&old_functions.nodes[i], token_delta, &source_edit, rebind);
+    }
+    os_free_memory(old_functions.nodes);
+
+    g_parser.scope = g_parser.globals;
+    return parsed;
+}
+
+b32 parse_source_incremental(const char *source_code, Ast *ast)
+{
+    b32 reusable = g_parser.reusable_source &&
+                   g_parser.reusable_source == lexer_get_source() &&
+                   g_parser.ast == ast;
+    g_parser.reusable_source = 0;
+
+    if (reusable)
+    {
+        g_parser.quiet = true;
+        b32 parsed = parse_incremental(source_code, ast);
+        parsed = print_errors() && parsed;
+        g_parser.quiet = false;
+
+        u32 live_expressions = 0;
+        for (u32 i = 1; i < ast->functions.count && parsed; i++)
+        {
+            live_expressions += ast->functions.nodes[i].expression_nodes.count;
+        }
+        u32 dead_expressions = ast->expressions.count - 1 - live_expressions;
+        if (parsed && (dead_expressions < live_expressions || dead_expressions < PARSER_MIN_DEAD_EXPRESSIONS))
+        {
+            g_parser.reusable_source = source_code;
+            return true;
+        }
+    }
+
+    // the scopes are only used by this ast
+    ast_free(ast);
+    memory_manager_free(&g_parser.memory_manager);
+    return parse_source(source_code, ast);
+}
+
+void parse_set_lazy_bodies(b32 lazy_bodies)
+{
+    g_lazy_bodies = lazy_bodies;
+}
+
+b32 parse_function_body(Ast *ast, Ast_Function *function)
+{
+    if (!function->body_pending)
+    {
+        return true;
+    }
+
+    g_parser.ast = ast;
+    g_parser.globals = ast->globals;
+    g_parser.scope = scope_create(&g_parser.memory_manager, g_parser.globals);
+
+    // the parameters were checked for duplicates with the signature
+    for (u32 i = 0; i < function->params.count; i++)
+    {
+        Ast_Index param_index = function->params.start + i;
+        Ast_Binding binding = {AST_PARAMETER, param_index};
+        scope_insert(g_parser.scope, ast->parameters.nodes[param_index].ident.value.symbol, binding);
+    }
+
+    // the braces are balanced, so the '}' that ends the body is the one at body_end
+    lexer_set_position(function->body_start);
+    b32 parsed = parse_body(function);
+    parsed = print_errors() && parsed;
+    if (!parsed)
+    {
+        return false;
+    }
+
+    function->body_pending = false;
+    g_parser.scope = g_parser.globals;
+    return true;
+}
+
+b32 parse_stream_open(const char *filepath, Ast *ast)
+{
+    if (!lexer_init_stream(filepath))
+    {
+        return false;
+    }
+
+    g_parser.filename = filepath;
+    g_parser.whole_file = false;
+    g_parser.lazy_bodies = false; // the tokens of a body are gone when it would be needed
+    g_parser.reusable_source = 0;
+    memory_manager_init(&g_parser.memory_manager, KILOBYTES(64));
+    memory_manager_init(&g_parser.globals_memory, KILOBYTES(64));
+    ast_init(ast);
+    g_parser.ast = ast;
+
+    // the globals outlive the function scopes
+    g_parser.globals = scope_create(&g_parser.globals_memory, 0);
+    g_parser.scope = g_parser.globals;
+    ast->globals = g_parser.globals;
+    return true;
+}
+
+b32 parse_next_function(Ast *ast, Ast_Function **function)
+{
+    *function = 0;
+
+    Token token = lexer_peek_token(0);
+    if (is_type_keyword(token.type))
+    {
+        g_parser.body_declarations_start = ast->declarations.count;
+        g_parser.body_statements_start = ast->statements.count;
+        g_parser.body_expressions_start = ast->expressions.count;
+        g_parser.body_arguments_start = ast->arguments.count;
+
+        // the errors of a function are all reported, the functions after it are not parsed
+        Ast_Index function_index;
+        b32 parsed = parse_function(&function_index);
+        parsed = print_errors() && parsed;
+        if (!parsed)
+        {
+            return false;
+        }
+        *function = &ast->functions.nodes[function_index];
+        return true;
+    }
+
+    // eof
+    if (token.type != '\0')
+    {
+        report_error(&token, "eof expected");
+        print_errors();
+        return false;
+    }
+    lexer_close_stream();
+    return true;
+}
+
+void parse_release_function(Ast_Function *function)
+{
+    // the next functions only need the signature, the function and parameter nodes are kept
+    Ast *ast = g_parser.ast;
+    ast->declarations.count = g_parser.body_declarations_start;
+    ast->statements.count = g_parser.body_statements_start;
+    ast->expressions.count = g_parser.body_expressions_start;
+    ast->arguments.count = g_parser.body_arguments_start;
+    function->declarations.count = 0;
+    function->statements.count = 0;
+
+    memory_manager_reset(&g_parser.memory_manager);
+    lexer_release_tokens();
+}
@@ -3,6 +3,37 @@
 
 #include "ast.h"
 
+// Syntax errors don't stop the parse, every one is printed when it is done and the
+// result is false then. See recover_statement in parser.c.
 b32 parse_file(const char *filepath, Ast *ast);
+b32 parse_source(const char *source_code, Ast *ast); // source_code must stay alive with the ast
+
+// Parses source_code, the edited source of ast, again. ast has to come from the last
+// parse_source or parse_source_incremental, and its source has to be alive still.
+// Only the functions whose tokens changed are parsed, see parser.c.
+b32 parse_source_incremental(const char *source_code, Ast *ast);
+
+// 0 threads (the default) uses one thread per processor for files with many functions
+void parse_set_thread_count(i32 thread_count);
+
+// With lazy bodies parse_file and parse_source only parse the signatures and skip
+// each body by matching its braces, so they cost about as much as lexing the file.
+// parse_function_body parses a skipped body, on the thread that parsed the file and
+// while its source is still the lexer's. check_ast does that for all bodies before it
+// checks any, anything else that reads a body has to call it first.
+//
+// The errors are the ones of a full parse up to the first error in a body. A full
+// parse recovers from that in the rest of the file, a skipped body only up to its
+// matching '}', so later errors can differ. A file whose braces don't balance fails
+// when its signatures are parsed, before any body is.
+void parse_set_lazy_bodies(b32 lazy_bodies);
+b32  parse_function_body(Ast *ast, Ast_Function *function); // true if it was parsed already
+
+// Stream mode parses one function at a time. ast->functions holds the signatures
+// of the released functions and the current one. *function is 0 at the end of the
+// input. parse_release_function drops the function's body from the ast.
+b32  parse_stream_open(const char *filepath, Ast *ast);
+b32  parse_next_function(Ast *ast, Ast_Function **function);
+void parse_release_function(Ast_Function *function);
 
 #endif // PARSER_H
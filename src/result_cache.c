@@ -0,0 +1,296 @@
+#include "result_cache.h"
+#include "memory_manager.h"
+#include "os.h"
+#include "sha256.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RESULT_CACHE_MAGIC 0x53455263 // "cRES" in little endian
+
+// an entry is the captured output followed by this
+typedef struct {
+    u32 magic;
+    u32 verdict;
+    u64 output_size;
+} Result_Trailer;
+
+typedef struct {
+    u32 magic;
+    u32 unused;
+    u64 hits;
+    u64 misses;
+    u64 evictions;
+    u64 size; // of the entries, approximate until the next cleanup recounts it
+} Result_Stats;
+
+typedef struct {
+    const char *name;
+    u64 size;
+    i64 modification_time;
+} Entry_Info;
+
+typedef struct {
+    Memory_Manager memory; // the names
+    Entry_Info *entries;
+    u32 count;
+    u32 capacity;
+} Entry_List;
+
+static void get_filepath(Result_Cache *cache, const char *name, char *filepath, size_t size)
+{
+    snprintf(filepath, size, "%s/%s", cache->dir, name);
+}
+
+static void read_stats(Result_Cache *cache, Result_Stats *stats)
+{
+    char filepath[4096];
+    get_filepath(cache, "stats", filepath, sizeof(filepath));
+
+    memset(stats, 0, sizeof(Result_Stats));
+    stats->magic = RESULT_CACHE_MAGIC;
+
+    size_t size;
+    Result_Stats *stored = os_map_file(filepath, &size);
+    if (!stored)
+    {
+        return;
+    }
+    if (size == sizeof(Result_Stats) && stored->magic == RESULT_CACHE_MAGIC)
+    {
+        *stats = *stored;
+    }
+    os_unmap_file(stored, size);
+}
+
+static void write_stats(Result_Cache *cache, Result_Stats *stats)
+{
+    char filepath[4096];
+    get_filepath(cache, "stats", filepath, sizeof(filepath));
+    os_write_buffer_to_file(filepath, stats, sizeof(Result_Stats));
+}
+
+static b32 has_suffix(const char *name, const char *suffix)
+{
+    size_t name_length = strlen(name);
+    size_t suffix_length = strlen(suffix);
+    return name_length >= suffix_length && strcmp(name + name_length - suffix_length, suffix) == 0;
+}
+
+static void collect_entry(const char *name, u64 size, i64 modification_time, void *data)
+{
+    if (!has_suffix(name, ".result"))
+    {
+        return;
+    }
+
+    Entry_List *list = (Entry_List*)data;
+    if (list->count == list->capacity)
+    {
+        list->capacity = list->capacity ? 2*list->capacity : 256;
+        list->entries = os_reallocate_memory(list->entries, list->capacity*sizeof(Entry_Info));
+        if (!list->entries)
+        {
+            printf("error: out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    size_t name_size = strlen(name) + 1;
+    char *name_copy = memory_manager_alloc(&list->memory, name_size);
+    memcpy(name_copy, name, name_size);
+
+    Entry_Info *entry = &list->entries[list->count++];
+    entry->name = name_copy;
+    entry->size = size;
+    entry->modification_time = modification_time;
+}
+
+static int compare_entries_by_use(const void *a, const void *b)
+{
+    const Entry_Info *entry_a = (const Entry_Info*)a;
+    const Entry_Info *entry_b = (const Entry_Info*)b;
+    if (entry_a->modification_time != entry_b->modification_time)
+    {
+        return entry_a->modification_time < entry_b->modification_time ? -1 : 1;
+    }
+    return strcmp(entry_a->name, entry_b->name);
+}
+
+// deletes the least recently used entries until the cache is at 80% of its limit,
+// and recounts the size since concurrent runs may have stored the same entry
+static void cleanup(Result_Cache *cache, Result_Stats *stats)
+{
+    Entry_List list;
+    memset(&list, 0, sizeof(list));
+    memory_manager_init(&list.memory, KILOBYTES(64));
+
+    if (os_list_directory(cache->dir, collect_entry, &list))
+    {
+        qsort(list.entries, list.count, sizeof(Entry_Info), compare_entries_by_use);
+
+        u64 size = 0;
+        for (u32 i = 0; i < list.count; i++)
+        {
+            size += list.entries[i].size;
+        }
+
+        u64 target_size = cache->max_size / 10 * 8;
+        for (u32 i = 0; i < list.count && size > target_size; i++)
+        {
+            char filepath[4096];
+            get_filepath(cache, list.entries[i].name, filepath, sizeof(filepath));
+            if (os_delete_file(filepath))
+            {
+                size -= list.entries[i].size;
+                stats->evictions++;
+            }
+        }
+        stats->size = size;
+    }
+
+    os_free_memory(list.entries);
+    memory_manager_free(&list.memory);
+}
+
+static void update_stats(Result_Cache *cache, u64 hits, u64 misses, u64 added_size)
+{
+    char lock_filepath[4096];
+    get_filepath(cache, "stats.lock", lock_filepath, sizeof(lock_filepath));
+    Os_File *lock = os_lock_file(lock_filepath);
+    if (!lock)
+    {
+        return;
+    }
+
+    Result_Stats stats;
+    read_stats(cache, &stats);
+    stats.hits += hits;
+    stats.misses += misses;
+    stats.size += added_size;
+    if (stats.size > cache->max_size)
+    {
+        cleanup(cache, &stats);
+    }
+    write_stats(cache, &stats);
+
+    os_unlock_file(lock);
+}
+
+b32 result_cache_init(Result_Cache *cache, const char *dir, u64 max_size)
+{
+    memset(cache, 0, sizeof(Result_Cache));
+    cache->dir = dir;
+    cache->max_size = max_size;
+    return os_create_directory(dir);
+}
+
+b32 result_cache_lookup(Result_Cache *cache, const char *key, const char *source, size_t source_length, b32 *verdict)
+{
+    // the key's '\0' separates it from the source
+    Sha256 sha;
+    u8 digest[SHA256_SIZE];
+    sha256_init(&sha);
+    sha256_update(&sha, key, strlen(key) + 1);
+    sha256_update(&sha, source, source_length);
+    sha256_final(&sha, digest);
+
+    char name[2*SHA256_SIZE + 1];
+    for (i32 i = 0; i < SHA256_SIZE; i++)
+    {
+        snprintf(name + 2*i, 3, "%02x", digest[i]);
+    }
+    snprintf(cache->entry_filepath, sizeof(cache->entry_filepath), "%s/%s.result", cache->dir, name);
+    snprintf(cache->temp_filepath, sizeof(cache->temp_filepath), "%s/%s.%lld.tmp", cache->dir, name, (long long)os_get_process_id());
+
+    size_t size;
+    char *entry = os_map_file(cache->entry_filepath, &size);
+    if (entry)
+    {
+        Result_Trailer trailer;
+        b32 valid = false;
+        if (size >= sizeof(Result_Trailer))
+        {
+            memcpy(&trailer, entry + size - sizeof(Result_Trailer), sizeof(Result_Trailer));
+            valid = trailer.magic == RESULT_CACHE_MAGIC && trailer.output_size == size - sizeof(Result_Trailer);
+        }
+
+        if (valid)
+        {
+            fwrite(entry, 1, trailer.output_size, stdout);
+            os_unmap_file(entry, size);
+            *verdict = trailer.verdict;
+
+            os_touch_file(cache->entry_filepath);
+            update_stats(cache, 1, 0, 0);
+            return true;
+        }
+        os_unmap_file(entry, size);
+    }
+
+    update_stats(cache, 0, 1, 0);
+    return false;
+}
+
+b32 result_cache_begin_store(Result_Cache *cache)
+{
+    return os_redirect_stdout(cache->temp_filepath);
+}
+
+void result_cache_store(Result_Cache *cache, b32 verdict)
+{
+    // the trailer goes after the output while stdout still is the entry
+    Result_Trailer trailer;
+    memset(&trailer, 0, sizeof(trailer));
+    trailer.magic = RESULT_CACHE_MAGIC;
+    trailer.verdict = verdict;
+    fflush(stdout);
+    trailer.output_size = ftell(stdout);
+    fwrite(&trailer, sizeof(trailer), 1, stdout);
+    os_restore_stdout();
+
+    size_t size;
+    char *entry = os_map_file(cache->temp_filepath, &size);
+    if (!entry || size != trailer.output_size + sizeof(Result_Trailer))
+    {
+        printf("error: failed to read back %s\n", cache->temp_filepath);
+        if (entry)
+        {
+            os_unmap_file(entry, size);
+        }
+        os_delete_file(cache->temp_filepath);
+        return;
+    }
+    fwrite(entry, 1, trailer.output_size, stdout);
+    os_unmap_file(entry, size);
+
+    if (!os_rename_file(cache->temp_filepath, cache->entry_filepath))
+    {
+        os_delete_file(cache->temp_filepath);
+        return;
+    }
+    update_stats(cache, 0, 0, size);
+}
+
+void result_cache_print_stats(Result_Cache *cache)
+{
+    char lock_filepath[4096];
+    get_filepath(cache, "stats.lock", lock_filepath, sizeof(lock_filepath));
+    Os_File *lock = os_lock_file(lock_filepath);
+    if (!lock)
+    {
+        return;
+    }
+    Result_Stats stats;
+    read_stats(cache, &stats);
+    os_unlock_file(lock);
+
+    u64 lookups = stats.hits + stats.misses;
+    printf("cache directory: %s\n", cache->dir);
+    printf("hits:            %llu\n", (unsigned long long)stats.hits);
+    printf("misses:          %llu\n", (unsigned long long)stats.misses);
+    printf("hit rate:        %.1f%%\n", lookups ? 100.0 * stats.hits / lookups : 0.0);
+    printf("evictions:       %llu\n", (unsigned long long)stats.evictions);
+    printf("size:            %llu / %llu bytes\n", (unsigned long long)stats.size, (unsigned long long)cache->max_size);
+}
@@ -0,0 +1,38 @@
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include "general.h"
+
+// A cache of whole runs in a directory, like ccache for the frontend. An entry is
+// keyed by the sha256 of the frontend version and options and of the source. It holds
+// everything the run printed and its verdict, so a hit replays the run from the
+// source's hash alone.
+//
+// Entries are written to a temporary file and renamed into place, so concurrent runs
+// never see a partial entry. The counters and the size of the entries are kept in a
+// stats file under a lock. When the size passes the limit the least recently used
+// entries are deleted, where a hit counts as a use.
+#define RESULT_CACHE_DEFAULT_MAX_SIZE MEGABYTES(256)
+
+typedef struct {
+    const char *dir;
+    u64 max_size;
+    char entry_filepath[4096];
+    char temp_filepath[4096];
+} Result_Cache;
+
+// false if the directory can't be created
+b32 result_cache_init(Result_Cache *cache, const char *dir, u64 max_size);
+
+// on a hit the stored output is printed and *verdict is the stored verdict,
+// key is everything besides the source that changes the output
+b32 result_cache_lookup(Result_Cache *cache, const char *key, const char *source, size_t source_length, b32 *verdict);
+
+// after a miss, stdout goes into the new entry from result_cache_begin_store until
+// result_cache_store, which also prints what was captured
+b32  result_cache_begin_store(Result_Cache *cache);
+void result_cache_store(Result_Cache *cache, b32 verdict);
+
+void result_cache_print_stats(Result_Cache *cache);
+
+#endif // RESULT_CACHE_H
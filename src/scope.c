@@ -0,0 +1,107 @@
+#include "scope.h"
+
+#include <string.h>
+
+#define SCOPE_MIN_CAPACITY 8
+
+// symbols are small integers, the odd multiplier scatters neighbouring ones over the table
+static u32 get_slot_index(u32 symbol, u32 capacity)
+{
+    u32 index = (symbol * 2654435769u) & (capacity - 1);
+    return index;
+}
+
+static Scope_Entry *find_entry(Scope *scope, u32 symbol)
+{
+    u32 index = get_slot_index(symbol, scope->capacity);
+    for (;;)
+    {
+        Scope_Entry *entry = &scope->entries[index];
+        if (entry->symbol == symbol || entry->symbol == 0)
+        {
+            return entry;
+        }
+        index = (index + 1) & (scope->capacity - 1);
+    }
+}
+
+// the old entries stay in the arena, scopes are freed together with the ast
+static void grow(Scope *scope)
+{
+    Scope_Entry *old_entries = scope->entries;
+    u32 old_capacity = scope->capacity;
+
+    scope->capacity = old_capacity ? old_capacity * 2 : SCOPE_MIN_CAPACITY;
+    scope->entries = memory_manager_alloc(scope->memory, scope->capacity * sizeof(Scope_Entry));
+    memset(scope->entries, 0, scope->capacity * sizeof(Scope_Entry));
+
+    for (u32 i = 0; i < old_capacity; i++)
+    {
+        if (old_entries[i].symbol)
+        {
+            *find_entry(scope, old_entries[i].symbol) = old_entries[i];
+        }
+    }
+}
+
+Scope *scope_create(Memory_Manager *memory, Scope *parent)
+{
+    // most blocks declare nothing, so the entries are allocated on the first insert
+    Scope *scope = memory_manager_alloc(memory, sizeof(Scope));
+    scope->parent = parent;
+    scope->memory = memory;
+    scope->count = 0;
+    scope->capacity = 0;
+    scope->entries = 0;
+    return scope;
+}
+
+b32 scope_insert(Scope *scope, u32 symbol, Ast_Binding binding)
+{
+    assert(symbol);
+
+    // keep the load at 3/4 at most
+    if ((scope->count + 1) * 4 > scope->capacity * 3)
+    {
+        grow(scope);
+    }
+
+    Scope_Entry *entry = find_entry(scope, symbol);
+    if (entry->symbol)
+    {
+        return false;
+    }
+    entry->symbol = symbol;
+    entry->binding = binding;
+    scope->count++;
+    return true;
+}
+
+Ast_Binding *scope_lookup_local(Scope *scope, u32 symbol)
+{
+    if (scope->count == 0)
+    {
+        return 0;
+    }
+
+    Scope_Entry *entry = find_entry(scope, symbol);
+    if (entry->symbol == 0)
+    {
+        return 0;
+    }
+    return &entry->binding;
+}
+
+Ast_Binding *scope_lookup(Scope *scope, u32 symbol)
+{
+    while (scope)
+    {
+        Ast_Binding *binding = scope_lookup_local(scope, symbol);
+        if (binding)
+        {
+            return binding;
+        }
+        scope = scope->parent;
+    }
+    return 0;
+}
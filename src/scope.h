@@ -0,0 +1,29 @@
+#ifndef SCOPE_H
+#define SCOPE_H
+
+#include "ast.h"
+#include "memory_manager.h"
+
+// A scope maps interned identifiers (Token_Value.symbol) to their bindings.
+// Lookups go from the innermost scope outwards: the function's parameters
+// and declarations, then the global scope with the functions. Blocks can't
+// declare anything, so they have no scope.
+typedef struct {
+    u32 symbol; // 0 for an empty slot, symbols start at 1
+    Ast_Binding binding;
+} Scope_Entry;
+
+struct Scope {
+    Scope *parent;
+    Memory_Manager *memory; // the entries are grown in here
+    u32 count;
+    u32 capacity; // 0 or a power of two
+    Scope_Entry *entries;
+};
+
+Scope*       scope_create(Memory_Manager *memory, Scope *parent);
+b32          scope_insert(Scope *scope, u32 symbol, Ast_Binding binding); // false if already in this scope
+Ast_Binding* scope_lookup_local(Scope *scope, u32 symbol);
+Ast_Binding* scope_lookup(Scope *scope, u32 symbol);
+
+#endif // SCOPE_H
@@ -0,0 +1,127 @@
+#include "sha256.h"
+
+#include <string.h>
+
+// FIPS 180-4
+static const u32 g_round_constants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static u32 rotate_right(u32 x, i32 n)
+{
+    return (x >> n) | (x << (32 - n));
+}
+
+static void process_block(Sha256 *sha, const u8 *block)
+{
+    u32 w[64];
+    for (i32 i = 0; i < 16; i++)
+    {
+        w[i] = (u32)block[4*i] << 24 | (u32)block[4*i+1] << 16 | (u32)block[4*i+2] << 8 | block[4*i+3];
+    }
+    for (i32 i = 16; i < 64; i++)
+    {
+        u32 s0 = rotate_right(w[i-15], 7) ^ rotate_right(w[i-15], 18) ^ (w[i-15] >> 3);
+        u32 s1 = rotate_right(w[i-2], 17) ^ rotate_right(w[i-2], 19) ^ (w[i-2] >> 10);
+        w[i] = w[i-16] + s0 + w[i-7] + s1;
+    }
+
+    u32 a = sha->state[0], b = sha->state[1], c = sha->state[2], d = sha->state[3];
+    u32 e = sha->state[4], f = sha->state[5], g = sha->state[6], h = sha->state[7];
+    for (i32 i = 0; i < 64; i++)
+    {
+        u32 s1 = rotate_right(e, 6) ^ rotate_right(e, 11) ^ rotate_right(e, 25);
+        u32 choice = (e & f) ^ (~e & g);
+        u32 t1 = h + s1 + choice + g_round_constants[i] + w[i];
+        u32 s0 = rotate_right(a, 2) ^ rotate_right(a, 13) ^ rotate_right(a, 22);
+        u32 majority = (a & b) ^ (a & c) ^ (b & c);
+        u32 t2 = s0 + majority;
+
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    sha->state[0] += a; sha->state[1] += b; sha->state[2] += c; sha->state[3] += d;
+    sha->state[4] += e; sha->state[5] += f; sha->state[6] += g; sha->state[7] += h;
+}
+
+void sha256_init(Sha256 *sha)
+{
+    static const u32 initial_state[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    memcpy(sha->state, initial_state, sizeof(initial_state));
+    sha->length = 0;
+    sha->block_used = 0;
+}
+
+void sha256_update(Sha256 *sha, const void *data, size_t size)
+{
+    const u8 *p = (const u8*)data;
+    sha->length += size;
+
+    if (sha->block_used)
+    {
+        size_t take = 64 - sha->block_used;
+        if (take > size)
+        {
+            take = size;
+        }
+        memcpy(sha->block + sha->block_used, p, take);
+        sha->block_used += take;
+        p += take;
+        size -= take;
+        if (sha->block_used < 64)
+        {
+            return;
+        }
+        process_block(sha, sha->block);
+        sha->block_used = 0;
+    }
+
+    while (size >= 64)
+    {
+        process_block(sha, p);
+        p += 64;
+        size -= 64;
+    }
+
+    memcpy(sha->block, p, size);
+    sha->block_used = size;
+}
+
+void sha256_final(Sha256 *sha, u8 digest[SHA256_SIZE])
+{
+    u64 bit_length = sha->length * 8;
+
+    // a 1 bit, zeros up to 56 mod 64 bytes, then the length in bits
+    u8 padding[72] = {0x80};
+    size_t padding_size = (sha->block_used < 56 ? 56 : 120) - sha->block_used;
+    for (i32 i = 0; i < 8; i++)
+    {
+        padding[padding_size + i] = (u8)(bit_length >> (56 - 8*i));
+    }
+    sha256_update(sha, padding, padding_size + 8);
+    assert(sha->block_used == 0);
+
+    for (i32 i = 0; i < 8; i++)
+    {
+        digest[4*i]   = (u8)(sha->state[i] >> 24);
+        digest[4*i+1] = (u8)(sha->state[i] >> 16);
+        digest[4*i+2] = (u8)(sha->state[i] >> 8);
+        digest[4*i+3] = (u8)(sha->state[i]);
+    }
+}
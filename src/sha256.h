@@ -0,0 +1,20 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include "general.h"
+
+#define SHA256_SIZE 32
+
+// incremental, feed the input in any number of parts
+typedef struct {
+    u32 state[8];
+    u64 length;
+    u8 block[64];
+    u32 block_used;
+} Sha256;
+
+void sha256_init(Sha256 *sha);
+void sha256_update(Sha256 *sha, const void *data, size_t size);
+void sha256_final(Sha256 *sha, u8 digest[SHA256_SIZE]);
+
+#endif // SHA256_H
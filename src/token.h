@@ -4,6 +4,17 @@
 #include "general.h"
 #include "string.h"
 
+// keyword, spelling, first and last character (the lexer hashes keywords on these)
+#define KEYWORD_LIST(X) \
+    X(VOID,   "void",   'v', 'd') \
+    X(CHAR,   "char",   'c', 'r') \
+    X(INT,    "int",    'i', 't') \
+    X(DOUBLE, "double", 'd', 'e') \
+    X(RETURN, "return", 'r', 'n') \
+    X(IF,     "if",     'i', 'f') \
+    X(ELSE,   "else",   'e', 'e') \
+    X(WHILE,  "while",  'w', 'e')
+
 enum TokenType {
     // 0-255 are for ascii characters
 
@@ -11,15 +22,9 @@ enum TokenType {
 
     TOKEN_IDENTIFIER,
 
-    TOKEN_KEYWORD_VOID,
-    TOKEN_KEYWORD_CHAR,
-    TOKEN_KEYWORD_INT,
-    TOKEN_KEYWORD_DOUBLE,
-
-    TOKEN_KEYWORD_RETURN,
-    TOKEN_KEYWORD_IF,
-    TOKEN_KEYWORD_ELSE,
-    TOKEN_KEYWORD_WHILE,
+#define KEYWORD_TOKEN_TYPE(name, spelling, first, last) TOKEN_KEYWORD_##name,
+    KEYWORD_LIST(KEYWORD_TOKEN_TYPE)
+#undef KEYWORD_TOKEN_TYPE
 
     TOKEN_UNCLOSED_COMMENT,
     TOKEN_UNCLOSED_STRING,
@@ -39,17 +44,27 @@ enum TokenType {
     TOKEN_OROR,
 };
 
-typedef struct {
-    i32 type;
+enum TokenFlags {
+    TOKEN_FLAG_OVERFLOW = 1 << 0, // the literal's value does not fit into its Token_Value
+};
 
-    i32 c0, c1;
-    i32 line;
+// literals are decoded by the lexer
+typedef union {
+    u64 int_value;       // TOKEN_LITERAL_INT, saturated on overflow
+    double double_value; // TOKEN_LITERAL_DOUBLE
+    u32 symbol;          // TOKEN_IDENTIFIER and TOKEN_LITERAL_STRING, same text means same symbol
+    b32 bool_value;
+} Token_Value;
 
-    union {
-        StringRef str_ref;
-        i32 int_value;
-        b32 bool_value;
-    };
+// Line and column are computed from the offset only when needed, see lexer_get_line_column.
+// Every ast node holds tokens, so a token stays at 16 bytes: the type fits into 16 bits and
+// the length is only in the lexer's token buffer. The text of an identifier or string
+// literal is its symbol's, see lexer_token_string.
+typedef struct {
+    i16 type;
+    u8 flags;
+    u32 offset; // byte offset into the source
+    Token_Value value;
 } Token;
 
 #endif // TOKEN_H
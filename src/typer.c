@@ -1,818 +1,1049 @@
 #include "general.h"
 #include "ast.h"
+#include "lexer.h"
+#include "os.h"
+#include "parser.h"
+#include "scope.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 typedef struct {
-    Ast_Type *type;
+    Ast_Index type;
     Ast_Function *function;
 } Ident_Info;
 
-static b32 check_expr(Ast_Expression *expr, Ast_Type *type, Ast_Function *function, Ast_Function *functions_root);
+// Errors and warnings are collected while a function is checked and printed when it
+// is done, see check_ast for why. So are the functions whose signatures the check
+// read, check_ast uses the result again while none of them changed.
+typedef struct {
+    u32 offset; // relative to the function's name once the function is done
+    i32 token_type; // the type of the token an error was found at
+    const char *message;
+    b32 is_warning;
+} Typer_Diagnostic;
+
+typedef struct {
+    u32 symbol;
+    u64 signature; // see hash_signature, 0 if there was no function with the name
+} Typer_Dependency;
+
+typedef struct {
+    AST_POOL(Typer_Diagnostic) diagnostics;
+    AST_POOL(Typer_Dependency) dependencies;
+} Typer_Output;
+
+static THREAD_LOCAL Typer_Output *g_output;
 
 static void report_error(Token *t, const char *message)
 {
-    printf("typechecker error (%d,%d): %s (found token type = %d)\n", t->line, t->c0, message, t->type);
+    u32 index = AST_POOL_PUSH(g_output->diagnostics);
+    Typer_Diagnostic *diagnostic = &g_output->diagnostics.nodes[index];
+    diagnostic->offset = t->offset;
+    diagnostic->token_type = t->type;
+    diagnostic->message = message;
 }
 
-static b32 lookup_ident_info(Ident_Info *info, Token *ident, Ast_Function *function, Ast_Function *functions_root)
+static void report_warning(u32 offset, const char *message)
 {
-    if (function)
-    {
-        // search for token in function declarations
-        Ast_Statement *statement_it = function->statements_root;
-        while (statement_it && statement_it->type == AST_DECLARATION)
-        {
-            Ast_Declaration *decl = &statement_it->stmt_decl;
-            if (strings_equal_ref(ident->str_ref, decl->ident->str_ref))
-            {
-                info->type = decl->type;
-                info->function = 0;
-                return true;
-            }
-            statement_it = statement_it->next;
-        }
-
-        // search for token in function parameters
-        if (function)
-        {
-            Ast_Parameter *param = function->params_root;
-            while (param)
-            {
-                Token *t = param->ident;
-                if (t && strings_equal_ref(t->str_ref, ident->str_ref))
-                {
-                    info->type = param->type;
-                    info->function = 0;
-                    return true;
-                }
-                param = param->next;
-            }
-        }
-    }
-
-    // search for token in function identifiers
-    function = functions_root;
-    while (function)
-    {
-        if (strings_equal_ref(ident->str_ref, function->ident->str_ref))
-        {
-            info->type = function->type;
-            info->function = function;
-            return true;
-        }
-        function = function->next;
-    }
-
-    report_error(ident, "identifier is not defined");
-    return false;
+    u32 index = AST_POOL_PUSH(g_output->diagnostics);
+    Typer_Diagnostic *diagnostic = &g_output->diagnostics.nodes[index];
+    diagnostic->offset = offset;
+    diagnostic->message = message;
+    diagnostic->is_warning = true;
 }
 
-static b32 type_is_void(Ast_Type *type)
+// the return type and the parameter types, which are all a call reads of a function
+static u64 hash_signature(Ast_Function *function, Ast *ast)
 {
-    if (type->token->type == TOKEN_KEYWORD_VOID && type->next == 0)
+    u64 hash = (0x9e3779b97f4a7c15ull ^ function->type) * 0xff51afd7ed558ccdull;
+    for (u32 i = 0; i < function->params.count; i++)
     {
-        return true;
+        hash = (hash ^ ast->parameters.nodes[function->params.start + i].type) * 0xc4ceb9fe1a85ec53ull;
+        hash ^= hash >> 32;
     }
-    return false;
+    return hash | 1;
 }
 
-static b32 type_is_int(Ast_Type *type)
+static void add_dependency(u32 symbol, Ast_Function *function, Ast *ast)
 {
-    if (type->token->type == TOKEN_KEYWORD_INT && !type->next)
-    {
-        return true;
-    }
-    return false;
+    u32 index = AST_POOL_PUSH(g_output->dependencies);
+    Typer_Dependency *dependency = &g_output->dependencies.nodes[index];
+    dependency->symbol = symbol;
+    dependency->signature = function ? hash_signature(function, ast) : 0;
 }
 
-static b32 type_is_double(Ast_Type *type)
+static Ast_Expression *get_expression(Ast *ast, Ast_Index index)
 {
-    if (type->token->type == TOKEN_KEYWORD_DOUBLE && !type->next)
-    {
-        return true;
-    }
-    return false;
+    Ast_Expression *expr = index ? &ast->expressions.nodes[index] : 0;
+    return expr;
 }
 
-static b32 type_is_string(Ast_Type *type)
+static Ast_Statement *get_statement(Ast *ast, Ast_Index index)
 {
-    if (type->token->type == TOKEN_KEYWORD_CHAR &&
-        type->next && type->next->token->type == '*' &&
-        !type->next->next)
-    {
-        return true;
-    }
-    return false;
+    Ast_Statement *statement = index ? &ast->statements.nodes[index] : 0;
+    return statement;
 }
 
-static b32 types_equal(Ast_Type *t1, Ast_Type *t2)
+// the parser resolved the parameters and declarations, identifiers it could not
+// resolve are functions that are defined further down. Those are looked up every
+// time, an incremental parse can move or remove functions after the ones it keeps.
+static b32 resolve_ident_info(Ident_Info *info, Ast_Binding *binding, Token *ident, Ast *ast)
 {
-    while (t1 && t2)
+    Ast_Binding resolved = *binding;
+    if (resolved.type == AST_NONE)
     {
-        if (t1->token->type != t2->token->type)
+        Ast_Binding *global = scope_lookup(ast->globals, ident->value.symbol);
+        if (!global)
         {
+            add_dependency(ident->value.symbol, 0, ast);
             return false;
         }
-        t1 = t1->next;
-        t2 = t2->next;
+        resolved = *global;
     }
-    return !t1 && !t2;
-}
 
-static b32 check_function_invocation(Ast_Function_Invocation *invocation, Ident_Info *info, Ast_Function *function, Ast_Function *functions_root)
-{
-    Ast_Argument *arg = invocation->args_root; 
-    Ast_Parameter *param = info->function->params_root;
-    if (param && arg && !arg->expr)
+    info->function = 0;
+    if (resolved.type == AST_FUNCTION)
     {
-        if (type_is_void(param->type))
-        {
-            return true;
-        }
-        report_error(param->ident, "argument is of type 'void' but function paramter is not of type 'void'");
-        return false;
+        info->function = &ast->functions.nodes[resolved.index];
+        info->type = info->function->type;
+        add_dependency(ident->value.symbol, info->function, ast);
     }
-
-    while (arg && param)
+    else if (resolved.type == AST_PARAMETER)
     {
-        if (!check_expr(arg->expr, param->type, function, functions_root))
-        {
-            return false;
-        }
-        arg = arg->next;
-        param = param->next;
+        info->type = ast->parameters.nodes[resolved.index].type;
     }
-    if (arg && !param)
+    else
     {
-        report_error(invocation->ident, "more arguments than parameters");
-        return false;
+        assert(resolved.type == AST_DECLARATION);
+        info->type = ast->declarations.nodes[resolved.index].type;
     }
-    if (param && !arg)
+    return true;
+}
+
+static b32 lookup_ident_info(Ident_Info *info, Ast_Binding *binding, Token *ident, Ast *ast)
+{
+    if (!resolve_ident_info(info, binding, ident, ast))
     {
-        report_error(invocation->ident, "more parameters than arguments");
+        report_error(ident, "identifier is not defined");
         return false;
     }
-
     return true;
 }
 
-static b32 check_double_literal_within_limits(Token *token)
+// types are interned, so their properties are read and not compared
+static Ast_Type *get_type(Ast *ast, Ast_Index index)
 {
-    return true;
+    Ast_Type *type = &ast->types.nodes[index];
+    return type;
 }
 
-static b32 check_int_literal_within_limits(Token *token, b32 unary_is_negative)
+// types that don't change under unary '-'
+static u8 get_negatable_types(u8 types)
 {
-    assert(token->type == TOKEN_LITERAL_INT);
+    return types | (types << AST_TYPES_NEGATED_SHIFT);
+}
 
-    const char *max_positive = "2147483647";
-    const char *max_negative = "2147483648";
+static b32 is_unary_operator(Ast_Expression *expr)
+{
+    i32 token_type = expr->token.type;
+    return !expr->is_call && (token_type == '+' || token_type == '-' || token_type == '!');
+}
 
-    i32 cmp_len = 10;
-    const char *cmp = unary_is_negative ? max_negative : max_positive;
+// the unary operators that apply first hang off the last one's left and have no right
+static b32 is_unary_chain_link(Ast_Expression *expr)
+{
+    return is_unary_operator(expr) && !expr->right;
+}
 
-    StringRef str_ref = token->str_ref;
-    while (*str_ref.location == '0')
+// the last unary operator of a chain, it holds the operand
+static b32 is_unary(Ast_Expression *expr, Ast *ast)
+{
+    if (!is_unary_operator(expr) || !expr->right)
     {
-        str_ref.location++;
-        str_ref.length--;
+        return false;
     }
+    Ast_Expression *left = get_expression(ast, expr->left);
+    return !left || is_unary_chain_link(left);
+}
+
+static b32 is_arithmetic_operator(i32 token_type)
+{
+    return token_type == '+' || token_type == '-' || token_type == '*' || token_type == '/' || token_type == '%';
+}
+
+static b32 is_comparison_operator(i32 token_type)
+{
+    return token_type == TOKEN_EQEQ || token_type == TOKEN_NE || token_type == TOKEN_LE ||
+           token_type == TOKEN_GE || token_type == '>' || token_type == '<';
+}
 
-    if (str_ref.length > cmp_len)
+static b32 call_is_valid(Ast_Expression *call, Ident_Info *info, Ast *ast)
+{
+    if (!info->function || call->arguments.count != info->function->params.count)
     {
-        report_error(token, "int literal too large");
         return false;
     }
-    else if (str_ref.length < cmp_len)
-    {
-        return true;
-    }
-
-    assert(str_ref.length == cmp_len);
-
-    i32 index = 0;
-    while (index < str_ref.length)
+    for (u32 i = 0; i < call->arguments.count; i++)
     {
-        if (str_ref.location[index] > cmp[index])
+        Ast_Expression *arg = get_expression(ast, ast->arguments.nodes[call->arguments.start + i]);
+        Ast_Parameter *param = &ast->parameters.nodes[info->function->params.start + i];
+        if (!(arg->types & get_type(ast, param->type)->types))
         {
-            report_error(token, "int literal too large");
             return false;
         }
-        if (str_ref.location[index] < cmp[index])
-        {
-            return true;
-        }
-        index++;
     }
-
     return true;
 }
 
-static b32 check_expr_int(Ast_Expression *expr, b32 unary_is_negative, Ast_Function *function, Ast_Function *functions_root)
+// the types of expr from the ones of its children, nothing is reported here
+static u8 get_expression_types(Ast_Expression *expr, Ast *ast)
 {
-    assert(expr);
+    i32 token_type = expr->token.type;
+    u8 number_types = AST_TYPE_INT | AST_TYPE_DOUBLE;
+    u8 all_types = number_types | AST_TYPE_BOOL | AST_TYPE_STRING;
 
-    i32 token_type = expr->token->type;
-
-    // unary
-    if (token_type == '+' || token_type == '-')
+    if (token_type == TOKEN_IDENTIFIER)
     {
-        b32 is_unary = true;
-        b32 unary_is_negative = token_type == '-';
-
-        Ast_Expression *sub_expr = expr->left;
-        while (sub_expr)
+        Ident_Info info;
+        if (!resolve_ident_info(&info, &expr->binding, &expr->token, ast))
         {
-            i32 token_type = sub_expr->token->type;
-            if (token_type == '+')
-            {
-            }
-            else if (token_type == '-')
-            {
-                unary_is_negative = !unary_is_negative;
-            }
-            else if (token_type == '!')
-            {
-                report_error(sub_expr->token, "invalid unary operator '!' in +,- unary operators");
-                return false;
-            }
-            else
-            {
-                is_unary = false;
-                break;
-            }
-            sub_expr = sub_expr->left;
+            return 0;
         }
-        if (is_unary)
+        // a string is used as one without checking the call
+        u8 types = AST_TYPE_BOOL | get_type(ast, info.type)->types;
+        if (expr->is_call && !call_is_valid(expr, &info, ast))
         {
-            b32 check = check_expr_int(expr->right, unary_is_negative, function, functions_root);
-            return check;
+            types &= AST_TYPE_STRING;
         }
+        return get_negatable_types(types);
     }
-
-    if (token_type == '!')
-    {
-        report_error(expr->token, "invalid unary operator '!' in int expression");
-        return false;
-    }
-
-    // operators
-    if (token_type == '+' ||
-        token_type == '-' ||
-        token_type == '*' ||
-        token_type == '/' ||
-        token_type == '%')
-    {
-        b32 left  = check_expr_int(expr->left,  false, function, functions_root);
-        b32 right = check_expr_int(expr->right, false, function, functions_root);
-        return left && right;
-    }
-    // identifier
-    else if (token_type == TOKEN_IDENTIFIER)
+    else if (token_type == TOKEN_LITERAL_INT)
     {
-        Ident_Info ident_info;
-        if (!lookup_ident_info(&ident_info, expr->token, function, functions_root))
+        u64 value = expr->token.value.int_value;
+        u8 types = 0;
+        if (expr->token.flags & TOKEN_FLAG_OVERFLOW)
         {
-            return false;
+            return 0;
         }
-        if (!type_is_int(ident_info.type))
+        if (value <= 2147483647ull)
         {
-            report_error(expr->token, "type is not int");
-            return false;
+            types |= number_types;
         }
-        if (expr->function_invocation)
+        if (value <= 2147483648ull)
         {
-            if (!check_function_invocation(expr->function_invocation, &ident_info, function, functions_root))
-            {
-                return false;
-            }
+            types |= number_types << AST_TYPES_NEGATED_SHIFT;
         }
-        return true;
+        return types;
     }
-    // literal
-    else if (token_type == TOKEN_LITERAL_INT)
+    else if (token_type == TOKEN_LITERAL_DOUBLE)
+    {
+        return get_negatable_types(AST_TYPE_DOUBLE);
+    }
+    else if (token_type == TOKEN_LITERAL_STRING)
     {
-        b32 limit_check = check_int_literal_within_limits(expr->token, unary_is_negative);
-        return limit_check;
+        return AST_TYPE_STRING;
     }
     else if (token_type == '(')
     {
-        assert(!expr->right);
-        b32 check = check_expr_int(expr->left, false, function, functions_root);
-        return check;
+        Ast_Expression *inner = get_expression(ast, expr->left);
+        return get_negatable_types(inner->types & all_types);
     }
-    else if (token_type == TOKEN_LITERAL_DOUBLE)
+    else if (is_unary_chain_link(expr))
     {
-        report_error(expr->token, "cannot convert double to int");
-        return false;
+        // the types are the ones of the whole chain, on its last operator
+        return 0;
     }
-
-    report_error(expr->token, "not an int-expression");
-    return false;
-}
-
-static b32 check_expr_double(Ast_Expression *expr, b32 unary_is_negative, Ast_Function *function, Ast_Function *functions_root)
-{
-    assert(expr);
-
-    i32 token_type = expr->token->type;
-
-    // unary
-    if (token_type == '+' || token_type == '-')
+    else if (is_unary(expr, ast))
     {
-        b32 is_unary = true;
-        b32 unary_is_negative = token_type == '-';
-
-        Ast_Expression *sub_expr = expr->left;
-        while (sub_expr)
+        b32 has_sign = false;
+        b32 has_not = false;
+        b32 negated = false;
+        for (Ast_Expression *unary = expr; unary; unary = get_expression(ast, unary->left))
         {
-            i32 token_type = sub_expr->token->type;
-            if (token_type == '+')
-            {
-            }
-            else if (token_type == '-')
-            {
-                unary_is_negative = !unary_is_negative;
-            }
-            else if (token_type == '!')
+            if (unary->token.type == '!')
             {
-                report_error(sub_expr->token, "invalid unary operator '!' in +,- unary operators");
-                return false;
+                has_not = true;
             }
             else
             {
-                is_unary = false;
-                break;
+                has_sign = true;
+                negated ^= unary->token.type == '-';
             }
-            sub_expr = sub_expr->left;
-        }
-        if (is_unary)
-        {
-            b32 check = check_expr_double(expr->right, unary_is_negative, function, functions_root);
-            return check;
         }
 
-    }
-    if (token_type == '!')
-    {
-        report_error(expr->token, "invalid unary operator '!' in double expression");
-        return false;
-    }
-
-    // operators
-    if (token_type == '+' ||
-        token_type == '-' ||
-        token_type == '*' ||
-        token_type == '/' ||
-        token_type == '%')
-    {
-        b32 left  = check_expr_double(expr->left,  false, function, functions_root);
-        b32 right = check_expr_double(expr->right, false, function, functions_root);
-        return left && right;
-    }
-    // identifier
-    else if (token_type == TOKEN_IDENTIFIER)
-    {
-        Ident_Info ident_info;
-        if (!lookup_ident_info(&ident_info, expr->token, function, functions_root))
-        {
-            return false;
-        }
-        if (!type_is_double(ident_info.type))
+        Ast_Expression *operand = get_expression(ast, expr->right);
+        u8 operand_types = negated ? operand->types >> AST_TYPES_NEGATED_SHIFT : operand->types & all_types;
+        u8 types = 0;
+        if (!has_not)
         {
-            report_error(expr->token, "is not type double");
-            return false;
+            types = operand_types & number_types;
         }
-        if (expr->function_invocation)
+        else if (!has_sign)
         {
-            if (!check_function_invocation(expr->function_invocation, &ident_info, function, functions_root))
-            {
-                return false;
-            }
+            types = operand_types & AST_TYPE_BOOL;
         }
-        return true;
+        return get_negatable_types(types);
     }
-    // literal
-    else if (token_type == TOKEN_LITERAL_INT)
+
+    u8 left = get_expression(ast, expr->left)->types;
+    u8 right = get_expression(ast, expr->right)->types;
+    u8 types = 0;
+    if (is_arithmetic_operator(token_type))
     {
-        b32 limit_check = check_int_literal_within_limits(expr->token, unary_is_negative);
-        return limit_check;
+        types = left & right & number_types;
     }
-    else if (token_type == TOKEN_LITERAL_DOUBLE)
+    else if (is_comparison_operator(token_type))
     {
-        b32 limit_check = check_double_literal_within_limits(expr->token);
-        return limit_check;
+        types = (left & right & AST_TYPE_DOUBLE) ? AST_TYPE_BOOL : 0;
     }
-    else if (token_type == '(')
+    else if (token_type == TOKEN_ANDAND || token_type == TOKEN_OROR)
     {
-        assert(!expr->right);
-        b32 check = check_expr_double(expr->left, false, function, functions_root);
-        return check;
+        types = left & right & AST_TYPE_BOOL;
     }
+    return get_negatable_types(types);
+}
 
-    report_error(expr->token, "not a double-expression");
-    return false;
+// one pass over the function's expressions, the children come before their parents
+static void type_expressions(Ast_Function *function, Ast *ast)
+{
+    Ast_Span nodes = function->expression_nodes;
+    for (u32 i = 0; i < nodes.count; i++)
+    {
+        Ast_Expression *expr = &ast->expressions.nodes[nodes.start + i];
+        expr->types = get_expression_types(expr, ast);
+    }
 }
 
-static b32 check_expr_bool(Ast_Expression *expr, Ast_Function *function, Ast_Function *functions_root)
+typedef struct {
+    Ast_Expression *expr;
+    u8 context; // the type expr is used as
+    b32 negated;
+} Expression_Check;
+
+typedef AST_POOL(Expression_Check) Expression_Checks;
+
+static void push_expression_check(Expression_Checks *checks, Ast_Expression *expr, u8 context, b32 negated)
 {
-    assert(expr);
+    u32 index = AST_POOL_PUSH(*checks);
+    checks->nodes[index].expr = expr;
+    checks->nodes[index].context = context;
+    checks->nodes[index].negated = negated;
+}
+
+// reports what is wrong with a call, or pushes its first argument that doesn't fit
+static void report_call_errors(Ast_Expression *call, Ident_Info *info, Expression_Checks *checks, Ast *ast)
+{
+    if (!info->function)
+    {
+        report_error(&call->token, "identifier is not a function");
+        return;
+    }
 
-    i32 type = expr->token->type;
-    // unary
-    if (type == '!')
+    Ast_Span args = call->arguments;
+    Ast_Span params = info->function->params;
+    u32 count = args.count < params.count ? args.count : params.count;
+    for (u32 i = 0; i < count; i++)
     {
-        struct Ast_Expression *sub_expr = expr->left;
-        while (sub_expr)
+        Ast_Expression *arg = get_expression(ast, ast->arguments.nodes[args.start + i]);
+        Ast_Parameter *param = &ast->parameters.nodes[params.start + i];
+        u8 context = get_type(ast, param->type)->types;
+        if (!context)
         {
-            if (sub_expr->token->type != '!')
-            {
-                report_error(sub_expr->token, "unary operator is not '!' in +,- unary operators");
-                return false;
-            }
-            sub_expr = sub_expr->left;
+            assert(0);
+            report_error(&arg->token, "expression is no type at all");
+            return;
+        }
+        if (!(arg->types & context))
+        {
+            push_expression_check(checks, arg, context, false);
+            return;
         }
-        b32 check = check_expr_bool(expr->right, function, functions_root);
-        return check;
     }
-    // operators for bool (TOKEN_EQEQ does not work with bools!)
-    else if (type == TOKEN_ANDAND ||
-             type == TOKEN_OROR)
+    if (args.count > params.count)
     {
-        b32 left  = check_expr_bool(expr->left,  function, functions_root);
-        b32 right = check_expr_bool(expr->right, function, functions_root);
-        return left && right;
+        report_error(&call->token, "more arguments than parameters");
     }
-    // operators for numbers only
-    else if (type == TOKEN_EQEQ ||
-             type == TOKEN_NE ||
-             type == TOKEN_LE ||
-             type == TOKEN_GE ||
-             type == '>' ||
-             type == '<')
+    else if (args.count < params.count)
     {
-        b32 left  = check_expr_double(expr->left,  false, function, functions_root);
-        b32 right = check_expr_double(expr->right, false, function, functions_root);
-        return left && right;
+        report_error(&call->token, "more parameters than arguments");
     }
-    // identifier
-    else if (type == TOKEN_IDENTIFIER)
+}
+
+static void report_number_errors(Expression_Check *check, Expression_Checks *checks, Ast *ast)
+{
+    Ast_Expression *expr = check->expr;
+    i32 token_type = expr->token.type;
+    b32 is_int = check->context == AST_TYPE_INT;
+
+    if (is_unary(expr, ast))
     {
-        Ident_Info ident_info;
-        if (!lookup_ident_info(&ident_info, expr->token, function, functions_root))
+        if (token_type == '!')
         {
-            return false;
+            report_error(&expr->token, is_int ? "invalid unary operator '!' in int expression"
+                                              : "invalid unary operator '!' in double expression");
+            return;
         }
-        if (expr->function_invocation)
+
+        b32 negated = token_type == '-';
+        for (Ast_Expression *unary = get_expression(ast, expr->left); unary; unary = get_expression(ast, unary->left))
         {
-            if (!check_function_invocation(expr->function_invocation, &ident_info, function, functions_root))
+            if (unary->token.type == '!')
             {
-                return false;
+                report_error(&unary->token, "invalid unary operator '!' in +,- unary operators");
+                return;
             }
+            negated ^= unary->token.type == '-';
         }
-        return true;
+        push_expression_check(checks, get_expression(ast, expr->right), check->context, negated);
     }
-    else if (type == '(')
+    else if (is_arithmetic_operator(token_type))
     {
-        b32 check = check_expr_bool(expr->left, function, functions_root);
-        return check;
+        push_expression_check(checks, get_expression(ast, expr->right), check->context, false);
+        push_expression_check(checks, get_expression(ast, expr->left), check->context, false);
     }
-    report_error(expr->token, "not a bool-expression");
-    return false;
-}
-
-static b32 check_expr_string(Ast_Expression *expr, Ast_Function *function, Ast_Function *functions_root)
-{
-    if (expr->token->type == TOKEN_IDENTIFIER)
+    else if (token_type == TOKEN_IDENTIFIER)
     {
         Ident_Info info;
-        if (!lookup_ident_info(&info, expr->token, function, functions_root))
+        if (!lookup_ident_info(&info, &expr->binding, &expr->token, ast))
         {
-            return false;
+            return;
         }
-        if (!type_is_string(info.type))
+        if (!(get_type(ast, info.type)->types & check->context))
         {
-            report_error(expr->token, "identifier is not of type string");
-            return false;
+            report_error(&expr->token, is_int ? "type is not int" : "is not type double");
+            return;
         }
-        return true;
+        report_call_errors(expr, &info, checks, ast);
     }
-    else if (expr->token->type == TOKEN_LITERAL_STRING)
+    else if (token_type == TOKEN_LITERAL_INT)
     {
-        return true;
+        report_error(&expr->token, "int literal too large");
+    }
+    else if (token_type == '(')
+    {
+        push_expression_check(checks, get_expression(ast, expr->left), check->context, false);
+    }
+    else if (token_type == TOKEN_LITERAL_DOUBLE && is_int)
+    {
+        report_error(&expr->token, "cannot convert double to int");
+    }
+    else
+    {
+        report_error(&expr->token, is_int ? "not an int-expression" : "not a double-expression");
     }
-    report_error(expr->token, "is not type string");
-    return false;
 }
 
-static b32 check_expr(Ast_Expression *expr, Ast_Type *type, Ast_Function *function, Ast_Function *functions_root)
+static void report_bool_errors(Expression_Check *check, Expression_Checks *checks, Ast *ast)
 {
-    assert(expr);
+    Ast_Expression *expr = check->expr;
+    i32 token_type = expr->token.type;
 
-    while (expr->token->type == '(')
+    if (is_unary(expr, ast) && token_type == '!')
+    {
+        for (Ast_Expression *unary = get_expression(ast, expr->left); unary; unary = get_expression(ast, unary->left))
+        {
+            if (unary->token.type != '!')
+            {
+                report_error(&unary->token, "unary operator is not '!' in +,- unary operators");
+                return;
+            }
+        }
+        push_expression_check(checks, get_expression(ast, expr->right), AST_TYPE_BOOL, false);
+    }
+    else if (token_type == TOKEN_ANDAND || token_type == TOKEN_OROR)
     {
-        expr = expr->left;
+        push_expression_check(checks, get_expression(ast, expr->right), AST_TYPE_BOOL, false);
+        push_expression_check(checks, get_expression(ast, expr->left), AST_TYPE_BOOL, false);
     }
-
-    if (type_is_int(type))
+    else if (is_comparison_operator(token_type))
     {
-        b32 check = check_expr_int(expr, false, function, functions_root);
-        return check;
+        // TOKEN_EQEQ does not work with bools!
+        push_expression_check(checks, get_expression(ast, expr->right), AST_TYPE_DOUBLE, false);
+        push_expression_check(checks, get_expression(ast, expr->left), AST_TYPE_DOUBLE, false);
     }
-    else if (type_is_double(type))
+    else if (token_type == TOKEN_IDENTIFIER)
     {
-        b32 check = check_expr_double(expr, false, function, functions_root);
-        return check;
+        Ident_Info info;
+        if (lookup_ident_info(&info, &expr->binding, &expr->token, ast))
+        {
+            report_call_errors(expr, &info, checks, ast);
+        }
     }
-    else if (type_is_string(type))
+    else if (token_type == '(')
     {
-        b32 check = check_expr_string(expr, function, functions_root);
-        return check;
+        push_expression_check(checks, get_expression(ast, expr->left), AST_TYPE_BOOL, false);
     }
     else
     {
-        assert(0);
+        report_error(&expr->token, "not a bool-expression");
     }
-
-    report_error(expr->token, "expression is no type at all");
-    return false;
 }
 
-static b32 check_ident_is_not_used_in_expr(Token *ident, Ast_Expression *expr)
+static void report_string_errors(Expression_Check *check, Expression_Checks *checks, Ast *ast)
 {
-    if (!expr)
-    {
-        return true;
-    }
-
-    if (expr->function_invocation)
+    Ast_Expression *expr = check->expr;
+    if (expr->token.type == TOKEN_IDENTIFIER)
     {
-        Ast_Argument *arg = expr->function_invocation->args_root;
-        while (arg)
+        Ident_Info info;
+        if (lookup_ident_info(&info, &expr->binding, &expr->token, ast))
         {
-            if (!check_ident_is_not_used_in_expr(ident, arg->expr))
-            {
-                return false;
-            }
-            arg = arg->next;
+            report_error(&expr->token, "identifier is not of type string");
         }
     }
-    else if (expr->token->type == TOKEN_IDENTIFIER && strings_equal_ref(expr->token->str_ref, ident->str_ref))
+    else if (expr->token.type == '(')
     {
-        report_error(expr->token, "identifier is not initialized");
-        return false;
+        push_expression_check(checks, get_expression(ast, expr->left), AST_TYPE_STRING, false);
+    }
+    else
+    {
+        report_error(&expr->token, "is not type string");
     }
-
-    b32 check_left  = check_ident_is_not_used_in_expr(ident, expr->left);
-    b32 check_right = check_ident_is_not_used_in_expr(ident, expr->right);
-    return check_left && check_right;
 }
 
-static b32 check_ident_is_initialized_when_used_in_statement(Ast_Statement *statement, Token *ident, b32 *has_been_initted)
+// Only runs once an expression failed its check. Goes down into the children whose
+// types don't fit, left before right, so the errors are the ones a check of every
+// node from the top would report, in the same order.
+static void report_expression_errors(Ast_Expression *expr, u8 context, Ast *ast)
 {
-    if (statement->type == AST_ASSIGNMENT)
+    Expression_Checks checks = {0};
+    push_expression_check(&checks, expr, context, false);
+    while (checks.count)
     {
-        Ast_Assignment *ast_assignment = &statement->stmt_assignment;
-        if (!check_ident_is_not_used_in_expr(ident, ast_assignment->expr))
+        Expression_Check check = checks.nodes[--checks.count];
+        u8 types = check.negated ? check.expr->types >> AST_TYPES_NEGATED_SHIFT : check.expr->types;
+        if (types & check.context)
         {
-            return false;
-        }
-        if (strings_equal_ref(ident->str_ref, ast_assignment->ident->str_ref))
-        {
-            *has_been_initted = true;
-            return true;
+            continue;
         }
-    }
-    else if (statement->type == AST_IF)
-    {
-        Ast_If *ast_if = &statement->stmt_if;
 
-        if (!check_ident_is_not_used_in_expr(ident, ast_if->expr))
+        if (check.context == AST_TYPE_BOOL)
         {
-            return false;
+            report_bool_errors(&check, &checks, ast);
         }
-
-        if (!check_ident_is_initialized_when_used_in_statement(ast_if->statement_if, ident, has_been_initted))
+        else if (check.context == AST_TYPE_STRING)
         {
-            return false;
+            report_string_errors(&check, &checks, ast);
         }
-
-        if (ast_if->statement_else &&
-            !check_ident_is_initialized_when_used_in_statement(ast_if->statement_if, ident, has_been_initted))
+        else
         {
-            return false;
+            report_number_errors(&check, &checks, ast);
         }
     }
-    else if (statement->type == AST_WHILE)
-    {
-        Ast_While *ast_while = &statement->stmt_while;
-
-        if (!check_ident_is_not_used_in_expr(ident, ast_while->expr))
-        {
-            return false;
-        }
+    os_free_memory(checks.nodes);
+}
 
-        if (!check_ident_is_initialized_when_used_in_statement(ast_while->statement, ident, has_been_initted))
-        {
-            return false;
-        }
-    }
-    else if (statement->type == AST_BLOCK)
+// the types were computed by type_expressions, only a failed check looks further
+static b32 check_expr_context(Ast_Expression *expr, u8 context, Ast *ast)
+{
+    assert(expr);
+    if (expr->types & context)
     {
-        Ast_Block *ast_block = &statement->stmt_block;
-
-        Ast_Statement *statement = ast_block->statements_root;
-        while (statement)
-        {
-            if (!check_ident_is_initialized_when_used_in_statement(statement, ident, has_been_initted))
+        return true;
+    }
+    report_expression_errors(expr, context, ast);
+    return false;
+}
+
+static b32 check_expr(Ast_Expression *expr, Ast_Index type, Ast *ast)
+{
+    u8 context = get_type(ast, type)->types;
+    if (!context)
+    {
+        assert(0);
+        report_error(&expr->token, "expression is no type at all");
+        return false;
+    }
+    return check_expr_context(expr, context, ast);
+}
+
+static b32 check_expr_bool(Ast_Expression *expr, Ast *ast)
+{
+    return check_expr_context(expr, AST_TYPE_BOOL, ast);
+}
+
+// The checks that depend on the order in which statements run work on a control flow
+// graph of the function, built once. Its blocks are straight runs of items, numbered
+// from 1 in source order, and the items of a block go up to the next block's first.
+// Statements after a return start a block without predecessors, so they are never
+// reached.
+typedef enum {
+    FLOW_STATEMENT, // a statement starts, index into the statement pool
+    FLOW_EVALUATE,  // an expression is evaluated, index into the expression pool
+    FLOW_ASSIGN,    // a local gets a value, the index of its declaration in the function
+} Flow_Item_Type;
+
+typedef struct {
+    Flow_Item_Type type;
+    u32 index;
+} Flow_Item;
+
+typedef struct {
+    u32 item_start;
+    u32 successors[2]; // 0 is none
+    b32 reachable;
+    b32 queued;
+} Flow_Block;
+
+// the function body, a block, while or if whose statements are still being added
+typedef struct {
+    Ast_Statement *statement; // 0 for the function body
+    Ast_Span statements;      // the function body and blocks
+    u32 next;                 // the next of the statements, or how many an if or while has done
+    u32 condition;            // the block that ends with the condition of an if or while
+    u32 then_end;             // the block the then-statement of an if ended in
+} Flow_Frame;
+
+typedef struct {
+    AST_POOL(Flow_Block) blocks;
+    AST_POOL(Flow_Item)  items;
+    AST_POOL(Flow_Frame) frames;
+    AST_POOL(u32)        worklist;
+    AST_POOL(Ast_Index)  expression_stack;
+    u32 current; // the block items are added to
+    u32 end;     // the block that falls off the end of the function
+
+    // one bit per local, the ones that definitely have a value at the start of each block
+    AST_POOL(u64) assigned;
+    u32 words; // per block
+} Flow_Graph;
+
+static void free_flow_graph(Flow_Graph *graph)
+{
+    os_free_memory(graph->blocks.nodes);
+    os_free_memory(graph->items.nodes);
+    os_free_memory(graph->frames.nodes);
+    os_free_memory(graph->worklist.nodes);
+    os_free_memory(graph->expression_stack.nodes);
+    os_free_memory(graph->assigned.nodes);
+}
+
+static u32 add_flow_block(Flow_Graph *graph)
+{
+    u32 index = AST_POOL_PUSH(graph->blocks);
+    graph->blocks.nodes[index].item_start = graph->items.count;
+    return index;
+}
+
+static void add_flow_edge(Flow_Graph *graph, u32 from, u32 to)
+{
+    Flow_Block *block = &graph->blocks.nodes[from];
+    u32 slot = block->successors[0] ? 1 : 0;
+    assert(!block->successors[slot]);
+    block->successors[slot] = to;
+}
+
+// items always go to the newest block
+static void add_flow_item(Flow_Graph *graph, Flow_Item_Type type, u32 index)
+{
+    assert(graph->current == graph->blocks.count - 1);
+    u32 item = AST_POOL_PUSH(graph->items);
+    graph->items.nodes[item].type = type;
+    graph->items.nodes[item].index = index;
+}
+
+static void push_flow_frame(Flow_Graph *graph, Ast_Statement *statement, Ast_Span statements)
+{
+    u32 index = AST_POOL_PUSH(graph->frames);
+    Flow_Frame *frame = &graph->frames.nodes[index];
+    frame->statement = statement;
+    frame->statements = statements;
+    frame->condition = graph->current;
+}
+
+// adds the items of statement, the statements in it are added through its frame
+static void add_flow_statement(Flow_Graph *graph, Ast_Statement *statement, Ast_Function *function, Ast *ast)
+{
+    add_flow_item(graph, FLOW_STATEMENT, statement - ast->statements.nodes);
+    switch (statement->type)
+    {
+        case AST_ASSIGNMENT:
+        {
+            Ast_Assignment *assignment = &statement->stmt_assignment;
+            add_flow_item(graph, FLOW_EVALUATE, assignment->expr);
+            if (assignment->binding.type == AST_DECLARATION)
             {
-                return false;
+                add_flow_item(graph, FLOW_ASSIGN, assignment->binding.index - function->declarations.start);
             }
+        }
+        break;
+
+        case AST_EXPRESSION:
+        {
+            add_flow_item(graph, FLOW_EVALUATE, statement->stmt_expr);
+        }
+        break;
 
-            if (*has_been_initted)
+        case AST_RETURN:
+        {
+            if (statement->stmt_return.expr)
             {
-                return true;
+                add_flow_item(graph, FLOW_EVALUATE, statement->stmt_return.expr);
             }
+            graph->current = add_flow_block(graph);
+        }
+        break;
 
-            statement = statement->next;
+        case AST_BLOCK:
+        {
+            push_flow_frame(graph, statement, statement->stmt_block.statements);
         }
+        break;
+
+        case AST_IF:
+        {
+            Ast_Span none = {0};
+            u32 condition = graph->current;
+            add_flow_item(graph, FLOW_EVALUATE, statement->stmt_if.expr);
+            push_flow_frame(graph, statement, none);
+            graph->current = add_flow_block(graph);
+            add_flow_edge(graph, condition, graph->current);
+        }
+        break;
+
+        case AST_WHILE:
+        {
+            Ast_Span none = {0};
+            u32 condition = add_flow_block(graph);
+            add_flow_edge(graph, graph->current, condition);
+            graph->current = condition;
+            add_flow_item(graph, FLOW_EVALUATE, statement->stmt_while.expr);
+            push_flow_frame(graph, statement, none);
+            graph->current = add_flow_block(graph);
+            add_flow_edge(graph, condition, graph->current);
+        }
+        break;
+
+        default: assert(0);
     }
-    else if (statement->type == AST_RETURN)
-    {
-        Ast_Return *ast_return = &statement->stmt_return;
+}
 
-        if (ast_return->expr &&
-            !check_ident_is_not_used_in_expr(ident, ast_return->expr))
+// the declarations' initializers run first, in order, then the statements
+static void build_flow_graph(Flow_Graph *graph, Ast_Function *function, Ast *ast)
+{
+    AST_POOL_PUSH(graph->blocks); // 0 is no block
+    graph->current = add_flow_block(graph);
+    for (u32 i = 0; i < function->declarations.count; i++)
+    {
+        Ast_Declaration *decl = &ast->declarations.nodes[function->declarations.start + i];
+        if (decl->expr)
         {
-            return false;
+            add_flow_item(graph, FLOW_EVALUATE, decl->expr);
+            add_flow_item(graph, FLOW_ASSIGN, i);
         }
     }
-    else if (statement->type == AST_EXPRESSION)
+
+    push_flow_frame(graph, 0, function->statements);
+    while (graph->frames.count)
     {
-        Ast_Function_Invocation *function_invoc = statement->stmt_expr.function_invocation;
-        if (function_invoc)
+        Flow_Frame *frame = &graph->frames.nodes[graph->frames.count - 1];
+        Ast_Statement *statement = frame->statement;
+        Ast_Statement *next = 0;
+        if (!statement || statement->type == AST_BLOCK)
         {
-            Ast_Argument *arg = function_invoc->args_root;
-            while (arg)
+            if (frame->next < frame->statements.count)
             {
-                if (arg->expr && !check_ident_is_not_used_in_expr(ident, arg->expr))
-                {
-                    return false;
-                }
+                next = get_statement(ast, frame->statements.start + frame->next++);
             }
         }
+        else if (statement->type == AST_WHILE)
+        {
+            if (frame->next++ == 0)
+            {
+                next = get_statement(ast, statement->stmt_while.statement);
+            }
+            else
+            {
+                // back to the condition, which is the only way out
+                add_flow_edge(graph, graph->current, frame->condition);
+                graph->current = add_flow_block(graph);
+                add_flow_edge(graph, frame->condition, graph->current);
+            }
+        }
+        else
+        {
+            Ast_If *ast_if = &statement->stmt_if;
+            if (frame->next == 0)
+            {
+                next = get_statement(ast, ast_if->statement_if);
+            }
+            else if (frame->next == 1 && ast_if->statement_else)
+            {
+                frame->then_end = graph->current;
+                graph->current = add_flow_block(graph);
+                add_flow_edge(graph, frame->condition, graph->current);
+                next = get_statement(ast, ast_if->statement_else);
+            }
+            else
+            {
+                u32 join = add_flow_block(graph);
+                add_flow_edge(graph, graph->current, join);
+                add_flow_edge(graph, ast_if->statement_else ? frame->then_end : frame->condition, join);
+                graph->current = join;
+            }
+            frame->next++;
+        }
+
+        if (next)
+        {
+            add_flow_statement(graph, next, function, ast);
+        }
+        else
+        {
+            graph->frames.count--;
+        }
     }
+    graph->end = graph->current;
+}
 
-    return true;
+static void queue_flow_block(Flow_Graph *graph, u32 block)
+{
+    if (!graph->blocks.nodes[block].queued)
+    {
+        graph->blocks.nodes[block].queued = true;
+        u32 index = AST_POOL_PUSH(graph->worklist);
+        graph->worklist.nodes[index] = block;
+    }
 }
 
-static b32 check_ident_is_initialized_when_used_in_statements(Ast_Declaration *decl, Ast_Statement *statements_root)
+// Finds the reachable blocks and the locals assigned at the start of each, as a
+// worklist over the blocks: a block's locals are the ones assigned at the end of
+// every reachable predecessor, so they only shrink until nothing changes.
+static void solve_flow_graph(Flow_Graph *graph, u32 local_count)
 {
-    Ast_Declaration *decl_it = decl;
-    while (decl_it)
+    u32 words = local_count / 64 + 1;
+    graph->words = words;
+    AST_POOL_RESERVE(graph->assigned, (graph->blocks.count + 1) * words);
+    u64 *assigned = graph->assigned.nodes;
+    u64 *out = assigned + graph->blocks.count * words; // a scratch set after the blocks' ones
+
+    // nothing is assigned at the start of the function
+    memset(assigned + words, 0, words * sizeof(u64));
+    graph->blocks.nodes[1].reachable = true;
+    queue_flow_block(graph, 1);
+
+    while (graph->worklist.count)
     {
-        if (decl_it->expr)
+        u32 block = graph->worklist.nodes[--graph->worklist.count];
+        graph->blocks.nodes[block].queued = false;
+
+        memcpy(out, assigned + block * words, words * sizeof(u64));
+        u32 item_end = block + 1 < graph->blocks.count ? graph->blocks.nodes[block + 1].item_start : graph->items.count;
+        for (u32 i = graph->blocks.nodes[block].item_start; i < item_end; i++)
         {
-            if (!check_ident_is_not_used_in_expr(decl->ident, decl_it->expr))
+            Flow_Item *item = &graph->items.nodes[i];
+            if (item->type == FLOW_ASSIGN)
             {
-                return false;
+                out[item->index / 64] |= 1ull << (item->index % 64);
+            }
+        }
+
+        for (u32 i = 0; i < 2; i++)
+        {
+            u32 successor = graph->blocks.nodes[block].successors[i];
+            if (!successor)
+            {
+                continue;
+            }
+
+            u64 *successor_assigned = assigned + successor * words;
+            if (!graph->blocks.nodes[successor].reachable)
+            {
+                graph->blocks.nodes[successor].reachable = true;
+                memcpy(successor_assigned, out, words * sizeof(u64));
+                queue_flow_block(graph, successor);
+                continue;
+            }
+
+            b32 changed = false;
+            for (u32 word = 0; word < words; word++)
+            {
+                u64 meet = successor_assigned[word] & out[word];
+                changed = changed || meet != successor_assigned[word];
+                successor_assigned[word] = meet;
+            }
+            if (changed)
+            {
+                queue_flow_block(graph, successor);
             }
         }
-        decl_it = decl_it->next;
     }
+}
 
-    Ast_Statement *statement = statements_root;
-    b32 ident_now_initted = false;
-    while (statement && !ident_now_initted)
+// the first local in expr that is used without a value, 0 if there is none
+static Ast_Expression *find_unassigned_use(Flow_Graph *graph, Ast_Index expr, u64 *assigned, Ast_Function *function, Ast *ast)
+{
+    graph->expression_stack.count = 0;
+    u32 index = AST_POOL_PUSH(graph->expression_stack);
+    graph->expression_stack.nodes[index] = expr;
+    while (graph->expression_stack.count)
     {
-        if (!check_ident_is_initialized_when_used_in_statement(statement, decl->ident, &ident_now_initted))
+        Ast_Expression *node = get_expression(ast, graph->expression_stack.nodes[--graph->expression_stack.count]);
+        if (node->is_call)
         {
-            return false;
+            // the arguments in order
+            for (u32 i = node->arguments.count; i-- > 0;)
+            {
+                index = AST_POOL_PUSH(graph->expression_stack);
+                graph->expression_stack.nodes[index] = ast->arguments.nodes[node->arguments.start + i];
+            }
+            continue;
+        }
+        if (node->token.type == TOKEN_IDENTIFIER && node->binding.type == AST_DECLARATION)
+        {
+            u32 local = node->binding.index - function->declarations.start;
+            if (!(assigned[local / 64] & (1ull << (local % 64))))
+            {
+                return node;
+            }
         }
-        statement = statement->next;
-    }
 
-    return true;
+        Ast_Index children[2] = {node->right, node->left};
+        for (u32 i = 0; i < 2; i++)
+        {
+            if (children[i])
+            {
+                index = AST_POOL_PUSH(graph->expression_stack);
+                graph->expression_stack.nodes[index] = children[i];
+            }
+        }
+    }
+    return 0;
 }
 
-static b32 check_statement(Ast_Statement *statement, Ast_Function *function, Ast_Function *functions_root)
+// reports the first use of a local that doesn't definitely have a value, in source order
+static b32 check_locals_are_assigned(Flow_Graph *graph, Ast_Function *function, Ast *ast)
 {
-    switch (statement->type)
+    u32 words = graph->words;
+    u64 *assigned = graph->assigned.nodes + graph->blocks.count * words; // the scratch set
+    for (u32 block = 1; block < graph->blocks.count; block++)
     {
-        case AST_DECLARATION:
+        if (!graph->blocks.nodes[block].reachable)
         {
-            Ast_Declaration *decl = &statement->stmt_decl;
-            if (decl->expr)
+            continue;
+        }
+
+        memcpy(assigned, graph->assigned.nodes + block * words, words * sizeof(u64));
+        u32 item_end = block + 1 < graph->blocks.count ? graph->blocks.nodes[block + 1].item_start : graph->items.count;
+        for (u32 i = graph->blocks.nodes[block].item_start; i < item_end; i++)
+        {
+            Flow_Item *item = &graph->items.nodes[i];
+            if (item->type == FLOW_ASSIGN)
             {
-                if (!check_expr(decl->expr, decl->type, function, functions_root))
-                {
-                    return false;
-                }
-                if (!check_ident_is_not_used_in_expr(decl->ident, decl->expr))
-                {
-                    return false;
-                }
+                assigned[item->index / 64] |= 1ull << (item->index % 64);
             }
-            else
+            else if (item->type == FLOW_EVALUATE)
             {
-                if (!check_ident_is_initialized_when_used_in_statements(decl, statement))
+                Ast_Expression *use = find_unassigned_use(graph, item->index, assigned, function, ast);
+                if (use)
                 {
+                    report_error(&use->token, "identifier is not initialized");
                     return false;
                 }
             }
         }
-        break;
+    }
+    return true;
+}
 
-        case AST_ASSIGNMENT:
+// the initializers run first and in order, with only the locals before them assigned
+static b32 check_declarations(Flow_Graph *graph, Ast_Function *function, Ast *ast)
+{
+    u64 *assigned = graph->assigned.nodes + graph->blocks.count * graph->words; // the scratch set
+    memset(assigned, 0, graph->words * sizeof(u64));
+    for (u32 i = 0; i < function->declarations.count; i++)
+    {
+        Ast_Declaration *decl = &ast->declarations.nodes[function->declarations.start + i];
+        if (!decl->expr)
         {
-             Ast_Assignment *assignment = &statement->stmt_assignment;
-             Ident_Info ident_info;
-             if (!lookup_ident_info(&ident_info, assignment->ident, function, functions_root))
-             {
-                return false;
-             }
-             b32 check = check_expr(assignment->expr, ident_info.type, function, functions_root);
-             return check;
+            continue;
+        }
+        if (!check_expr(get_expression(ast, decl->expr), decl->type, ast))
+        {
+            return false;
         }
-        break;
 
-        case AST_IF:
+        Ast_Expression *use = find_unassigned_use(graph, decl->expr, assigned, function, ast);
+        if (use)
         {
-            Ast_If *ast_if = &statement->stmt_if;
-            b32 check_if_expr = check_expr_bool(ast_if->expr, function, functions_root);
-            b32 check_if_statement = check_statement(ast_if->statement_if, function, functions_root);
-            if (ast_if->statement_else)
-            {
-                b32 check_else_statement = check_statement(ast_if->statement_else, function, functions_root);
-                b32 check = check_if_expr && check_if_statement && check_else_statement;
-                return check;
-            }
-            b32 check = check_if_expr && check_if_statement;
-            return check;
+            report_error(&use->token, "identifier is not initialized");
+            return false;
         }
-        break;
+        assigned[i / 64] |= 1ull << (i % 64);
+    }
+    return true;
+}
 
-        case AST_WHILE:
+// warns at the first statement of every run of statements that can't be reached
+static void warn_unreachable_statements(Flow_Graph *graph, Ast *ast)
+{
+    b32 was_reachable = true;
+    u32 block = 1;
+    for (u32 i = 0; i < graph->items.count; i++)
+    {
+        while (block + 1 < graph->blocks.count && graph->blocks.nodes[block + 1].item_start <= i)
         {
-            Ast_While *ast_while = &statement->stmt_while;
-            b32 check_expr = check_expr_bool(ast_while->expr, function, functions_root);
-            b32 check_stmt = check_statement(ast_while->statement, function, functions_root);
-            b32 check = check_expr && check_stmt;
-            return check;
+            block++;
         }
-        break;
 
-        case AST_BLOCK:
+        Flow_Item *item = &graph->items.nodes[i];
+        if (item->type == FLOW_STATEMENT)
         {
-            Ast_Statement *s = statement->stmt_block.statements_root;
-            while (s)
+            b32 reachable = graph->blocks.nodes[block].reachable;
+            if (!reachable && was_reachable)
             {
-                if (!check_statement(s, function, functions_root))
-                {
-                    return false;
-                }
-                s = s->next;
+                report_warning(ast->statements.nodes[item->index].offset, "statement is unreachable");
             }
-            return true;
+            was_reachable = reachable;
+        }
+    }
+}
+
+// the statements without statements in them
+static b32 check_simple_statement(Ast_Statement *statement, Ast_Function *function, Ast *ast)
+{
+    switch (statement->type)
+    {
+        case AST_ASSIGNMENT:
+        {
+             Ast_Assignment *assignment = &statement->stmt_assignment;
+             Ident_Info ident_info;
+             if (!lookup_ident_info(&ident_info, &assignment->binding, &assignment->ident, ast))
+             {
+                return false;
+             }
+             b32 check = check_expr(get_expression(ast, assignment->expr), ident_info.type, ast);
+             return check;
         }
         break;
 
         case AST_RETURN:
         {
             Ast_Return *ast_return = &statement->stmt_return;
-            if (type_is_void(function->type))
+            if (get_type(ast, function->type)->is_void)
             {
                 if (ast_return->expr)
                 {
-                    report_error(function->ident, "function type is void but return statement has expression");
+                    report_error(&function->ident, "function type is void but return statement has expression");
                     return false;
                 }
                 return true;
             }
             if (!ast_return->expr)
             {
-                report_error(function->ident, "function type is not void but return has no expression");
+                report_error(&function->ident, "function type is not void but return has no expression");
                 return false;
             }
-            return check_expr(ast_return->expr, function->type, function, functions_root);
+            return check_expr(get_expression(ast, ast_return->expr), function->type, ast);
         }
         break;
 
         case AST_EXPRESSION:
         {
-            Ast_Function_Invocation *function_invocation = statement->stmt_expr.function_invocation;
-            if (function_invocation)
-            {
-                Ident_Info ident_info;
-                if (!lookup_ident_info(&ident_info, function_invocation->ident, function, functions_root))
-                {
-                    return false;
-                }
-                b32 check = check_function_invocation(function_invocation, &ident_info, function, functions_root);
-                return check;
-            }
-            return true;
+            // a call is a bool if it is valid
+            b32 check = check_expr_bool(get_expression(ast, statement->stmt_expr), ast);
+            return check;
         }
         break;
 
@@ -821,88 +1052,585 @@ static b32 check_statement(Ast_Statement *statement, Ast_Function *function, Ast
     return true;
 }
 
-static b32 check_statement_definitely_returns(Ast_Statement *statement)
+// a block, if or while whose statements are still being checked
+typedef struct {
+    Ast_Statement *statement; // 0 for the function body
+    u32 next;                 // the next of its statements
+    b32 check;                // of what was checked so far
+} Check_Frame;
+
+// Nested statements are checked with a stack of frames instead of recursing, like the
+// flow graph is built, so deep nesting can't overflow the call stack. A block stops at
+// its first statement that fails, an if or while checks its condition and all of its
+// statements.
+static b32 check_statements(Ast_Function *function, Ast *ast)
 {
-    if (statement->type == AST_RETURN)
+    AST_POOL(Check_Frame) frames = {0};
+    AST_POOL_PUSH(frames);
+    frames.nodes[0].check = true;
+
+    b32 check = true;
+    while (frames.count)
     {
-        return true;
+        Check_Frame *frame = &frames.nodes[frames.count - 1];
+        Ast_Statement *statement = frame->statement;
+        Ast_Index child = 0;
+        if (!statement || statement->type == AST_BLOCK)
+        {
+            Ast_Span statements = statement ? statement->stmt_block.statements : function->statements;
+            if (frame->check && frame->next < statements.count)
+            {
+                child = statements.start + frame->next;
+            }
+        }
+        else if (statement->type == AST_IF)
+        {
+            Ast_If *ast_if = &statement->stmt_if;
+            if (frame->next == 0)
+            {
+                frame->check = check_expr_bool(get_expression(ast, ast_if->expr), ast);
+                child = ast_if->statement_if;
+            }
+            else if (frame->next == 1)
+            {
+                child = ast_if->statement_else;
+            }
+        }
+        else
+        {
+            assert(statement->type == AST_WHILE);
+            Ast_While *ast_while = &statement->stmt_while;
+            if (frame->next == 0)
+            {
+                frame->check = check_expr_bool(get_expression(ast, ast_while->expr), ast);
+                child = ast_while->statement;
+            }
+        }
+        frame->next++;
+
+        // a finished frame hands its check to the one below
+        if (!child)
+        {
+            b32 frame_check = frame->check;
+            frames.count--;
+            if (frames.count)
+            {
+                Check_Frame *parent = &frames.nodes[frames.count - 1];
+                parent->check = parent->check && frame_check;
+            }
+            else
+            {
+                check = frame_check;
+            }
+            continue;
+        }
+
+        Ast_Statement *child_statement = get_statement(ast, child);
+        if (child_statement->type == AST_BLOCK || child_statement->type == AST_IF || child_statement->type == AST_WHILE)
+        {
+            u32 index = AST_POOL_PUSH(frames);
+            frames.nodes[index].statement = child_statement;
+            frames.nodes[index].check = true;
+        }
+        else
+        {
+            b32 child_check = check_simple_statement(child_statement, function, ast);
+            frame->check = frame->check && child_check;
+        }
     }
-    else if (statement->type == AST_BLOCK)
+
+    os_free_memory(frames.nodes);
+    return check;
+}
+
+static b32 check_function(Ast_Function *function, Ast *ast)
+{
+    if (!parse_function_body(ast, function))
+    {
+        return false;
+    }
+    type_expressions(function, ast);
+
+    Flow_Graph graph = {0};
+    build_flow_graph(&graph, function, ast);
+    solve_flow_graph(&graph, function->declarations.count);
+
+    // each initializer is typechecked, then checked for uses of locals without a value, in order
+    b32 check = check_declarations(&graph, function, ast);
+
+    // uses of locals without a value are reported before the statements are typechecked
+    check = check && check_locals_are_assigned(&graph, function, ast) && check_statements(function, ast);
+    if (check)
     {
-        b32 has_return = false;
-        Ast_Statement *s = statement->stmt_block.statements_root;
-        while (s && !has_return)
+        warn_unreachable_statements(&graph, ast);
+
+        // the end is only reached without a return
+        if (!get_type(ast, function->type)->is_void && graph.blocks.nodes[graph.end].reachable)
         {
-            has_return = check_statement_definitely_returns(statement);
-            s = statement->next;
+            report_error(&function->ident, "function does not definitely have return");
+            check = false;
         }
-        return has_return;
     }
-    else if (statement->type == AST_IF)
+
+    free_flow_graph(&graph);
+    return check;
+}
+
+// what checking a function found, its diagnostics and dependencies are spans of an output
+typedef struct {
+    b32 checked;
+    u64 layout; // see hash_layout, only set if there are diagnostics
+    Ast_Span diagnostics;
+    Ast_Span dependencies;
+} Typer_Result;
+
+static void free_output(Typer_Output *output)
+{
+    os_free_memory(output->diagnostics.nodes);
+    os_free_memory(output->dependencies.nodes);
+}
+
+static int compare_dependencies(const void *a, const void *b)
+{
+    u32 symbol_a = ((const Typer_Dependency*)a)->symbol;
+    u32 symbol_b = ((const Typer_Dependency*)b)->symbol;
+    return symbol_a < symbol_b ? -1 : symbol_a > symbol_b;
+}
+
+// The offsets of the function's tokens that diagnostics can be at, relative to its
+// name. An edit before the function moves them all by the same amount, one between
+// its tokens changes the hash.
+static u64 hash_layout(Ast_Function *function, Ast *ast)
+{
+    u32 base = function->ident.offset;
+    u64 hash = 0x9e3779b97f4a7c15ull;
+    for (u32 i = 0; i < function->statement_nodes.count; i++)
+    {
+        Ast_Statement *statement = &ast->statements.nodes[function->statement_nodes.start + i];
+        hash = (hash ^ (statement->offset - base)) * 0xff51afd7ed558ccdull;
+        if (statement->type == AST_ASSIGNMENT)
+        {
+            hash = (hash ^ (statement->stmt_assignment.ident.offset - base)) * 0xff51afd7ed558ccdull;
+        }
+        hash ^= hash >> 32;
+    }
+    for (u32 i = 0; i < function->expression_nodes.count; i++)
+    {
+        Ast_Expression *expr = &ast->expressions.nodes[function->expression_nodes.start + i];
+        hash = (hash ^ (expr->token.offset - base)) * 0xc4ceb9fe1a85ec53ull;
+        hash ^= hash >> 32;
+    }
+    return hash;
+}
+
+// checks the function into g_output, where its diagnostics get offsets relative to its
+// name and each function it read is a dependency once
+static void check_function_into_output(Ast_Function *function, Ast *ast, Typer_Result *result)
+{
+    Typer_Output *output = g_output;
+    result->diagnostics.start = output->diagnostics.count;
+    result->dependencies.start = output->dependencies.count;
+    result->checked = check_function(function, ast);
+
+    result->diagnostics.count = output->diagnostics.count - result->diagnostics.start;
+    for (u32 i = 0; i < result->diagnostics.count; i++)
+    {
+        output->diagnostics.nodes[result->diagnostics.start + i].offset -= function->ident.offset;
+    }
+    result->layout = result->diagnostics.count ? hash_layout(function, ast) : 0;
+
+    u32 count = output->dependencies.count - result->dependencies.start;
+    u32 unique = 0;
+    if (count)
+    {
+        Typer_Dependency *dependencies = &output->dependencies.nodes[result->dependencies.start];
+        qsort(dependencies, count, sizeof(Typer_Dependency), compare_dependencies);
+        for (u32 i = 0; i < count; i++)
+        {
+            if (unique == 0 || dependencies[i].symbol != dependencies[unique - 1].symbol)
+            {
+                dependencies[unique++] = dependencies[i];
+            }
+        }
+    }
+    result->dependencies.count = unique;
+    output->dependencies.count = result->dependencies.start + unique;
+}
+
+// the lexer builds its line table on the first call, so this is for one thread only
+static void print_result(Typer_Result *result, Typer_Output *output, Ast_Function *function)
+{
+    for (u32 i = 0; i < result->diagnostics.count; i++)
     {
-        b32 if_has_return = check_statement_definitely_returns(statement->stmt_if.statement_if);
-        b32 else_has_return = false;
-        if (statement->stmt_if.statement_else)
+        Typer_Diagnostic *diagnostic = &output->diagnostics.nodes[result->diagnostics.start + i];
+        i32 line, column;
+        lexer_get_line_column(function->ident.offset + diagnostic->offset, &line, &column);
+        if (diagnostic->is_warning)
         {
-            else_has_return = check_statement_definitely_returns(statement->stmt_if.statement_else);
+            printf("typechecker warning (%d,%d): %s\n", line, column, diagnostic->message);
+        }
+        else
+        {
+            printf("typechecker error (%d,%d): %s (found token type = %d)\n", line, column, diagnostic->message, diagnostic->token_type);
         }
-        return if_has_return && else_has_return;
     }
+}
+
+// The results of the last check_ast, for the next one on the same ast. A result is
+// used again while its function is the one that was checked, which is while the
+// incremental parse keeps the function's check_result, while the functions the check
+// read have the same signatures, and while the diagnostics' tokens are where they
+// were relative to the function's name. So after an edit only the edited functions
+// and the ones that read a changed signature are checked.
+typedef struct {
+    Ast *ast;
+    AST_POOL(Typer_Result) results; // Ast_Function.check_result is the index
+    Typer_Output output;
+} Typer_Cache;
+
+static Typer_Cache g_cache;
+
+static Typer_Result *get_cached_result(Ast_Function *function, Ast *ast)
+{
+    if (g_cache.ast != ast || !function->check_result)
+    {
+        return 0;
+    }
+
+    Typer_Result *result = &g_cache.results.nodes[function->check_result];
+    for (u32 i = 0; i < result->dependencies.count; i++)
+    {
+        Typer_Dependency *dependency = &g_cache.output.dependencies.nodes[result->dependencies.start + i];
+        Ast_Binding *global = scope_lookup(ast->globals, dependency->symbol);
+        u64 signature = global ? hash_signature(&ast->functions.nodes[global->index], ast) : 0;
+        if (signature != dependency->signature)
+        {
+            return 0;
+        }
+    }
+    if (result->diagnostics.count && hash_layout(function, ast) != result->layout)
+    {
+        return 0;
+    }
+    return result;
+}
 
+// copies the result into the cache, the function's check_result is its index there
+static void store_result(Typer_Cache *cache, Typer_Result *result, Typer_Output *output, Ast_Function *function)
+{
+    u32 index = AST_POOL_PUSH(cache->results);
+    Typer_Result *stored = &cache->results.nodes[index];
+    *stored = *result;
+    stored->diagnostics.start = cache->output.diagnostics.count;
+    stored->dependencies.start = cache->output.dependencies.count;
+
+    for (u32 i = 0; i < result->diagnostics.count; i++)
+    {
+        u32 diagnostic = AST_POOL_PUSH(cache->output.diagnostics);
+        cache->output.diagnostics.nodes[diagnostic] = output->diagnostics.nodes[result->diagnostics.start + i];
+    }
+    for (u32 i = 0; i < result->dependencies.count; i++)
+    {
+        u32 dependency = AST_POOL_PUSH(cache->output.dependencies);
+        cache->output.dependencies.nodes[dependency] = output->dependencies.nodes[result->dependencies.start + i];
+    }
+    function->check_result = index;
+}
+
+// Files with many functions to check are checked on several threads. Checking a
+// function only writes to the nodes of its body and reads the signatures of the
+// others, their functions, parameters and types and the globals, which don't change
+// meanwhile. Each worker owns a range of the functions and takes them from the front,
+// a worker whose range is empty steals the back half of another's, so a few long
+// functions don't keep one worker busy while the others wait. The diagnostics go to
+// an output per worker and are printed in source order when all are done, up to the
+// first function that failed, the same as checking one after another.
+#define TYPER_MAX_WORKERS 16
+#define TYPER_MIN_WORKER_FUNCTIONS 256
+
+typedef struct Typer_Job Typer_Job;
+
+typedef struct {
+    Typer_Job *job;
+    i32 index;
+    volatile u64 range; // the positions left in the job's functions, the first in the low half and one past the last in the high half
+    Typer_Output output;
+} Typer_Worker;
+
+// the result of one function and the output with its spans, 0 until it has one
+typedef struct {
+    Typer_Result result;
+    Typer_Output *output;
+} Typer_Function_Result;
+
+struct Typer_Job {
+    Ast *ast;
+    Typer_Worker workers[TYPER_MAX_WORKERS];
+    i32 worker_count;
+    AST_POOL(Ast_Index) functions;           // the ones to check, from position 1
+    AST_POOL(Typer_Function_Result) results; // per function
+    volatile u64 first_failed;               // the functions after it don't need checking
+};
+
+static i32 g_thread_count; // 0 uses one thread per processor for files with many functions
+
+void typer_set_thread_count(i32 thread_count)
+{
+    g_thread_count = thread_count;
+}
+
+static u64 pack_range(u32 start, u32 end)
+{
+    return (u64)end << 32 | start;
+}
+
+// the first position of the worker's range, 0 if it is empty
+static u32 take_function(Typer_Worker *worker)
+{
+    for (;;)
+    {
+        u64 range = os_atomic_load(&worker->range);
+        u32 start = (u32)range;
+        u32 end = (u32)(range >> 32);
+        if (start == end)
+        {
+            return 0;
+        }
+        if (os_atomic_compare_exchange(&worker->range, range, pack_range(start + 1, end)))
+        {
+            return start;
+        }
+    }
+}
+
+// Moves the back half of another worker's range to the worker, whose range is empty,
+// false if all ranges are empty. A range never has the same functions twice, so a
+// compare exchange that succeeds saw the range it split.
+static b32 steal_functions(Typer_Worker *worker)
+{
+    Typer_Job *job = worker->job;
+    for (i32 i = 1; i < job->worker_count; i++)
+    {
+        Typer_Worker *victim = &job->workers[(worker->index + i) % job->worker_count];
+        for (;;)
+        {
+            u64 range = os_atomic_load(&victim->range);
+            u32 start = (u32)range;
+            u32 end = (u32)(range >> 32);
+            if (start == end)
+            {
+                break;
+            }
+
+            u32 middle = start + (end - start) / 2;
+            if (os_atomic_compare_exchange(&victim->range, range, pack_range(start, middle)))
+            {
+                os_atomic_store(&worker->range, pack_range(middle, end));
+                return true;
+            }
+        }
+    }
     return false;
 }
 
-static b32 check_statements_definitely_return(Ast_Statement *statements_root)
+static void set_first_failed(Typer_Job *job, u32 function)
 {
-    b32 have_return = false;
-    Ast_Statement *statement = statements_root;
-    while (statement && !have_return)
+    for (;;)
     {
-        have_return = check_statement_definitely_returns(statement);
-        statement = statement->next;
+        u64 first_failed = os_atomic_load(&job->first_failed);
+        if (function >= first_failed || os_atomic_compare_exchange(&job->first_failed, first_failed, function))
+        {
+            return;
+        }
     }
-    return have_return;
 }
 
-static b32 check_function(Ast_Function *function, Ast_Function *functions_root)
+static void check_functions(void *data)
 {
-    // typecheck statements
-    Ast_Statement *statement = function->statements_root;
-    while (statement)
+    Typer_Worker *worker = (Typer_Worker*)data;
+    Typer_Job *job = worker->job;
+
+    // the first worker runs on the calling thread
+    Typer_Output *saved_output = g_output;
+    g_output = &worker->output;
+
+    for (;;)
     {
-        if (!check_statement(statement, function, functions_root))
+        u32 position = take_function(worker);
+        if (!position)
         {
-            return false;
+            if (!steal_functions(worker))
+            {
+                break;
+            }
+            continue;
+        }
+        u32 function = job->functions.nodes[position];
+        if (function > os_atomic_load(&job->first_failed))
+        {
+            continue;
+        }
+
+        Typer_Function_Result *entry = &job->results.nodes[function];
+        check_function_into_output(&job->ast->functions.nodes[function], job->ast, &entry->result);
+        entry->output = &worker->output;
+        if (!entry->result.checked)
+        {
+            set_first_failed(job, function);
         }
-        statement = statement->next;
     }
 
-    // check return always reachable
-    if (!type_is_void(function->type))
+    g_output = saved_output;
+}
+
+static void run_workers(Typer_Job *job)
+{
+    Os_Thread *threads[TYPER_MAX_WORKERS];
+    for (i32 i = 1; i < job->worker_count; i++)
     {
-        if (!check_statements_definitely_return(function->statements_root))
+        threads[i] = os_create_thread(check_functions, &job->workers[i]);
+        if (!threads[i])
         {
-            report_error(function->ident, "function does not definitely have return");
-            return false;
+            check_functions(&job->workers[i]);
         }
     }
+    check_functions(&job->workers[0]);
 
-    return true;
+    for (i32 i = 1; i < job->worker_count; i++)
+    {
+        if (threads[i])
+        {
+            os_join_thread(threads[i]);
+        }
+    }
 }
 
 b32 check_ast(Ast *ast)
 {
-    Ast_Function *functions_root = ast->functions_root;
+    u32 function_count = ast->functions.count;
 
-    Ast_Function *function = functions_root;
-    while (function)
+    // All skipped bodies are parsed first, on the thread that parsed the file. So a lazily
+    // parsed ast reports every syntax error and nothing else, as parse_source does without
+    // lazy bodies, and the functions can be checked on any thread.
+    b32 parsed = true;
+    for (u32 i = 1; i < function_count; i++)
     {
-        if (!check_function(function, ast->functions_root))
+        parsed = parse_function_body(ast, &ast->functions.nodes[i]) && parsed;
+    }
+    if (!parsed)
+    {
+        return false;
+    }
+
+    Typer_Job job = {0};
+    job.ast = ast;
+    job.first_failed = function_count;
+    AST_POOL_PUSH(job.functions);
+    AST_POOL_RESERVE(job.results, function_count);
+    memset(job.results.nodes, 0, function_count * sizeof(Typer_Function_Result));
+
+    // the cached results, and the functions without one, up to the first that failed
+    u32 end = function_count;
+    for (u32 i = 1; i < end; i++)
+    {
+        Typer_Result *cached = get_cached_result(&ast->functions.nodes[i], ast);
+        if (cached)
         {
-            return false;
+            job.results.nodes[i].result = *cached;
+            job.results.nodes[i].output = &g_cache.output;
+            if (!cached->checked)
+            {
+                end = i + 1;
+            }
+        }
+        else
+        {
+            u32 index = AST_POOL_PUSH(job.functions);
+            job.functions.nodes[index] = i;
         }
-        function = function->next;
     }
-    return true;
+
+    u32 check_count = job.functions.count - 1;
+    job.worker_count = os_get_worker_count(g_thread_count, check_count, TYPER_MIN_WORKER_FUNCTIONS, TYPER_MAX_WORKERS);
+
+    if (job.worker_count > 1)
+    {
+        for (i32 i = 0; i < job.worker_count; i++)
+        {
+            Typer_Worker *worker = &job.workers[i];
+            worker->job = &job;
+            worker->index = i;
+            u32 range_start = 1 + (u64)check_count * i / job.worker_count;
+            u32 range_end = 1 + (u64)check_count * (i + 1) / job.worker_count;
+            worker->range = pack_range(range_start, range_end);
+        }
+        run_workers(&job);
+    }
+
+    // in source order, on one thread the functions are checked here
+    Typer_Cache cache = {0};
+    cache.ast = ast;
+    AST_POOL_PUSH(cache.results);
+    Typer_Output output = {0};
+    b32 checked = true;
+    u32 index = 1;
+    for (; index < end && checked; index++)
+    {
+        Ast_Function *function = &ast->functions.nodes[index];
+        Typer_Function_Result *entry = &job.results.nodes[index];
+        if (!entry->output)
+        {
+            g_output = &output;
+            check_function_into_output(function, ast, &entry->result);
+            g_output = 0;
+            entry->output = &output;
+        }
+        print_result(&entry->result, entry->output, function);
+        store_result(&cache, &entry->result, entry->output, function);
+        checked = entry->result.checked;
+    }
+
+    // the functions after the first that failed keep their results for the next check
+    for (; index < function_count; index++)
+    {
+        Ast_Function *function = &ast->functions.nodes[index];
+        Typer_Function_Result *entry = &job.results.nodes[index];
+        if (entry->output)
+        {
+            store_result(&cache, &entry->result, entry->output, function);
+        }
+        else if (g_cache.ast == ast && function->check_result)
+        {
+            store_result(&cache, &g_cache.results.nodes[function->check_result], &g_cache.output, function);
+        }
+        else
+        {
+            function->check_result = 0;
+        }
+    }
+
+    free_output(&output);
+    for (i32 i = 0; i < job.worker_count; i++)
+    {
+        free_output(&job.workers[i].output);
+    }
+    os_free_memory(job.functions.nodes);
+    os_free_memory(job.results.nodes);
+    os_free_memory(g_cache.results.nodes);
+    free_output(&g_cache.output);
+    g_cache = cache;
+    return checked;
 }
 
+b32 check_ast_function(Ast *ast, Ast_Function *function)
+{
+    Typer_Output output = {0};
+    Typer_Result result;
+    g_output = &output;
+    check_function_into_output(function, ast, &result);
+    g_output = 0;
+
+    print_result(&result, &output, function);
+    free_output(&output);
+    return result.checked;
+}
@@ -4,7 +4,15 @@
 #include "general.h"
 #include "ast.h"
 
+// Checks every function, or after an incremental parse only the functions that changed
+// and the ones that call a function whose signature changed, the others print what
+// they printed the last time. See the cache in typer.c. Bodies that were skipped by the
+// parser are parsed first, all of them, and nothing is checked if one has an error.
 b32 check_ast(Ast *ast);
+b32 check_ast_function(Ast *ast, Ast_Function *function);
+
+// 0 threads (the default) uses one thread per processor for files with many functions
+void typer_set_thread_count(i32 thread_count);
 
 #endif // TYPER_H
 
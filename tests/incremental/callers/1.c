@@ -0,0 +1,17 @@
+double square(double a) {
+    return a * a;
+}
+
+int twice(int a) {
+    return square(a) + square(a);
+}
+
+double half(double a) {
+    return a / 2.0;
+}
+
+int main(int argc) {
+    int x = twice(argc);
+    double y = half(2.5);
+    return x;
+}
@@ -0,0 +1,18 @@
+double square(double a) {
+    return a * a;
+}
+
+double twice(double a) {
+    return square(a) + square(a);
+}
+
+double half(double a) {
+    return a / 2.0;
+}
+
+int main(int argc) {
+    double x = twice(2.5);
+    int z = argc;
+    double y = half(2.5);
+    return z;
+}
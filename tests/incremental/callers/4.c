@@ -0,0 +1,16 @@
+double twice(double a) {
+    return square(a) + square(a);
+}
+
+// half of a
+double half(double a) {
+    double b = a;
+    return b / 2.0;
+}
+
+int main(int argc) {
+    double x = twice(2.5);
+    int z = argc;
+    double y = half(2.5);
+    return z;
+}
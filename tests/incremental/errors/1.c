@@ -0,0 +1,17 @@
+int add(int a, int b) {
+    return a + b;
+}
+
+int count(double n) {
+    int c = 0;
+    while (n > 0.0 {
+        n = n - 1.0;
+        c = c + 1;
+    }
+    return c;
+}
+
+int main(int argc) {
+    int x = add(argc, 2);
+    return count(2.5) + x;
+}
@@ -0,0 +1,34 @@
+#!/bin/sh
+# run by make test from the repository root, after c-frontend and test-incremental are built
+#
+# tests/samples/<name>.c has to print tests/samples/<name>.expected. Each directory in
+# tests/incremental holds the versions of a file after one edit each, in name order;
+# test-incremental parses them one after the other and has to print what it prints
+# for every version parsed on its own.
+
+failed=0
+
+for sample in tests/samples/*.c; do
+    expected="${sample%.c}.expected"
+    if ! ./c-frontend "$sample" | diff -u "$expected" -; then
+        echo "FAILED: $sample"
+        failed=1
+    fi
+done
+
+for edits in tests/incremental/*/; do
+    incremental=$(./test-incremental "$edits"*.c)
+    fresh=$(for version in "$edits"*.c; do ./test-incremental "$version"; done)
+    if [ "$incremental" != "$fresh" ]; then
+        printf '%s\n' "$fresh" > test_fresh.txt
+        printf '%s\n' "$incremental" | diff -u test_fresh.txt -
+        rm -f test_fresh.txt
+        echo "FAILED: $edits"
+        failed=1
+    fi
+done
+
+if [ $failed -eq 0 ]; then
+    echo "all tests passed"
+fi
+exit $failed
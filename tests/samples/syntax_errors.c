@@ -0,0 +1,19 @@
+int add(int a, int b) {
+    return a + ;
+}
+
+int sub(int a int b) {
+    return a - b;
+}
+
+int mul(int a, int b) {
+    int x = a * b
+    return x;
+}
+
+int main(int argc) {
+    if (argc > 1 {
+        return add(1, 2);
+    }
+    return 0;
+}
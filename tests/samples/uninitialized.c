@@ -0,0 +1,2 @@
+int f(int a) { return a; }
+int main(int s) { double x = x; int y = +(s % s > f(7)); return 0; }
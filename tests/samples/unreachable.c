@@ -0,0 +1,24 @@
+int sign(double x) {
+    if (x < 0.0) {
+        return -1;
+        x = 0.0;
+    } else {
+        return 1;
+    }
+    return 0;
+}
+
+int loop(double n) {
+    while (n > 0.0) {
+        return 1;
+        n = n - 1.0;
+    }
+    return 0;
+}
+
+int main(int argc) {
+    int s = sign(2.5);
+    return loop(2.5) + s;
+    s = 1;
+    s = 2;
+}
@@ -0,0 +1,34 @@
+// parses the first file, then every following file as an edit of the one before it
+// with parse_source_incremental, and checks and prints each version like c-frontend
+// usage: test-incremental <file> [<edited file> ...]   (the output for each version has to
+//                                                       be the one for that file alone,
+//                                                       tests/run_tests.sh compares them)
+
+#include "../src/os.h"
+#include "../src/parser.h"
+#include "../src/typer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(int argc, char **argv)
+{
+    Ast ast;
+    for (i32 i = 1; i < argc; i++)
+    {
+        // the incremental parse reuses the last version's source, so none is freed
+        char *source = os_read_file_as_string(argv[i]);
+        if (!source)
+        {
+            return EXIT_FAILURE;
+        }
+
+        printf("=== %s\n", argv[i]);
+        b32 parsed = i == 1 ? parse_source(source, &ast) : parse_source_incremental(source, &ast);
+        if (parsed && check_ast(&ast))
+        {
+            ast_print(&ast);
+        }
+    }
+    return EXIT_SUCCESS;
+}